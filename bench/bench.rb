@@ -26,6 +26,7 @@ object_structured = {
 }
 
 data_structured = MessagePack.pack(object_structured)
+schema_structured = MessagePack::DefaultFactory.compile_schema(object_structured.keys)
 
 class Extended
   def to_msgpack_ext
@@ -55,6 +56,10 @@ Benchmark.ips do |x|
     MessagePack.pack(object_structured)
   end
 
+  x.report('pack-structured-schema') do
+    MessagePack::DefaultFactory.packer.write_with_schema(schema_structured, object_structured).to_s
+  end
+
   x.report('pack-extended') do
     packer = MessagePack::Packer.new
     packer.register_type(0x00, Extended, :to_msgpack_ext)
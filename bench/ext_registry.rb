@@ -0,0 +1,56 @@
+# % bundle install
+# % bundle exec ruby bench/ext_registry.rb
+#
+# Packs and unpacks an Array of objects of 3 registered extension types,
+# with 1 to 50 types registered to the factory, and packs an Array of
+# objects of an unregistered class defining #to_msgpack.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = Integer(ENV.fetch('ITERATIONS', 1_000))
+
+Money = Struct.new(:cents)
+Uuid = Struct.new(:bytes)
+Stamp = Struct.new(:seconds)
+Plain = Struct.new(:value) do
+  def to_msgpack(packer)
+    packer.write(value)
+  end
+end
+
+[1, 5, 10, 50].each do |count|
+  factory = MessagePack::Factory.new
+  (count - 1).times do |i|
+    factory.register_type(i + 3, Class.new(Struct.new(:value)), packer: ->(o) { o.value }, unpacker: ->(s) { s })
+  end
+  factory.register_type(0, Money, packer: ->(m) { [m.cents].pack('q>') }, unpacker: ->(s) { Money.new(s.unpack1('q>')) })
+  if count >= 3
+    factory.register_type(1, Uuid, packer: ->(u) { u.bytes }, unpacker: ->(s) { Uuid.new(s) })
+    factory.register_type(2, Stamp, packer: ->(t) { [t.seconds].pack('N') }, unpacker: ->(s) { Stamp.new(s.unpack1('N')) })
+  end
+
+  objects = Array.new(1_000) do |i|
+    case count >= 3 ? i % 3 : 0
+    when 0 then Money.new(i * 100)
+    when 1 then Uuid.new("0123456789abcdef".b)
+    else Stamp.new(1_700_000_000 + i)
+    end
+  end
+  data = factory.dump(objects)
+  plains = Array.new(1_000) { |i| Plain.new(i) }
+
+  packer = factory.packer
+  pack = Benchmark.realtime do
+    ITERATIONS.times { packer.write(objects); packer.reset }
+  end
+  unpack = Benchmark.realtime do
+    ITERATIONS.times { factory.load(data) }
+  end
+  unregistered = Benchmark.realtime do
+    ITERATIONS.times { packer.write(plains); packer.reset }
+  end
+  printf("%2d types: pack %8.1fus  unpack %8.1fus  pack unregistered %8.1fus\n", count,
+    pack / ITERATIONS * 1e6, unpack / ITERATIONS * 1e6, unregistered / ITERATIONS * 1e6)
+end
@@ -0,0 +1,30 @@
+# % bundle install
+# % bundle exec ruby bench/key_cache.rb
+
+require 'msgpack'
+
+require 'benchmark/ips'
+
+# Records picking 20 keys among a varying number of distinct keys
+def records_data(distinct_keys)
+  keys = (1..distinct_keys).map { |i| "field_name_#{i}" }
+  records = (0...64).map { |r| keys.sample(20, random: Random.new(r)).to_h { |k| [k, r] } }
+  MessagePack.pack(records)
+end
+
+[20, 300].each do |distinct_keys|
+  data = records_data(distinct_keys)
+
+  Benchmark.ips do |x|
+    [false, true, 1024].each do |key_cache|
+      unpacker = MessagePack::Unpacker.new(key_cache: key_cache)
+
+      x.report("unpack-#{distinct_keys}-keys-key_cache=#{key_cache}") do
+        unpacker.feed(data)
+        unpacker.read
+      end
+    end
+
+    x.compare!
+  end
+end
@@ -0,0 +1,41 @@
+# % bundle install
+# % bundle exec ruby bench/native_ext.rb
+#
+# Packs and unpacks an Array of small extension types with Ruby procs or
+# with the C functions of the MessagePack::NativeExt test extension of
+# spec/cruby/native_ext, which is built on the fly.
+
+require 'msgpack'
+
+require 'benchmark'
+require 'rbconfig'
+require 'tmpdir'
+
+ITERATIONS = Integer(ENV.fetch('ITERATIONS', 1_000))
+
+Dir.mktmpdir('msgpack_native_ext') do |dir|
+  source = File.expand_path('../spec/cruby/native_ext', __dir__)
+  system(RbConfig.ruby, File.join(source, 'extconf.rb'), chdir: dir, out: File::NULL, err: File::NULL, exception: true)
+  system('make', "srcdir=#{source}", chdir: dir, out: File::NULL, err: File::NULL, exception: true)
+  require File.join(dir, "msgpack_native_ext_test.#{RbConfig::CONFIG['DLEXT']}")
+end
+
+Blob = MessagePackNativeExtTest::Blob
+
+registrations = {
+  proc: [->(b) { b.data }, ->(s) { Blob.new(s) }],
+  native_ext: [MessagePackNativeExtTest::BLOB, MessagePackNativeExtTest::BLOB],
+}
+
+objects = Array.new(1_000) { |i| Blob.new([i, i * 7].pack('Q>Q>')) }
+
+registrations.each do |name, (packer, unpacker)|
+  factory = MessagePack::Factory.new
+  factory.register_type(0x01, Blob, packer: packer, unpacker: unpacker)
+  data = factory.dump(objects)
+  raise "mismatch" unless factory.load(data) == objects
+
+  dump = Benchmark.realtime { ITERATIONS.times { factory.dump(objects) } }
+  load = Benchmark.realtime { ITERATIONS.times { factory.load(data) } }
+  printf("%-10s dump %8.1fus  load %8.1fus\n", name, dump / ITERATIONS * 1e6, load / ITERATIONS * 1e6)
+end
@@ -0,0 +1,48 @@
+# % bundle install
+# % bundle exec ruby bench/nogvl.rb
+#
+# Measures how much work another Ruby thread gets done while large bin
+# bodies, fed to the unpacker in pieces, are copied into Strings.
+
+require 'msgpack'
+
+require 'benchmark'
+
+PAYLOAD_SIZE = 64 * 1024 * 1024
+PIECE_SIZE = 1024 * 1024
+DURATION = 3.0
+
+payload = MessagePack.pack("x".b * PAYLOAD_SIZE)
+pieces = (0...payload.bytesize).step(PIECE_SIZE).map { |i| payload.byteslice(i, PIECE_SIZE) }
+
+def unpack_for(duration, pieces, nogvl_threshold)
+  decoded = 0
+  elapsed = Benchmark.realtime do
+    deadline = Process.clock_gettime(Process::CLOCK_MONOTONIC) + duration
+    while Process.clock_gettime(Process::CLOCK_MONOTONIC) < deadline
+      unpacker = MessagePack::Unpacker.new(nogvl_threshold: nogvl_threshold)
+      pieces.each { |piece| unpacker.feed_reference(piece) }
+      unpacker.read
+      decoded += 1
+    end
+  end
+  [decoded * PAYLOAD_SIZE / elapsed / 1e6, elapsed]
+end
+
+[nil, 1024 * 1024].each do |nogvl_threshold|
+  alone, _ = unpack_for(DURATION, pieces, nogvl_threshold)
+
+  ticks = 0
+  stop = false
+  ticker = Thread.new do
+    until stop
+      ticks += 1
+    end
+  end
+  shared, elapsed = unpack_for(DURATION, pieces, nogvl_threshold)
+  stop = true
+  ticker.join
+
+  printf("nogvl_threshold=%-8s unpack alone: %6.1f MB/s  unpack with a busy thread: %6.1f MB/s  busy thread: %5.1f M ticks/s\n",
+         nogvl_threshold.inspect, alone, shared, ticks / elapsed / 1e6)
+end
@@ -0,0 +1,29 @@
+# % bundle install
+# % bundle exec ruby bench/numeric_array.rb
+#
+# Measures packing 10k-element Arrays of Floats and Integers, element by
+# element and in bulk.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = 1_000
+
+floats = Array.new(10_000) { rand }
+ints = Array.new(10_000) { rand(-2**40..2**40) }
+
+def pack_each(array)
+  packer = MessagePack::Packer.new
+  packer.write_array_header(array.size)
+  array.each { |e| packer.write(e) }
+  packer.to_s
+end
+
+[['floats', floats, :write_float_array], ['ints', ints, :write_int_array]].each do |name, array, method|
+  each = Benchmark.realtime { ITERATIONS.times { pack_each(array) } }
+  bulk = Benchmark.realtime { ITERATIONS.times { MessagePack.pack(array) } }
+  typed = Benchmark.realtime { ITERATIONS.times { MessagePack::Packer.new.public_send(method, array).to_s } }
+  printf("%-6s each %7.1fus  pack %7.1fus  %s %7.1fus\n",
+         name, each / ITERATIONS * 1e6, bulk / ITERATIONS * 1e6, method, typed / ITERATIONS * 1e6)
+end
@@ -0,0 +1,25 @@
+# % bundle install
+# % bundle exec ruby bench/packed_size.rb
+#
+# Compares MessagePack.pack with and without the exact_size option, and
+# measures MessagePack.packed_size alone.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = 100
+
+documents = {
+  'blobs' => Array.new(100) { |i| { 'id' => i, 'blob' => ('x' * 100_000).b } },
+  'floats' => Array.new(200_000) { rand },
+  'records' => Array.new(20_000) { |i| { 'id' => i, 'name' => "item-#{i}", 'price' => i * 1.5 } },
+}
+
+documents.each do |name, document|
+  pack = Benchmark.realtime { ITERATIONS.times { MessagePack.pack(document) } }
+  exact = Benchmark.realtime { ITERATIONS.times { MessagePack.pack(document, exact_size: true) } }
+  size = Benchmark.realtime { ITERATIONS.times { MessagePack.packed_size(document) } }
+  printf("%-8s pack %7.3fms  exact_size %7.3fms  packed_size %7.3fms\n",
+         name, pack / ITERATIONS * 1e3, exact / ITERATIONS * 1e3, size / ITERATIONS * 1e3)
+end
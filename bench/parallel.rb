@@ -0,0 +1,44 @@
+# % bundle install
+# % bundle exec ruby bench/parallel.rb
+#
+# Measures Factory#unpack_all_parallel with 1 to 16 workers on the
+# object_structured payload of bench/bench.rb repeated COUNT times.
+
+require 'msgpack'
+
+require 'benchmark'
+
+Warning[:experimental] = false
+
+COUNT = Integer(ENV.fetch('COUNT', 1_000_000))
+WORKERS = ENV.fetch('WORKERS', '1,2,4,8,16').split(',').map { |n| Integer(n) }
+
+object_structured = {
+  'remote_host' => '127.0.0.1',
+  'remote_user' => '-',
+  'date' => '10/Oct/2000:13:55:36 -0700',
+  'request' => 'GET /apache_pb.gif HTTP/1.0',
+  'method' => 'GET',
+  'path' => '/apache_pb.gif',
+  'protocol' => 'HTTP/1.0',
+  'status' => 200,
+  'bytes' => 2326,
+  'referer' => 'http://www.example.com/start.html',
+  'agent' => 'Mozilla/4.08 [en] (Win98; I ;Nav)',
+}
+
+factory = Ractor.make_shareable(MessagePack::Factory.new.freeze)
+data = (factory.dump(object_structured) * COUNT).freeze
+
+baseline = Benchmark.realtime do
+  objects = []
+  unpacker = factory.unpacker
+  unpacker.feed_reference(data)
+  unpacker.each { |object| objects << object }
+end
+printf("%-10s %7.3fs\n", "Unpacker#each", baseline)
+
+WORKERS.each do |workers|
+  elapsed = Benchmark.realtime { factory.unpack_all_parallel(data, workers: workers) }
+  printf("%2d workers %7.3fs (x%.2f)\n", workers, elapsed, baseline / elapsed)
+end
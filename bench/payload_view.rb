@@ -0,0 +1,58 @@
+# % bundle install
+# % bundle exec ruby bench/payload_view.rb
+#
+# Unpacks an Array of UUID-like, money and timestamp-like extension types
+# with unpacker procs receiving a String or a MessagePack::PayloadView.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = Integer(ENV.fetch('ITERATIONS', 1_000))
+
+Uuid = Struct.new(:high, :low)
+Money = Struct.new(:cents, :currency)
+Stamp = Struct.new(:seconds, :nanoseconds)
+
+unpackers = {
+  string: {
+    Uuid => ->(s) { Uuid.new(*s.unpack('Q>Q>')) },
+    Money => ->(s) { Money.new(s.unpack1('q>'), s.unpack1('N', offset: 8)) },
+    Stamp => ->(s) { Stamp.new(*s.unpack('q>N')) },
+  },
+  view: {
+    Uuid => ->(v) { Uuid.new(v.u64be(0), v.u64be(8)) },
+    Money => ->(v) { Money.new(v.i64be(0), v.u32be(8)) },
+    Stamp => ->(v) { Stamp.new(v.i64be(0), v.u32be(8)) },
+  },
+}
+
+packers = {
+  Uuid => ->(u) { [u.high, u.low].pack('Q>Q>') },
+  Money => ->(m) { [m.cents, m.currency].pack('q>N') },
+  Stamp => ->(t) { [t.seconds, t.nanoseconds].pack('q>N') },
+}
+
+objects = Array.new(1_000) do |i|
+  case i % 3
+  when 0 then Uuid.new(i, i * 7)
+  when 1 then Money.new(i * 100, 840)
+  else Stamp.new(1_700_000_000 + i, i)
+  end
+end
+
+unpackers.each do |payload, procs|
+  factory = MessagePack::Factory.new
+  procs.each_with_index do |(klass, unpacker), type|
+    factory.register_type(type, klass, packer: packers[klass], unpacker: unpacker, payload: payload)
+  end
+  data = factory.dump(objects)
+  raise "mismatch" unless factory.load(data) == objects
+
+  allocated = GC.stat(:total_allocated_objects)
+  elapsed = Benchmark.realtime do
+    ITERATIONS.times { factory.load(data) }
+  end
+  allocated = GC.stat(:total_allocated_objects) - allocated
+  printf("payload: %-7s %8.1fus/load  %6d objects/load\n", payload.inspect, elapsed / ITERATIONS * 1e6, allocated / ITERATIONS)
+end
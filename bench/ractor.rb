@@ -0,0 +1,47 @@
+# % bundle install
+# % bundle exec ruby bench/ractor.rb
+#
+# Measures the decode throughput of a shareable Factory used by 1 to N
+# Ractors at once (N defaults to the number of processors).
+
+require 'msgpack'
+
+require 'benchmark'
+require 'etc'
+
+Warning[:experimental] = false
+
+ITERATIONS = 2_000
+MAX_RACTORS = Integer(ENV.fetch('RACTORS', Etc.nprocessors))
+
+factory = MessagePack::Factory.new
+factory.register_type(0x00, Symbol)
+Ractor.make_shareable(factory)
+
+document = {
+  "id" => 42,
+  "items" => Array.new(100) { |i| { "sku" => "item-#{i}", "qty" => i, "tags" => [:a, :b] } },
+}
+payload = Ractor.make_shareable(factory.dump(document))
+
+def decode(factory, payload, iterations)
+  iterations.times { factory.load(payload) }
+end
+
+decode(factory, payload, ITERATIONS) # warm up
+baseline = nil
+
+counts = [1, 2, 4, 8, 16].select { |n| n <= MAX_RACTORS }
+counts << MAX_RACTORS unless counts.include?(MAX_RACTORS)
+counts.each do |count|
+  elapsed = Benchmark.realtime do
+    count.times.map do
+      Ractor.new(factory, payload, ITERATIONS) do |factory, payload, iterations|
+        decode(factory, payload, iterations)
+      end
+    end.each(&:take)
+  end
+  throughput = count * ITERATIONS * payload.bytesize / elapsed / 1e6
+  baseline ||= throughput
+  printf("%2d Ractors: %7.1f MB/s (x%.2f)\n", count, throughput, throughput / baseline)
+end
@@ -0,0 +1,39 @@
+# % bundle install
+# % bundle exec ruby bench/read_raw.rb
+#
+# Forwards the body of envelopes untouched, decoding it and packing it again
+# or reading it raw with the raw_keys: option.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = Integer(ENV.fetch('ITERATIONS', 1_000))
+
+body = {
+  'items' => Array.new(50) { |i| { 'id' => i, 'name' => "item #{i}", 'price' => i * 1.5, 'tags' => %w(a b c) } },
+  'note' => 'x' * 1_000,
+}
+envelopes = Array.new(100) { |i| { 'id' => i, 'route' => 'orders', 'body' => body } }
+data = envelopes.map { |envelope| MessagePack.pack(envelope) }.join
+
+forwarders = {
+  'decode and repack' => [{}, ->(envelope) { MessagePack.pack(envelope['body']) }],
+  'raw_keys' => [{ raw_keys: ['body'] }, ->(envelope) { envelope['body'] }],
+}
+
+expected = nil
+forwarders.each do |name, (options, forward)|
+  unpacker = MessagePack::Unpacker.new(options)
+  forwarded = []
+  elapsed = Benchmark.realtime do
+    ITERATIONS.times do
+      forwarded.clear
+      unpacker.feed_reference(data)
+      unpacker.each { |envelope| forwarded << forward.call(envelope) }
+    end
+  end
+  expected ||= forwarded.dup
+  raise "mismatch" unless forwarded == expected
+  printf("%-18s %8.1fus/batch\n", name, elapsed / ITERATIONS * 1e6)
+end
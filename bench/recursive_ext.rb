@@ -0,0 +1,46 @@
+# % bundle install
+# % bundle exec ruby bench/recursive_ext.rb
+#
+# Packs documents made of recursive extension types: a wide Array of small
+# ones, a deeply nested tree, and a few large ones.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = Integer(ENV.fetch('ITERATIONS', 200))
+
+Point = Struct.new(:x, :y, :z)
+Node = Struct.new(:name, :children)
+
+factory = MessagePack::Factory.new
+factory.register_type(0x01, Point,
+  packer: ->(point, packer) { packer.write_array_header(3).write(point.x).write(point.y).write(point.z) },
+  unpacker: ->(unpacker) { Point.new(*unpacker.read) },
+  recursive: true)
+factory.register_type(0x02, Node,
+  packer: ->(node, packer) { packer.write_array_header(2).write(node.name).write(node.children) },
+  unpacker: ->(unpacker) { Node.new(*unpacker.read) },
+  recursive: true)
+
+def tree(depth)
+  return Node.new("leaf", [Point.new(1, 2, 3)]) if depth == 0
+  Node.new("node#{depth}", Array.new(3) { tree(depth - 1) })
+end
+
+documents = {
+  "wide" => Array.new(10_000) { |i| Point.new(i, i * 2, i * 3) },
+  "tree" => tree(7),
+  "large" => Array.new(10) { |i| Node.new("n" * 100_000, [Point.new(i, 0, 0)]) },
+}
+
+documents.each do |name, document|
+  packer = factory.packer
+  elapsed = Benchmark.realtime do
+    ITERATIONS.times do
+      packer.write(document)
+      packer.reset
+    end
+  end
+  printf("%-6s %8.3f ms/pack %8d bytes\n", name, elapsed * 1000 / ITERATIONS, factory.dump(document).bytesize)
+end
@@ -0,0 +1,35 @@
+# % bundle install
+# % bundle exec ruby bench/referenced_strings.rb
+#
+# Packs COUNT strings longer than write_reference_threshold, so that each of
+# them is referred to from its own buffer chunk, and packs recursive
+# extension types around them.
+
+require 'msgpack'
+
+require 'benchmark'
+
+COUNT = Integer(ENV.fetch('COUNT', 10_000))
+
+string = ('x' * 1024).b.freeze
+strings = Array.new(COUNT, string)
+
+elapsed = Benchmark.realtime do
+  packer = MessagePack::Packer.new(write_reference_threshold: 256)
+  strings.each { |s| packer.write(s) }
+  packer.size
+  packer.to_s
+end
+printf("%d referenced strings: %8.2fms\n", COUNT, elapsed * 1e3)
+
+Wrapper = Struct.new(:value)
+factory = MessagePack::Factory.new
+factory.register_type(0x01, Wrapper, packer: ->(w, packer) { packer.write(w.value) }, unpacker: ->(u) { Wrapper.new(u.read) }, recursive: true)
+wrappers = strings.map { |s| Wrapper.new(s) }
+
+elapsed = Benchmark.realtime do
+  packer = factory.packer(write_reference_threshold: 256)
+  strings.zip(wrappers).each { |s, w| packer.write(s).write(w) }
+  packer.to_s
+end
+printf("%d strings and recursive extensions: %8.2fms\n", COUNT, elapsed * 1e3)
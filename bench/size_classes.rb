@@ -0,0 +1,35 @@
+# % bundle install
+# % bundle exec ruby bench/size_classes.rb
+#
+# Packs documents of 8KB to 256KB holding a binary of most of that size,
+# which is larger than the 4KB pages of the memory pool but still copied
+# into the buffer.
+
+require 'msgpack'
+
+require 'benchmark'
+
+COUNT = Integer(ENV.fetch('COUNT', 2_000))
+
+[8, 16, 64, 256].each do |kilobytes|
+  document = {
+    "id" => kilobytes,
+    "items" => Array.new(50) { |i| { "sku" => "item-#{i}", "qty" => i } },
+    "blob" => ("x" * (kilobytes * 768)).b,
+  }
+
+  packer = MessagePack::Packer.new
+  elapsed = Benchmark.realtime do
+    COUNT.times do
+      packer.write(document)
+      packer.to_s
+      packer.reset
+    end
+  end
+  printf("%3dKB Packer#write: %8.2fus", kilobytes, elapsed / COUNT * 1e6)
+
+  elapsed = Benchmark.realtime do
+    COUNT.times { MessagePack.pack(document) }
+  end
+  printf("  MessagePack.pack: %8.2fus\n", elapsed / COUNT * 1e6)
+end
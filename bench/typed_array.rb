@@ -0,0 +1,30 @@
+# % bundle install
+# % bundle exec ruby bench/typed_array.rb
+#
+# Compares Unpacker#read_typed_array with unpacking an Array of numbers
+# and packing it into a binary String.
+
+require 'msgpack'
+
+require 'benchmark'
+
+ITERATIONS = 1_000
+
+floats = Array.new(10_000) { rand }
+ints = Array.new(10_000) { rand(-2**40..2**40) }
+
+[[floats, :float64, 'd*'], [ints, :int64, 'q*']].each do |array, type, format|
+  data = MessagePack.pack(array)
+  unpack = Benchmark.realtime do
+    ITERATIONS.times { MessagePack.unpack(data).pack(format) }
+  end
+  typed = Benchmark.realtime do
+    ITERATIONS.times do
+      unpacker = MessagePack::Unpacker.new
+      unpacker.feed_reference(data)
+      unpacker.read_typed_array(type)
+    end
+  end
+  printf("%-8s unpack+pack %7.1fus  read_typed_array %7.1fus (x%.1f)\n",
+         type, unpack / ITERATIONS * 1e6, typed / ITERATIONS * 1e6, unpack / typed)
+end
@@ -38,6 +38,17 @@ module MessagePack
   def self.pack(obj)
   end
 
+  #
+  # Returns the number of bytes an object takes when serialized, without serializing core types.
+  # Useful for Content-Length headers or to reject objects that are too large.
+  #
+  # @param obj [Object] object to measure
+  # @param options [Hash] see Packer#initialize
+  # @return [Integer] size in bytes
+  #
+  def self.packed_size(obj, options=nil)
+  end
+
   #
   # Deserializes an object from an IO or String.
   #
@@ -74,6 +85,70 @@ module MessagePack
   def self.unpack(src, options={})
   end
 
+  #
+  # Reads the value at the given path of keys and array indexes from an IO or String
+  # without decoding the rest of the object. Returns nil if the path doesn't exist.
+  #
+  # @overload dig(string, *path)
+  #   @param string [String] data to read
+  #   @param path [Array<Object>] map keys and array indexes
+  #
+  # @overload dig(io, *path)
+  #   @param io [IO]
+  #   @param path [Array<Object>] map keys and array indexes
+  #
+  # @return [Object] deserialized value at the path
+  #
+  # See Unpacker#dig.
+  #
+  def self.dig(src, *path)
+  end
+
+  #
+  # Splits a String of concatenated objects into the offset and length of each top-level object,
+  # without decoding them. Objects are delimited by a walk over the format bytes that allocates
+  # no Ruby object and releases the GVL for large strings.
+  #
+  # The bytes after the last returned range, if any, are an incomplete object.
+  # If data format is invalid, this method raises MessagePack::MalformedFormatError.
+  #
+  # @param string [String] concatenated objects
+  # @return [Array<Array(Integer, Integer)>] offset and length pairs
+  #
+  #   MessagePack.scan_boundaries(data).each do |offset, length|
+  #     queue << data.byteslice(offset, length)
+  #   end
+  #
+  def self.scan_boundaries(string)
+  end
+
+  #
+  # Reports the memory pools which the buffers and the unpacker stacks of the main Ractor
+  # allocate from. Buffers use a pool for each page size (4KB, 16KB, 64KB and 256KB), and
+  # the pools allocate pages by chunks of several pages.
+  #
+  # Other Ractors don't use pools, and get empty arrays.
+  #
+  # @return [Hash] +:buffer+ and +:unpacker_stack+ Arrays of Hashes with the +:page_size+,
+  #   the number of +:chunks+, +:pages+ and +:pages_in_use+, and the +:bytes+ allocated by each pool
+  #
+  #   MessagePack.memory_stats[:buffer].sum { |pool| pool[:bytes] }
+  #
+  def self.memory_stats
+  end
+
+  #
+  # Frees the chunks of the memory pools none of whose pages are in use, which the pools
+  # otherwise keep to serve later allocations, and asks the malloc implementation to return
+  # the freed memory to the OS if it supports it. Pools allocate again when needed.
+  #
+  # Does nothing outside the main Ractor.
+  #
+  # @return [Integer] number of bytes freed
+  #
+  def self.trim_memory
+  end
+
   #
   # An instance of Factory class. DefaultFactory is also used
   # by global pack/unpack methods such as MessagePack.dump/load,
@@ -21,6 +21,8 @@ module MessagePack
     # * *:io_buffer_size* buffer size to read data from the internal IO. (default: 32768)
     # * *:read_reference_threshold* the threshold size to enable zero-copy deserialize optimization. Read strings longer than this threshold will refer the original string instead of copying it. (default: 256) (supported in MRI only)
     # * *:write_reference_threshold* the threshold size to enable zero-copy serialize optimization. The buffer refers written strings longer than this threshold instead of copying it. (default: 524288) (supported in MRI only)
+    # * *:io_zero_copy* read from the internal IO into a new String each time and refer to it instead of copying it into the buffer, so that read strings longer than *:read_reference_threshold* share its memory. Reads shorter than *:read_reference_threshold* are still copied. _io_ must return a new String each time, which the buffer freezes. (default: false) (supported in MRI only)
+    # * *:nogvl_threshold* copy strings of this size or longer without holding the GVL, so that other threads can run meanwhile. Values below 65536 are raised to 65536. Other threads writing to or resetting the buffer meanwhile get a ThreadError. (default: nil, always hold the GVL) (supported in MRI only)
     #
     def initialize(*args)
     end
@@ -153,6 +155,16 @@ module MessagePack
     def to_a
     end
 
+    #
+    # Returns the offset and length of each complete top-level object in the readable data,
+    # without consuming nor decoding them. See MessagePack.scan_boundaries.
+    # Unlike MessagePack.scan_boundaries, the GVL is held while scanning.
+    #
+    # @return [Array<Array(Integer, Integer)>] offset and length pairs
+    #
+    def scan_boundaries
+    end
+
     #
     # Internal io
     #
@@ -183,6 +195,10 @@ module MessagePack
     # This method consumes and removes data from the internal buffer.
     # _io_ must respond to write(data) method.
     #
+    # When the buffer holds several chunks, a binmode File or socket receives them
+    # with a single writev(2) call, and an IO whose write accepts multiple arguments
+    # receives them with a single write(*chunks) call.
+    #
     # @param io [IO]
     # @return [Integer] byte size of written data
     #
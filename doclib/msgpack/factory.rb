@@ -35,6 +35,14 @@ module MessagePack
     end
     alias pack dump
 
+    #
+    # Returns the number of bytes an object takes when serialized with this factory.
+    #
+    # See Packer#packed_size and Packer#initialize for supported options.
+    #
+    def packed_size(obj, options=nil)
+    end
+
     #
     # Creates a MessagePack::Unpacker instance, which has ext types already registered.
     # Options are passed to MessagePack::Unpacker#initialized.
@@ -73,10 +81,12 @@ module MessagePack
     #
     # Supported options:
     #
-    # * *:packer* specify symbol or proc object for packer
-    # * *:unpacker* specify symbol or proc object for unpacker
+    # * *:packer* specify symbol or proc object for packer, or a MessagePack::NativeExt with a pack function
+    # * *:unpacker* specify symbol or proc object for unpacker, or a MessagePack::NativeExt with an unpack function
     # * *:optimized_symbols_parsing* specify true to use the optimized symbols parsing (not supported on JRuby now)
-    # * *recursive* specify true to receive the packer or unpacker as argument to generate the extension body manually.
+    # * *recursive* specify true to receive the packer or unpacker as argument to generate the extension body manually. The packer writes the body in place, so the packer proc must not read the packer buffer.
+    # * *:payload* specify :view to pass a reusable MessagePack::PayloadView to the unpacker instead of a new String, saving the String for payloads of up to 64 bytes (not supported on JRuby now)
+    # * *:native* specify true with the Time class to pack and unpack timestamps natively, or with the Integer class to pack and unpack oversized integers natively in the MessagePack::Bigint format (implies *:oversized_integer_extension*), without calling any proc (not supported on JRuby now). The MessagePack::Bigint methods registered as *:packer* or *:unpacker* for Integer use the native implementation automatically
     #
     def register_type(type, klass, options={})
     end
@@ -100,6 +110,84 @@ module MessagePack
     def type_registered?(klass_or_type, selector=:both)
     end
 
+    #
+    # Returns the KeyDictionary shared by the unpackers of this factory, or nil.
+    #
+    # @return [MessagePack::KeyDictionary]
+    #
+    def key_dictionary
+    end
+
+    #
+    # Sets a KeyDictionary which is shared read-only by every unpacker created afterwards by this factory,
+    # including pools and MessagePack.unpack for the DefaultFactory.
+    # Map keys found in the dictionary are returned without being interned again, other keys go through
+    # the *:key_cache* of the unpacker if enabled.
+    #
+    # @param dictionary [MessagePack::KeyDictionary, Array, nil] a dictionary, a list of keys to build one from, or nil to remove it
+    # @return [MessagePack::KeyDictionary]
+    #
+    # Not supported on JRuby now.
+    #
+    def key_dictionary=(dictionary)
+    end
+
+    #
+    # Builds a new KeyDictionary from the String map keys found in the sample payloads, in addition to the
+    # keys of the current dictionary, and sets it as the key_dictionary of this factory.
+    #
+    # @param payloads [Array<String>] serialized samples, each can contain several objects
+    # @return [MessagePack::KeyDictionary]
+    #
+    def learn_key_dictionary(payloads)
+    end
+
+    #
+    # Compiles a schema for records which always have the same keys, to be used with Packer#write_with_schema.
+    # The map header and every key are encoded once, using the types registered to this factory.
+    #
+    # @param keys_or_class [Array, Class] list of keys of Hash records, or a Struct or Data class
+    # @return [MessagePack::Schema]
+    #
+    # Not supported on JRuby now.
+    #
+    def compile_schema(keys_or_class)
+    end
+
+    #
+    # Freezes the factory, after which no type can be registered.
+    #
+    # A frozen factory can be passed to Ractor.make_shareable, if its packer and unpacker procs
+    # are shareable too, and then be used by several Ractors at once.
+    #
+    # @return [MessagePack::Factory] self
+    #
+    def freeze
+    end
+
+    #
+    # Deserializes all the concatenated objects of data, splitting it at object boundaries
+    # (see MessagePack.scan_boundaries) and decoding the slices in several Ractors at once.
+    # Returns the objects in order.
+    #
+    # The Ractors use a shareable frozen copy of the factory, kept until types are registered
+    # or the key dictionary changes (or the factory itself if it is already shareable).
+    # A frozen data String is shared, other Strings are copied.
+    #
+    # With workers: 1, if Ractors aren't available, or if registered procs can't be made
+    # shareable, objects are decoded in the calling thread.
+    #
+    # If the last object is incomplete, this method raises EOFError.
+    # If data format is invalid, this method raises MessagePack::MalformedFormatError.
+    #
+    # @param data [String] concatenated objects
+    # @param workers [Integer] number of Ractors (default: the number of processors)
+    # @param options [Hash] options passed to the unpackers. See Unpacker#initialize.
+    # @return [Array] deserialized objects
+    #
+    def unpack_all_parallel(data, workers: nil, **options)
+    end
+
     #
     # Creates a MessagePack::PooledFactory instance of the given size.
     #
@@ -139,6 +227,15 @@ module MessagePack
       def dump(object)
       end
 
+      #
+      # Returns the number of bytes an object takes when serialized, see Packer#packed_size.
+      #
+      # @param obj [Object] object to measure
+      # @return [Integer] size in bytes
+      #
+      def packed_size(object)
+      end
+
       #
       # Yields an Unpacker from the pool, and check it back in.
       #
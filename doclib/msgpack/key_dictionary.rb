@@ -0,0 +1,42 @@
+module MessagePack
+
+  #
+  # KeyDictionary is an immutable set of map keys, attached to a Factory with Factory#key_dictionary=
+  # and shared by all its unpackers. It is frozen upon creation and can be shared between Ractors.
+  #
+  class KeyDictionary
+    #
+    # Creates a dictionary of the given keys. Symbols are stored as their name.
+    #
+    # @param keys [Array<String, Symbol>]
+    #
+    def initialize(keys)
+    end
+
+    #
+    # Returns the number of keys.
+    #
+    # @return [Integer]
+    #
+    def size
+    end
+
+    #
+    # Returns the interned keys, in no particular order.
+    #
+    # @return [Array<String>]
+    #
+    def keys
+    end
+
+    #
+    # Returns true if the dictionary contains the key.
+    #
+    # @param key [String, Symbol]
+    # @return [Boolean]
+    #
+    def include?(key)
+    end
+  end
+
+end
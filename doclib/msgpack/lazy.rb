@@ -0,0 +1,110 @@
+module MessagePack
+
+  #
+  # LazyArray is an Array returned by Unpacker#read_lazy, which decodes each element on first
+  # access. Nested Arrays and Maps are lazy too. It includes Enumerable.
+  #
+  class LazyArray
+    #
+    # Returns the number of elements.
+    #
+    # @return [Integer]
+    #
+    def size
+    end
+
+    #
+    # Returns the element at the index, decoding it on first access.
+    #
+    # @param index [Integer] negative indexes count from the end
+    # @return [Object] nil if the index is out of range
+    #
+    def [](index)
+    end
+
+    #
+    # Yields each element.
+    #
+    def each
+    end
+
+    #
+    # Decodes all the elements into an Array, as Unpacker#read would.
+    #
+    # @return [Array]
+    #
+    def to_a
+    end
+
+    #
+    # Same as Array#dig.
+    #
+    def dig(index, *rest)
+    end
+  end
+
+  #
+  # LazyMap is a Hash returned by Unpacker#read_lazy, which decodes each value on first
+  # access. All the keys are decoded on the first lookup. Nested Arrays and Maps are lazy
+  # too. It includes Enumerable.
+  #
+  class LazyMap
+    #
+    # Returns the number of pairs.
+    #
+    # @return [Integer]
+    #
+    def size
+    end
+
+    #
+    # Returns the value of the key, decoding it on first access.
+    #
+    # @return [Object] nil if the key is missing
+    #
+    def [](key)
+    end
+
+    #
+    # Same as Hash#fetch.
+    #
+    def fetch(key, *default)
+    end
+
+    #
+    # Returns true if the key is present.
+    #
+    # @return [Boolean]
+    #
+    def key?(key)
+    end
+
+    #
+    # Returns the decoded keys.
+    #
+    # @return [Array]
+    #
+    def keys
+    end
+
+    #
+    # Yields each key and value.
+    #
+    def each
+    end
+
+    #
+    # Decodes all the pairs into a Hash, as Unpacker#read would.
+    #
+    # @return [Hash]
+    #
+    def to_h
+    end
+
+    #
+    # Same as Hash#dig.
+    #
+    def dig(key, *rest)
+    end
+  end
+end
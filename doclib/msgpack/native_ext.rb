@@ -0,0 +1,38 @@
+module MessagePack
+
+  #
+  # NativeExt wraps the C functions a native extension registers through the C API of
+  # <tt>ext/msgpack/native_ext.h</tt> to pack and unpack an extension type. Packers and
+  # unpackers call them directly, without a Ruby frame, and the unpack function reads the
+  # payload straight from the unpacker buffer. Pass it as the packer or unpacker of
+  # Factory#register_type. It can't be combined with the *recursive* or *:payload* options.
+  #
+  # NativeExts are frozen and can be shared between Ractors. They can only be created from
+  # C, with msgpack_native_ext_new (not supported on JRuby).
+  #
+  class NativeExt
+    #
+    # Returns the name of the msgpack_native_ext_t.
+    #
+    # @return [String, nil]
+    #
+    def name
+    end
+
+    #
+    # Returns true if it has a pack function.
+    #
+    # @return [Boolean]
+    #
+    def packer?
+    end
+
+    #
+    # Returns true if it has an unpack function.
+    #
+    # @return [Boolean]
+    #
+    def unpacker?
+    end
+  end
+end
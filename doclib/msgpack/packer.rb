@@ -20,6 +20,11 @@ module MessagePack
     # Supported options:
     #
     # * *:compatibility_mode* serialize in older versions way, without str8 and bin types
+    # * *:exact_size* when an object is written to an empty packer without IO, compute its packed size
+    #   first (see #packed_size) and pack it straight into a single String of that size. This saves
+    #   the copy of the buffer chunks into the result for documents holding long strings, at the
+    #   cost of a pass over the object. Objects packed by extension types or to_msgpack are packed
+    #   once, during that pass, and their bytes are copied into the result
     #
     # See also Buffer#initialize for other options.
     #
@@ -85,6 +90,17 @@ module MessagePack
 
     alias pack write
 
+    #
+    # Returns the number of bytes _obj_ takes when serialized by this packer, without writing
+    # it. Core types are measured without allocating. Objects serialized by extension types or
+    # to_msgpack are packed into a temporary buffer to be measured.
+    #
+    # @param obj [Object] object to measure
+    # @return [Integer] size in bytes
+    #
+    def packed_size(obj)
+    end
+
     #
     # Serializes a nil object. Same as write(nil).
     #
@@ -115,6 +131,20 @@ module MessagePack
     def write_map_header(n)
     end
 
+    #
+    # Write a Hash, Struct or Data instance using a schema compiled by Factory#compile_schema.
+    # The map header and keys are copied from the schema, only the values are serialized.
+    # For example, write_with_schema(factory.compile_schema([:a, :b]), {a: 1, b: 2}) is same as write(a: 1, b: 2).
+    #
+    # Keys missing from a Hash are written as nil, and keys which are not part of the schema are ignored.
+    #
+    # @param schema [MessagePack::Schema]
+    # @param obj [Hash, Struct, Data]
+    # @return [Packer] self
+    #
+    def write_with_schema(schema, obj)
+    end
+
     #
     # Write a header of a binary string whose size is _n_. Useful if you want to append large binary data without loading it into memory at once.
     # For example,
@@ -141,6 +171,27 @@ module MessagePack
     def write_float32(value)
     end
 
+    #
+    # Serializes an Array of numbers, every element as a 64-bit double precision float.
+    # Integers and other Numerics are converted with to_f. Floats and Integers that fit in a
+    # Fixnum are written in a single loop, without dispatching on the type of each element.
+    #
+    # @param array [Array<Numeric>]
+    # @return [Packer] self
+    #
+    def write_float_array(array)
+    end
+
+    #
+    # Serializes an Array of Integers, each in its smallest format, as #write does.
+    # Raises TypeError if an element isn't an Integer.
+    #
+    # @param array [Array<Integer>]
+    # @return [Packer] self
+    #
+    def write_int_array(array)
+    end
+
     #
     # Flushes data in the internal buffer to the internal IO. Same as _buffer.flush.
     # If internal IO is not set, it does nothing.
@@ -210,6 +261,10 @@ module MessagePack
     # This method consumes and removes data from the internal buffer.
     # _io_ must respond to write(data) method.
     #
+    # When the buffer holds several chunks, a binmode File or socket receives them
+    # with a single writev(2) call, and an IO whose write accepts multiple arguments
+    # receives them with a single write(*chunks) call.
+    #
     # @param io [IO]
     # @return [Integer] byte size of written data
     #
@@ -0,0 +1,83 @@
+module MessagePack
+
+  #
+  # PayloadView is passed instead of a String to the unpacker procs of the extension types
+  # registered with <tt>payload: :view</tt>. An Unpacker reuses the same view for all the
+  # payloads, so it's only readable while the proc runs; its methods raise RuntimeError
+  # afterwards.
+  #
+  # Readers raise IndexError if the bytes at offset are out of the payload.
+  #
+  class PayloadView
+    #
+    # Returns the size of the payload in bytes.
+    #
+    # @return [Integer]
+    #
+    def bytesize
+    end
+
+    alias size bytesize
+
+    #
+    # Returns a copy of the payload.
+    #
+    # @return [String] a binary String
+    #
+    def to_s
+    end
+
+    #
+    # Returns a copy of length bytes of the payload at offset.
+    #
+    # @return [String] a binary String
+    #
+    def byteslice(offset, length)
+    end
+
+    #
+    # Reads an unsigned or signed 8-bit integer at offset.
+    #
+    # @return [Integer]
+    #
+    def u8(offset)
+    end
+
+    def i8(offset)
+    end
+
+    #
+    # Reads a big-endian unsigned or signed 16, 32 or 64-bit integer at offset.
+    #
+    # @return [Integer]
+    #
+    def u16be(offset)
+    end
+
+    def i16be(offset)
+    end
+
+    def u32be(offset)
+    end
+
+    def i32be(offset)
+    end
+
+    def u64be(offset)
+    end
+
+    def i64be(offset)
+    end
+
+    #
+    # Reads a big-endian single or double precision float at offset.
+    #
+    # @return [Float]
+    #
+    def f32be(offset)
+    end
+
+    def f64be(offset)
+    end
+  end
+end
@@ -0,0 +1,35 @@
+module MessagePack
+
+  #
+  # Schema is created by Factory#compile_schema and holds the pre-encoded
+  # map header and keys of fixed-shape records.
+  # It is frozen and can't be instantiated directly.
+  #
+  class Schema
+    #
+    # Returns the keys of the schema, in the order they are written.
+    # For Struct and Data classes, these are the member names.
+    #
+    # @return [Array]
+    #
+    def keys
+    end
+
+    #
+    # Returns the number of keys of the schema.
+    #
+    # @return [Integer]
+    #
+    def size
+    end
+
+    #
+    # Returns the Struct or Data class of the schema, or Hash.
+    #
+    # @return [Class]
+    #
+    def target
+    end
+  end
+
+end
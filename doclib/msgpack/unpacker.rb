@@ -20,8 +20,9 @@ module MessagePack
     #
     # * *:symbolize_keys* deserialize keys of Hash objects as Symbol instead of String
     # * *:freeze* freeze the deserialized objects. Can allow string deduplication and some allocation elision.
-    # * *:key_cache* Enable caching of map keys, this can improve performance significantly if the same map keys are frequently encountered, but also degrade performance if that's not the case.
+    # * *:key_cache* Enable caching of map keys, this can improve performance significantly if the same map keys are frequently encountered, but also degrade performance if that's not the case. Pass an Integer to set the number of cached keys (256 by default, rounded up to a power of two), see also #key_cache_stats.
     # * *:allow_unknown_ext* allow to deserialize ext type object with unknown type id as ExtensionValue instance. Otherwise (by default), unpacker throws UnknownExtTypeError.
+    # * *:raw_keys* an Array of map keys whose values are read like #read_raw, as the String of their encoded bytes, in maps at any depth. Symbols match the String keys too. Not supported on JRuby now.
     #
     # See also Buffer#initialize for other options.
     #
@@ -88,6 +89,63 @@ module MessagePack
     def read
     end
 
+    #
+    # Reads the next object like #read, except that an Array or a Map is returned as a
+    # MessagePack::LazyArray or MessagePack::LazyMap. Their elements are decoded on first
+    # access, so that reading a few fields of a large document doesn't decode the rest of it.
+    #
+    # The encoded container is kept in a String. Other objects are returned as #read does.
+    #
+    # @return [MessagePack::LazyArray, MessagePack::LazyMap, Object]
+    #
+    def read_lazy
+    end
+
+    #
+    # Reads the next object without decoding it and returns the String of its encoded bytes,
+    # to be forwarded or unpacked later. When the object lies in a String fed with
+    # #feed_reference, the result refers to it rather than copying it.
+    #
+    # Not supported on JRuby now.
+    #
+    # @return [String] binary String of the encoded object
+    #
+    def read_raw
+    end
+
+    #
+    # Reads the next object, an Array of numbers, into a binary String of native-endian
+    # values of the given type without creating a Ruby object per element. The result can be
+    # unpacked with String#unpack or handed to a numeric library as is.
+    #
+    # Integers are range checked, and Floats are only accepted by :float32 and :float64.
+    # If an element doesn't fit the type, the whole Array is skipped before the error is
+    # raised. If the next object isn't an Array, it is left to be read.
+    #
+    # @param type [Symbol] :int8, :int16, :int32, :int64, :uint8, :uint16, :uint32, :uint64, :float32 or :float64
+    # @return [String] binary String of the elements
+    # @raise [MessagePack::UnexpectedTypeError] if the next object isn't an Array of numbers of the type
+    # @raise [RangeError] if an integer doesn't fit the type
+    #
+    def read_typed_array(type)
+    end
+
+    #
+    # Reads the next object and returns the value found by following path, a list of
+    # map keys and array indexes (negative indexes count from the end), or nil if the path
+    # doesn't exist. Only the returned value is deserialized: other keys are compared in the
+    # buffer and other values are skipped. Keys match as in the Hash #read would return: String
+    # keys match str and bin keys, or Symbol keys do with the symbolize_keys option, and the
+    # value of the last duplicate key is returned.
+    #
+    # The whole object is consumed, as #read does.
+    #
+    # @param path [Array<Object>] map keys and array indexes
+    # @return [Object] deserialized value at the path
+    #
+    def dig(*path)
+    end
+
     alias unpack read
 
     #
@@ -180,6 +238,17 @@ module MessagePack
     #
     def reset
     end
+
+    #
+    # Returns statistics of the key cache enabled by the *:key_cache* option, to help sizing it.
+    # The cache is kept across #reset, so the counters are cumulative.
+    #
+    # @return [Hash] with :capacity, :size (number of cached keys), :hits, :misses and :evictions
+    #
+    # Not supported on JRuby now.
+    #
+    def key_cache_stats
+    end
   end
 
 end
@@ -18,29 +18,50 @@
 
 #include "buffer.h"
 #include "rmem.h"
+#include "ruby/thread.h"
+
+#ifdef HAVE_WRITEV
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include "ruby/io.h"
+#endif
 
 int msgpack_rb_encindex_utf8;
 int msgpack_rb_encindex_usascii;
 int msgpack_rb_encindex_ascii8bit;
 
 ID s_uminus;
+static ID s_write;
 
-static msgpack_rmem_t s_rmem;
+static msgpack_rmem_t s_rmem[MSGPACK_RMEM_CLASSES];
 
 void msgpack_buffer_static_init(void)
 {
     s_uminus = rb_intern("-@");
+    s_write = rb_intern("write");
 
     msgpack_rb_encindex_utf8 = rb_utf8_encindex();
     msgpack_rb_encindex_usascii = rb_usascii_encindex();
     msgpack_rb_encindex_ascii8bit = rb_ascii8bit_encindex();
 
-    msgpack_rmem_init(&s_rmem);
+    msgpack_rmem_static_init();
+    msgpack_rmem_init(&s_rmem[0]);
+    for(int i = 1; i < MSGPACK_RMEM_CLASSES; i++) {
+        msgpack_rmem_init_lazy(&s_rmem[i], MSGPACK_RMEM_CLASS_PAGE_SIZE(i), MSGPACK_RMEM_CLASS_PAGES(i));
+    }
 }
 
 void msgpack_buffer_static_destroy(void)
 {
-    msgpack_rmem_destroy(&s_rmem);
+    for(int i = 0; i < MSGPACK_RMEM_CLASSES; i++) {
+        msgpack_rmem_destroy(&s_rmem[i]);
+    }
+}
+
+msgpack_rmem_t* msgpack_buffer_rmem_pools(void)
+{
+    return msgpack_rmem_for_current_ractor(s_rmem);
 }
 
 void msgpack_buffer_init(msgpack_buffer_t* b)
@@ -51,15 +72,28 @@ void msgpack_buffer_init(msgpack_buffer_t* b)
     b->write_reference_threshold = MSGPACK_BUFFER_STRING_WRITE_REFERENCE_DEFAULT;
     b->read_reference_threshold = MSGPACK_BUFFER_STRING_READ_REFERENCE_DEFAULT;
     b->io_buffer_size = MSGPACK_BUFFER_IO_BUFFER_SIZE_DEFAULT;
+    b->nogvl_threshold = SIZE_MAX;
     b->io = Qnil;
     b->io_buffer = Qnil;
+    b->rmem = msgpack_rmem_for_current_ractor(s_rmem);
+}
+
+/*
+ * Chunks can't be freed, moved nor resized while copies run without the GVL.
+ * Other threads using the same buffer meanwhile get an error instead.
+ */
+static inline void _msgpack_buffer_check_nogvl_readers(const msgpack_buffer_t* b)
+{
+    if(b->nogvl_readers > 0) {
+        rb_raise(rb_eThreadError, "msgpack buffer is being read by another thread");
+    }
 }
 
-static void _msgpack_buffer_chunk_destroy(msgpack_buffer_chunk_t* c)
+static void _msgpack_buffer_chunk_destroy(msgpack_buffer_chunk_t* c, bool rmem_deferred)
 {
     if(c->mem != NULL) {
         if(c->rmem) {
-            if(!msgpack_rmem_free(&s_rmem, c->mem)) {
+            if(!msgpack_rmem_free_or_defer(c->rmem, c->mem, rmem_deferred)) {
                 rb_bug("Failed to free an rmem pointer, memory leak?");
             }
         } else {
@@ -76,15 +110,18 @@ static void _msgpack_buffer_chunk_destroy(msgpack_buffer_chunk_t* c)
 
 void msgpack_buffer_destroy(msgpack_buffer_t* b)
 {
+    /* the GC may sweep the buffer from another Ractor's thread */
+    bool rmem_deferred = msgpack_rmem_free_deferred_p(b->rmem);
+
     /* head is always available */
     msgpack_buffer_chunk_t* c = b->head;
     while(c != &b->tail) {
         msgpack_buffer_chunk_t* n = c->next;
-        _msgpack_buffer_chunk_destroy(c);
+        _msgpack_buffer_chunk_destroy(c, rmem_deferred);
         xfree(c);
         c = n;
     }
-    _msgpack_buffer_chunk_destroy(c);
+    _msgpack_buffer_chunk_destroy(c, rmem_deferred);
 
     c = b->free_list;
     while(c != NULL) {
@@ -94,17 +131,32 @@ void msgpack_buffer_destroy(msgpack_buffer_t* b)
     }
 }
 
+static inline size_t _msgpack_buffer_chunk_memsize(const msgpack_buffer_chunk_t* c)
+{
+    if(c->mapped_string != NO_MAPPED_STRING) {
+        return c->last - c->first;
+    }
+    if(c->mem == NULL) {
+        /* empty, or part of a 4KB page owned by another chunk */
+        return 0;
+    }
+    return c->rmem ? c->rmem->page_size : c->mem_size;
+}
+
 size_t msgpack_buffer_memsize(const msgpack_buffer_t* b)
 {
     size_t memsize = 0;
     msgpack_buffer_chunk_t* c = b->head;
 
-    while(c) {
+    /* tail is a part of msgpack_buffer_t */
+    for(; c != &b->tail; c = c->next) {
+        memsize += sizeof(msgpack_buffer_chunk_t) + _msgpack_buffer_chunk_memsize(c);
+    }
+    memsize += _msgpack_buffer_chunk_memsize(c);
+
+    /* chunks kept for reuse */
+    for(c = b->free_list; c != NULL; c = c->next) {
         memsize += sizeof(msgpack_buffer_chunk_t);
-        if(c->mapped_string != NO_MAPPED_STRING) {
-            memsize += (c->last - c->first);
-        }
-        c = c->next;
     }
 
     return memsize;
@@ -127,7 +179,9 @@ void msgpack_buffer_mark(void *ptr)
 
 bool _msgpack_buffer_shift_chunk(msgpack_buffer_t* b)
 {
-    _msgpack_buffer_chunk_destroy(b->head);
+    _msgpack_buffer_check_nogvl_readers(b);
+    _msgpack_buffer_chunk_destroy(b->head, false);
+    b->shifted_chunks++;
 
     if(b->head == &b->tail) {
         /* list becomes empty. don't add head to free_list
@@ -148,6 +202,13 @@ bool _msgpack_buffer_shift_chunk(msgpack_buffer_t* b)
     b->head = next_head;
     b->read_buffer = next_head->first;
 
+    if(next_head == &b->tail) {
+        b->before_tail = NULL;
+        b->inner_size = 0;
+    } else {
+        b->inner_size -= next_head->last - next_head->first;
+    }
+
     return true;
 }
 
@@ -158,6 +219,90 @@ void msgpack_buffer_clear(msgpack_buffer_t* b)
     }
 }
 
+void msgpack_buffer_write_into_string(msgpack_buffer_t* b, VALUE string)
+{
+    msgpack_buffer_clear(b);
+
+    char* data = RSTRING_PTR(string);
+    b->tail.first = data;
+    b->tail.last = data;
+    b->tail.mem = NULL;
+    b->tail.mapped_string = string;
+    b->tail_buffer_end = data + RSTRING_LEN(string);
+    b->read_buffer = data;
+}
+
+struct msgpack_buffer_copy_args {
+    msgpack_buffer_t* b;
+    const msgpack_buffer_chunk_t* c;
+    const char* src;
+    size_t avail;
+    char* dest;
+    size_t length;
+};
+
+static void* _msgpack_buffer_copy_without_gvl_func(void* ptr)
+{
+    struct msgpack_buffer_copy_args* args = ptr;
+    const msgpack_buffer_chunk_t* c = args->c;
+    const char* src = args->src;
+    size_t avail = args->avail;
+    char* dest = args->dest;
+    size_t length = args->length;
+
+    while(length > avail) {
+        memcpy(dest, src, avail);
+        dest += avail;
+        length -= avail;
+        c = c->next;
+        src = c->first;
+        avail = c->last - c->first;
+    }
+    memcpy(dest, src, length);
+    return NULL;
+}
+
+static VALUE _msgpack_buffer_copy_without_gvl_body(VALUE ptr)
+{
+    rb_thread_call_without_gvl(_msgpack_buffer_copy_without_gvl_func, (void*)ptr, NULL, NULL);
+    return Qnil;
+}
+
+static VALUE _msgpack_buffer_copy_without_gvl_ensure(VALUE ptr)
+{
+    ((struct msgpack_buffer_copy_args*)ptr)->b->nogvl_readers--;
+    return Qnil;
+}
+
+/*
+ * Copies the first length readable bytes, which must be buffered already,
+ * without consuming them. Other threads run meanwhile: they may read the
+ * buffer, but get an error from anything freeing or moving its chunks.
+ */
+static void _msgpack_buffer_copy_without_gvl(msgpack_buffer_t* b, char* dest, size_t length)
+{
+    struct msgpack_buffer_copy_args args = {
+        b, b->head, b->read_buffer, msgpack_buffer_top_readable_size(b), dest, length
+    };
+    b->nogvl_readers++;
+    rb_ensure(_msgpack_buffer_copy_without_gvl_body, (VALUE)&args, _msgpack_buffer_copy_without_gvl_ensure, (VALUE)&args);
+}
+
+static VALUE _msgpack_buffer_copy_to_string_without_gvl(VALUE ptr)
+{
+    struct msgpack_buffer_copy_args* args = (struct msgpack_buffer_copy_args*)ptr;
+    _msgpack_buffer_copy_without_gvl(args->b, args->dest, args->length);
+    return Qnil;
+}
+
+VALUE _msgpack_buffer_read_as_string_without_gvl(msgpack_buffer_t* b, size_t length, bool utf8)
+{
+    VALUE string = utf8 ? rb_utf8_str_new(NULL, length) : rb_str_new(NULL, length);
+    _msgpack_buffer_copy_without_gvl(b, RSTRING_PTR(string), length);
+    msgpack_buffer_read_nonblock(b, NULL, length);
+    return string;
+}
+
 size_t msgpack_buffer_read_to_string_nonblock(msgpack_buffer_t* b, VALUE string, size_t length)
 {
     size_t avail = msgpack_buffer_top_readable_size(b);
@@ -174,6 +319,24 @@ size_t msgpack_buffer_read_to_string_nonblock(msgpack_buffer_t* b, VALUE string,
         return length;
     }
 
+    if(length >= b->nogvl_threshold) {
+        size_t n = msgpack_buffer_all_readable_size(b);
+        if(n > length) {
+            n = length;
+        }
+        if(n >= b->nogvl_threshold) {
+            long len = RSTRING_LEN(string);
+            rb_str_modify_expand(string, n);
+            struct msgpack_buffer_copy_args args = { b, NULL, NULL, 0, RSTRING_PTR(string) + len, n };
+            /* the caller's String must not be resized by other threads meanwhile */
+            rb_str_locktmp(string);
+            rb_ensure(_msgpack_buffer_copy_to_string_without_gvl, (VALUE)&args, rb_str_unlocktmp, string);
+            rb_str_set_len(string, len + n);
+            msgpack_buffer_read_nonblock(b, NULL, n);
+            return n;
+        }
+    }
+
     size_t const length_orig = length;
 
     while(true) {
@@ -230,15 +393,94 @@ size_t msgpack_buffer_all_readable_size(const msgpack_buffer_t* b)
         return sz;
     }
 
-    msgpack_buffer_chunk_t* c = b->head->next;
+    return sz + b->inner_size + (b->tail.last - b->tail.first);
+}
 
-    while(true) {
-        sz += c->last - c->first;
-        if(c == &b->tail) {
-            return sz;
+static msgpack_buffer_chunk_t* _msgpack_buffer_position_chunk(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos)
+{
+    if(b->shifted_chunks != pos->shifted_chunks || (size_t)(b->read_buffer - b->head->first) != pos->read_offset) {
+        return NULL;
+    }
+
+    /* chunks are only appended after pos unless it's truncated */
+    msgpack_buffer_chunk_t* before_tail = b->head == &b->tail ? NULL : b->before_tail;
+    if(before_tail == pos->before) {
+        return &b->tail;
+    }
+    return pos->before == NULL ? b->head : pos->before->next;
+}
+
+char* msgpack_buffer_position_pointer(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos)
+{
+    msgpack_buffer_chunk_t* c = _msgpack_buffer_position_chunk(b, pos);
+    return c == NULL ? NULL : c->first + pos->offset;
+}
+
+void msgpack_buffer_erase(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos, size_t length)
+{
+    _msgpack_buffer_check_nogvl_readers(b);
+    msgpack_buffer_chunk_t* c = _msgpack_buffer_position_chunk(b, pos);
+    char* p = c->first + pos->offset;
+    memmove(p, p + length, c->last - p - length);
+    c->last -= length;
+
+    if(c != b->head && c != &b->tail) {
+        b->inner_size -= length;
+    }
+}
+
+void msgpack_buffer_truncate(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos)
+{
+    _msgpack_buffer_check_nogvl_readers(b);
+    msgpack_buffer_chunk_t* c = _msgpack_buffer_position_chunk(b, pos);
+    if(c == NULL) {
+        return;
+    }
+
+    if(c == &b->tail) {
+        b->tail.last = b->tail.first + pos->offset;
+        return;
+    }
+
+    /* release the chunks after c and make c the tail */
+    msgpack_buffer_chunk_t* n = c->next;
+    while(n != &b->tail) {
+        msgpack_buffer_chunk_t* next = n->next;
+        _msgpack_buffer_chunk_destroy(n, false);
+        n->next = b->free_list;
+        b->free_list = n;
+        n = next;
+    }
+    _msgpack_buffer_chunk_destroy(&b->tail, false);
+
+    b->tail = *c;
+    b->tail.last = b->tail.first + pos->offset;
+    b->tail.next = NULL;
+    c->mem = NULL;
+    c->next = b->free_list;
+    b->free_list = c;
+
+    if(pos->before == NULL) {
+        b->head = &b->tail;
+        b->before_tail = NULL;
+    } else {
+        pos->before->next = &b->tail;
+        b->before_tail = pos->before;
+    }
+
+    b->inner_size = 0;
+    if(b->head != &b->tail) {
+        for(n = b->head->next; n != &b->tail; n = n->next) {
+            b->inner_size += n->last - n->first;
         }
-        c = c->next;
     }
+
+    /* the free space of c may have been used by the released chunks, which
+     * may also have owned the current rmem page */
+    b->tail_buffer_end = b->tail.last;
+    b->rmem_last = NULL;
+    b->rmem_end = NULL;
+    b->rmem_owner = NULL;
 }
 
 bool _msgpack_buffer_read_all2(msgpack_buffer_t* b, char* buffer, size_t length)
@@ -266,6 +508,8 @@ static inline msgpack_buffer_chunk_t* _msgpack_buffer_alloc_new_chunk(msgpack_bu
 
 static inline void _msgpack_buffer_add_new_chunk(msgpack_buffer_t* b)
 {
+    _msgpack_buffer_check_nogvl_readers(b);
+
     if(b->head == &b->tail) {
         if(b->tail.first == NULL) {
             /* empty buffer */
@@ -277,14 +521,9 @@ static inline void _msgpack_buffer_add_new_chunk(msgpack_buffer_t* b)
         *nc = b->tail;
         b->head = nc;
         nc->next = &b->tail;
+        b->before_tail = nc;
 
     } else {
-        /* search node before tail */
-        msgpack_buffer_chunk_t* before_tail = b->head;
-        while(before_tail->next != &b->tail) {
-            before_tail = before_tail->next;
-        }
-
         msgpack_buffer_chunk_t* nc = _msgpack_buffer_alloc_new_chunk(b);
 
         if(b->rmem_last == b->tail_buffer_end) {
@@ -295,8 +534,10 @@ static inline void _msgpack_buffer_add_new_chunk(msgpack_buffer_t* b)
 
         /* rebuild tail */
         *nc = b->tail;
-        before_tail->next = nc;
+        b->before_tail->next = nc;
         nc->next = &b->tail;
+        b->before_tail = nc;
+        b->inner_size += nc->last - nc->first;
     }
 }
 
@@ -348,13 +589,13 @@ static inline void* _msgpack_buffer_chunk_malloc(
         msgpack_buffer_t* b, msgpack_buffer_chunk_t* c,
         size_t required_size, size_t* allocated_size)
 {
-    if(required_size <= MSGPACK_RMEM_PAGE_SIZE) {
-        c->rmem = true;
+    if(required_size <= MSGPACK_RMEM_PAGE_SIZE && b->rmem) {
+        c->rmem = b->rmem;
 
         if((size_t)(b->rmem_end - b->rmem_last) < required_size) {
             /* alloc new rmem page */
             *allocated_size = MSGPACK_RMEM_PAGE_SIZE;
-            char* buffer = msgpack_rmem_alloc(&s_rmem);
+            char* buffer = msgpack_rmem_alloc(b->rmem);
             c->mem = buffer;
 
             /* update rmem owner */
@@ -377,11 +618,21 @@ static inline void* _msgpack_buffer_chunk_malloc(
         }
     }
 
+    if(required_size <= MSGPACK_RMEM_MAX_PAGE_SIZE && b->rmem) {
+        /* a whole page of a larger class */
+        msgpack_rmem_t* pm = &b->rmem[msgpack_rmem_class_of(required_size)];
+        *allocated_size = pm->page_size;
+        c->rmem = pm;
+        c->mem = msgpack_rmem_alloc(pm);
+        return c->mem;
+    }
+
     // TODO alignment?
     *allocated_size = required_size;
     void* mem = xmalloc(required_size);
     c->mem = mem;
-    c->rmem = false;
+    c->mem_size = required_size;
+    c->rmem = NULL;
     return mem;
 }
 
@@ -397,15 +648,31 @@ static inline void* _msgpack_buffer_chunk_realloc(
     while(next_size < required_size) {
         next_size *= 2;
     }
+
+    if(c->rmem) {
+        /* pages can't be resized: move to a page of a larger class or out of the pools */
+        msgpack_rmem_t* pm = c->rmem;
+        size_t filled = c->last - c->first;
+        void* next = _msgpack_buffer_chunk_malloc(b, c, next_size, current_size);
+        memcpy(next, mem, filled);
+        if(!msgpack_rmem_free(pm, mem)) {
+            rb_bug("Failed to free an rmem pointer, memory leak?");
+        }
+        return next;
+    }
+
     *current_size = next_size;
     mem = xrealloc(mem, next_size);
 
     c->mem = mem;
+    c->mem_size = next_size;
     return mem;
 }
 
 void _msgpack_buffer_expand(msgpack_buffer_t* b, const char* data, size_t length, bool flush_to_io)
 {
+    _msgpack_buffer_check_nogvl_readers(b);
+
     if(flush_to_io && b->io != Qnil) {
         msgpack_buffer_flush(b);
         if(msgpack_buffer_writable_size(b) >= length) {
@@ -430,7 +697,7 @@ void _msgpack_buffer_expand(msgpack_buffer_t* b, const char* data, size_t length
 
     size_t capacity = b->tail.last - b->tail.first;
 
-    /* can't realloc mapped chunk or rmem page */
+    /* can't realloc mapped chunk or shared 4KB rmem page */
     if(b->tail.mapped_string != NO_MAPPED_STRING || capacity <= MSGPACK_RMEM_PAGE_SIZE) {
         /* allocate new chunk */
         _msgpack_buffer_add_new_chunk(b);
@@ -509,11 +776,19 @@ static inline VALUE _msgpack_buffer_chunk_as_string(msgpack_buffer_chunk_t* c)
 
 VALUE msgpack_buffer_all_as_string(msgpack_buffer_t* b)
 {
+    size_t length = msgpack_buffer_all_readable_size(b);
+
+    if(length >= b->nogvl_threshold &&
+            !(b->head == &b->tail && b->head->mapped_string != NO_MAPPED_STRING)) {
+        VALUE string = rb_str_new(NULL, length);
+        _msgpack_buffer_copy_without_gvl(b, RSTRING_PTR(string), length);
+        return string;
+    }
+
     if(b->head == &b->tail) {
         return _msgpack_buffer_head_chunk_as_string(b);
     }
 
-    size_t length = msgpack_buffer_all_readable_size(b);
     VALUE string = rb_str_new(NULL, length);
     char* buffer = RSTRING_PTR(string);
 
@@ -566,12 +841,150 @@ VALUE msgpack_buffer_all_as_string_array(msgpack_buffer_t* b)
     return ary;
 }
 
+#ifdef HAVE_WRITEV
+#define MSGPACK_BUFFER_WRITEV_MAX_IOV 256
+
+struct msgpack_buffer_writev_args {
+    msgpack_buffer_t* b;
+    int fd;
+    const struct iovec* iov;
+    int iovcnt;
+    ssize_t result;
+    int error;
+};
+
+static void* _msgpack_buffer_writev_without_gvl(void* ptr)
+{
+    struct msgpack_buffer_writev_args* args = ptr;
+    args->result = writev(args->fd, args->iov, args->iovcnt);
+    args->error = errno;
+    return NULL;
+}
+
+static VALUE _msgpack_buffer_writev_body(VALUE ptr)
+{
+    rb_thread_call_without_gvl(_msgpack_buffer_writev_without_gvl, (void*)ptr, RUBY_UBF_IO, NULL);
+    return Qnil;
+}
+
+static VALUE _msgpack_buffer_writev_ensure(VALUE ptr)
+{
+    ((struct msgpack_buffer_writev_args*)ptr)->b->nogvl_readers--;
+    return Qnil;
+}
+
+/*
+ * Writes all the chunks to the file descriptor of a binmode IO with writev(2),
+ * without the GVL. Returns false if the IO isn't eligible and has to be
+ * written through its write method.
+ */
+static bool _msgpack_buffer_writev_to_io(msgpack_buffer_t* b, VALUE io, ID write_method, size_t* written)
+{
+    if(!RB_TYPE_P(io, T_FILE) || write_method != s_write || !rb_method_basic_definition_p(rb_class_of(io), s_write)) {
+        return false;
+    }
+
+#ifdef HAVE_RB_IO_MODE
+    int mode = rb_io_mode(io);
+#else
+    rb_io_t* fptr;
+    GetOpenFile(io, fptr);
+    int mode = fptr->mode;
+#endif
+    /* text mode IOs may convert what is written */
+    if(!(mode & FMODE_BINMODE) || !(mode & FMODE_WRITABLE)) {
+        return false;
+    }
+
+    /* data buffered by the IO itself has to be written first */
+    rb_io_flush(io);
+
+#ifdef HAVE_RB_IO_DESCRIPTOR
+    int fd = rb_io_descriptor(io);
+#else
+    GetOpenFile(io, fptr);
+    int fd = fptr->fd;
+#endif
+
+    struct iovec iov[MSGPACK_BUFFER_WRITEV_MAX_IOV];
+    size_t total = 0;
+
+    while(msgpack_buffer_top_readable_size(b) > 0) {
+        int iovcnt = 0;
+        msgpack_buffer_chunk_t* c = b->head;
+        iov[iovcnt].iov_base = b->read_buffer;
+        iov[iovcnt].iov_len = msgpack_buffer_top_readable_size(b);
+        iovcnt++;
+        while(c != &b->tail && iovcnt < MSGPACK_BUFFER_WRITEV_MAX_IOV) {
+            c = c->next;
+            if(c->last > c->first) {
+                iov[iovcnt].iov_base = c->first;
+                iov[iovcnt].iov_len = c->last - c->first;
+                iovcnt++;
+            }
+        }
+
+        struct msgpack_buffer_writev_args args = { b, fd, iov, iovcnt, 0, 0 };
+        /* other threads must not free the chunks while they are written */
+        b->nogvl_readers++;
+        rb_ensure(_msgpack_buffer_writev_body, (VALUE)&args, _msgpack_buffer_writev_ensure, (VALUE)&args);
+
+        if(args.result < 0) {
+            if(args.error == EINTR) {
+                rb_thread_check_ints();
+                continue;
+            }
+#ifdef HAVE_RB_IO_MAYBE_WAIT_WRITABLE
+            if(rb_io_maybe_wait_writable(args.error, io, Qnil)) {
+                continue;
+            }
+#else
+            errno = args.error;
+            if(rb_io_wait_writable(fd)) {
+                continue;
+            }
+#endif
+            rb_syserr_fail(args.error, "writev");
+        }
+
+        msgpack_buffer_skip_nonblock(b, (size_t)args.result);
+        total += (size_t)args.result;
+    }
+
+    *written = total;
+    return true;
+}
+#endif
+
 size_t msgpack_buffer_flush_to_io(msgpack_buffer_t* b, VALUE io, ID write_method, bool consume)
 {
     if(msgpack_buffer_top_readable_size(b) == 0) {
         return 0;
     }
 
+    if(consume && b->head != &b->tail) {
+#ifdef HAVE_WRITEV
+        size_t written;
+        if(_msgpack_buffer_writev_to_io(b, io, write_method, &written)) {
+            return written;
+        }
+#endif
+
+        if(write_method == s_write && rb_respond_to(io, s_write) && rb_obj_method_arity(io, s_write) == -1) {
+            /* write all the chunks at once with io.write(*chunks), only when
+             * write takes any number of Strings like IO#write and StringIO#write */
+            VALUE chunks = rb_ary_new();
+            size_t sz = 0;
+            do {
+                VALUE s = _msgpack_buffer_head_chunk_as_string(b);
+                rb_ary_push(chunks, s);
+                sz += RSTRING_LEN(s);
+            } while(_msgpack_buffer_shift_chunk(b));
+            rb_funcallv(io, write_method, (int)RARRAY_LEN(chunks), RARRAY_CONST_PTR(chunks));
+            return sz;
+        }
+    }
+
     VALUE s = _msgpack_buffer_head_chunk_as_string(b);
     rb_funcall(io, write_method, 1, s);
     size_t sz = RSTRING_LEN(s);
@@ -601,8 +1014,37 @@ size_t msgpack_buffer_flush_to_io(msgpack_buffer_t* b, VALUE io, ID write_method
     }
 }
 
+static size_t _msgpack_buffer_feed_reference_from_io(msgpack_buffer_t* b)
+{
+    /* read into a new String each time so that the buffer can refer to it */
+    VALUE string = rb_funcall(b->io, b->io_partial_read_method, 1, SIZET2NUM(b->io_buffer_size));
+    if(string == Qnil) {
+        rb_raise(rb_eEOFError, "IO reached end of file");
+    }
+    StringValue(string);
+
+    size_t len = RSTRING_LEN(string);
+    if(len == 0) {
+        rb_raise(rb_eEOFError, "IO reached end of file");
+    }
+
+    if(len < b->read_reference_threshold) {
+        /* short reads are cheaper to copy than to keep their whole capacity alive */
+        msgpack_buffer_append_nonblock(b, RSTRING_PTR(string), len);
+    } else {
+        /* the IO may keep the String, so map a copy-on-write dup of it */
+        _msgpack_buffer_append_reference(b, string);
+    }
+
+    return len;
+}
+
 size_t _msgpack_buffer_feed_from_io(msgpack_buffer_t* b)
 {
+    if(b->io_zero_copy) {
+        return _msgpack_buffer_feed_reference_from_io(b);
+    }
+
     if(b->io_buffer == Qnil) {
         b->io_buffer = rb_funcall(b->io, b->io_partial_read_method, 1, SIZET2NUM(b->io_buffer_size));
         if(b->io_buffer == Qnil) {
@@ -621,7 +1063,7 @@ size_t _msgpack_buffer_feed_from_io(msgpack_buffer_t* b)
         rb_raise(rb_eEOFError, "IO reached end of file");
     }
 
-    /* TODO zero-copy optimize? */
+    /* see io_zero_copy to avoid this copy */
     msgpack_buffer_append_nonblock(b, RSTRING_PTR(b->io_buffer), len);
 
     return len;
@@ -670,3 +1112,27 @@ size_t _msgpack_buffer_skip_from_io(msgpack_buffer_t* b, size_t length)
     return RSTRING_LEN(b->io_buffer);
 }
 
+
+void msgpack_key_cache_init(msgpack_key_cache_t *cache, size_t capacity)
+{
+    msgpack_key_cache_destroy(cache);
+
+    if (capacity > MSGPACK_KEY_CACHE_MAX_CAPACITY) {
+        capacity = MSGPACK_KEY_CACHE_MAX_CAPACITY;
+    }
+
+    uint32_t rounded = 0;
+    if (capacity > 0) {
+        rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+    }
+    cache->capacity = rounded;
+}
+
+void msgpack_key_cache_destroy(msgpack_key_cache_t *cache)
+{
+    xfree(cache->entries);
+    memset(cache, 0, sizeof(msgpack_key_cache_t));
+}
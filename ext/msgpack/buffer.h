@@ -20,6 +20,7 @@
 
 #include "compat.h"
 #include "sysdep.h"
+#include "rmem.h"
 
 #ifndef MSGPACK_BUFFER_STRING_WRITE_REFERENCE_DEFAULT
 #define MSGPACK_BUFFER_STRING_WRITE_REFERENCE_DEFAULT (512*1024)
@@ -47,6 +48,11 @@
 #define MSGPACK_BUFFER_IO_BUFFER_SIZE_MINIMUM (1024)
 #endif
 
+/* releasing the GVL costs more than copying less than this */
+#ifndef MSGPACK_BUFFER_NOGVL_THRESHOLD_MINIMUM
+#define MSGPACK_BUFFER_NOGVL_THRESHOLD_MINIMUM (64*1024)
+#endif
+
 #define NO_MAPPED_STRING ((VALUE)0)
 
 #ifndef RB_ENC_INTERNED_STR_NULL_CHECK
@@ -76,9 +82,10 @@ struct msgpack_buffer_chunk_t {
     char* first;
     char* last;
     void* mem;
+    size_t mem_size;  /* of xmalloc()ed mem */
     msgpack_buffer_chunk_t* next;
     VALUE mapped_string;  /* RBString or NO_MAPPED_STRING */
-    bool rmem;
+    msgpack_rmem_t* rmem;  /* pool of mem or NULL */
 };
 
 struct msgpack_buffer_t {
@@ -89,6 +96,14 @@ struct msgpack_buffer_t {
     msgpack_buffer_chunk_t* head;
     msgpack_buffer_chunk_t* free_list;
 
+    /* chunk linked to tail, and size of the chunks between head and tail */
+    msgpack_buffer_chunk_t* before_tail;
+    size_t inner_size;
+
+    /* number of chunks released by reading, to invalidate positions */
+    size_t shifted_chunks;
+
+    msgpack_rmem_t* rmem;  /* MSGPACK_RMEM_CLASSES pools or NULL */
     char* rmem_last;
     char* rmem_end;
     void** rmem_owner;
@@ -101,6 +116,12 @@ struct msgpack_buffer_t {
     size_t write_reference_threshold;
     size_t read_reference_threshold;
     size_t io_buffer_size;
+    size_t nogvl_threshold;
+
+    /* number of copies running without the GVL, which read the chunks */
+    size_t nogvl_readers;
+
+    bool io_zero_copy;
 };
 
 /*
@@ -110,6 +131,9 @@ void msgpack_buffer_static_init(void);
 
 void msgpack_buffer_static_destroy(void);
 
+/* the MSGPACK_RMEM_CLASSES pools of the buffers, or NULL outside the main Ractor */
+msgpack_rmem_t* msgpack_buffer_rmem_pools(void);
+
 void msgpack_buffer_init(msgpack_buffer_t* b);
 
 void msgpack_buffer_destroy(msgpack_buffer_t* b);
@@ -120,6 +144,12 @@ void msgpack_buffer_clear(msgpack_buffer_t* b);
 
 size_t msgpack_buffer_memsize(const msgpack_buffer_t* b);
 
+/*
+ * Clears the buffer and makes it write into string, a new String not seen by
+ * Ruby code yet, up to its length. Data beyond it goes to new chunks.
+ */
+void msgpack_buffer_write_into_string(msgpack_buffer_t* b, VALUE string);
+
 static inline void msgpack_buffer_set_write_reference_threshold(msgpack_buffer_t* b, size_t length)
 {
     if(length < MSGPACK_BUFFER_STRING_WRITE_REFERENCE_MINIMUM) {
@@ -144,6 +174,19 @@ static inline void msgpack_buffer_set_io_buffer_size(msgpack_buffer_t* b, size_t
     b->io_buffer_size = length;
 }
 
+static inline void msgpack_buffer_set_nogvl_threshold(msgpack_buffer_t* b, size_t length)
+{
+    if(length < MSGPACK_BUFFER_NOGVL_THRESHOLD_MINIMUM) {
+        length = MSGPACK_BUFFER_NOGVL_THRESHOLD_MINIMUM;
+    }
+    b->nogvl_threshold = length;
+}
+
+static inline void msgpack_buffer_set_io_zero_copy(msgpack_buffer_t* b, bool enable)
+{
+    b->io_zero_copy = enable;
+}
+
 static inline void msgpack_buffer_reset_io(msgpack_buffer_t* b)
 {
     b->io = Qnil;
@@ -281,6 +324,36 @@ static inline size_t msgpack_buffer_top_readable_size(const msgpack_buffer_t* b)
 
 size_t msgpack_buffer_all_readable_size(const msgpack_buffer_t* b);
 
+/*
+ * Position of the next byte written to a buffer, to patch, erase or discard
+ * the data written after it later on. Reading the buffer invalidates it.
+ */
+typedef struct {
+    msgpack_buffer_chunk_t* before;  /* chunk linked to the chunk of the position, or NULL if it's head */
+    size_t offset;  /* from first of the chunk */
+    size_t read_offset;  /* of read_buffer from first of head */
+    size_t shifted_chunks;
+    size_t size;  /* all readable size */
+} msgpack_buffer_position_t;
+
+static inline void msgpack_buffer_get_position(const msgpack_buffer_t* b, msgpack_buffer_position_t* pos)
+{
+    pos->before = b->head == &b->tail ? NULL : b->before_tail;
+    pos->offset = b->tail.last - b->tail.first;
+    pos->read_offset = b->read_buffer - b->head->first;
+    pos->shifted_chunks = b->shifted_chunks;
+    pos->size = msgpack_buffer_all_readable_size(b);
+}
+
+/* returns a pointer to the byte at pos, or NULL if pos is invalid */
+char* msgpack_buffer_position_pointer(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos);
+
+/* erases length bytes at pos, which must be in the chunk of pos */
+void msgpack_buffer_erase(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos, size_t length);
+
+/* discards the data written after pos, if pos is still valid */
+void msgpack_buffer_truncate(msgpack_buffer_t* b, const msgpack_buffer_position_t* pos);
+
 bool _msgpack_buffer_shift_chunk(msgpack_buffer_t* b);
 
 static inline void _msgpack_buffer_consumed(msgpack_buffer_t* b, size_t length)
@@ -407,6 +480,8 @@ VALUE msgpack_buffer_all_as_string(msgpack_buffer_t* b);
 
 VALUE msgpack_buffer_all_as_string_array(msgpack_buffer_t* b);
 
+VALUE _msgpack_buffer_read_as_string_without_gvl(msgpack_buffer_t* b, size_t length, bool utf8);
+
 static inline VALUE _msgpack_buffer_refer_head_mapped_string(msgpack_buffer_t* b, size_t length)
 {
     size_t offset = b->read_buffer - b->head->first;
@@ -425,6 +500,13 @@ static inline VALUE msgpack_buffer_read_top_as_string(msgpack_buffer_t* b, size_
         return result;
     }
 
+    if(length >= b->nogvl_threshold) {
+        /* large strings are not worth deduplicating */
+        VALUE result = _msgpack_buffer_read_as_string_without_gvl(b, length, utf8);
+        if (will_be_frozen) rb_obj_freeze(result);
+        return result;
+    }
+
     VALUE result;
 
 #ifdef HAVE_RB_ENC_INTERNED_STR
@@ -477,18 +559,34 @@ static inline VALUE msgpack_buffer_read_top_as_symbol(msgpack_buffer_t* b, size_
 // Hash keys are likely to be repeated, and are frozen.
 // As such we can re-use them if we keep a cache of the ones we've seen so far,
 // and save much more expensive lookups into the global fstring table.
-// This cache implementation is deliberately simple, as we're optimizing for compactness,
-// to be able to fit easily embeded inside msgpack_unpacker_t.
-// As such, binary search into a sorted array gives a good tradeoff between compactness and
-// performance.
-#define MSGPACK_KEY_CACHE_CAPACITY 63
+// The cache is an open addressing hash table with a bounded probe window, so
+// lookups stay cheap regardless of the capacity. When the window of a new key is
+// full, an entry which wasn't hit since it was inserted or last passed over is
+// evicted (second chance), so the cache adapts to the keys actually in use.
+#define MSGPACK_KEY_CACHE_DEFAULT_CAPACITY 256
+#define MSGPACK_KEY_CACHE_MAX_CAPACITY (1 << 20)
+#define MSGPACK_KEY_CACHE_PROBE_LIMIT 8
+
+typedef struct {
+    VALUE value;
+    uint32_t hash;
+    bool referenced;
+} msgpack_key_cache_entry_t;
 
 typedef struct msgpack_key_cache_t msgpack_key_cache_t;
 struct msgpack_key_cache_t {
-    int length;
-    VALUE entries[MSGPACK_KEY_CACHE_CAPACITY];
+    msgpack_key_cache_entry_t *entries; /* lazily allocated */
+    uint32_t capacity; /* power of two, 0 when disabled */
+    uint32_t length;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
 };
 
+void msgpack_key_cache_init(msgpack_key_cache_t *cache, size_t capacity);
+
+void msgpack_key_cache_destroy(msgpack_key_cache_t *cache);
+
 static inline VALUE build_interned_string(const char *str, const long length)
 {
 # ifdef HAVE_RB_ENC_INTERNED_STR
@@ -504,87 +602,114 @@ static inline VALUE build_symbol(const char *str, const long length)
     return rb_str_intern(build_interned_string(str, length));
 }
 
-static void rvalue_cache_insert_at(msgpack_key_cache_t *cache, int index, VALUE rstring)
+static inline uint32_t key_cache_hash(const char *str, const long length)
 {
-    MEMMOVE(&cache->entries[index + 1], &cache->entries[index], VALUE, cache->length - index);
-    cache->length++;
-    cache->entries[index] = rstring;
+    /* FNV-1a, keys are short enough for a bytewise hash */
+    uint32_t hash = 2166136261U;
+    for (long i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619U;
+    }
+    return hash;
 }
 
-static inline int rstring_cache_cmp(const char *str, const long length, VALUE rstring)
+static inline VALUE key_cache_fetch(msgpack_key_cache_t *cache, const char *str, const long length, bool symbol)
 {
-    long rstring_length = RSTRING_LEN(rstring);
-    if (length == rstring_length) {
-        return memcmp(str, RSTRING_PTR(rstring), length);
-    } else {
-        return (int)(length - rstring_length);
+    if (RB_UNLIKELY(!cache->entries)) {
+        cache->entries = ZALLOC_N(msgpack_key_cache_entry_t, cache->capacity);
     }
-}
 
-static VALUE rstring_cache_fetch(msgpack_key_cache_t *cache, const char *str, const long length)
-{
-    int low = 0;
-    int high = cache->length - 1;
-    int mid = 0;
-    int last_cmp = 0;
+    uint32_t hash = key_cache_hash(str, length);
+    uint32_t mask = cache->capacity - 1;
+    uint32_t probes = cache->capacity < MSGPACK_KEY_CACHE_PROBE_LIMIT ? cache->capacity : MSGPACK_KEY_CACHE_PROBE_LIMIT;
+    msgpack_key_cache_entry_t *victim = NULL;
 
-    while (low <= high) {
-        mid = (high + low) >> 1;
-        VALUE entry = cache->entries[mid];
-        last_cmp = rstring_cache_cmp(str, length, entry);
+    for (uint32_t i = 0; i < probes; i++) {
+        msgpack_key_cache_entry_t *entry = &cache->entries[(hash + i) & mask];
 
-        if (last_cmp == 0) {
-            return entry;
-        } else if (last_cmp > 0) {
-            low = mid + 1;
-        } else {
-            high = mid - 1;
+        if (!entry->value) {
+            /* entries are never removed, so the key isn't cached */
+            victim = entry;
+            break;
         }
-    }
-
-    VALUE rstring = build_interned_string(str, length);
 
-    if (cache->length < MSGPACK_KEY_CACHE_CAPACITY) {
-        if (last_cmp > 0) {
-            mid += 1;
+        if (entry->hash == hash) {
+            VALUE rstring = symbol ? rb_sym2str(entry->value) : entry->value;
+            if (RSTRING_LEN(rstring) == length && memcmp(str, RSTRING_PTR(rstring), length) == 0) {
+                entry->referenced = true;
+                cache->hits++;
+                return entry->value;
+            }
         }
 
-        rvalue_cache_insert_at(cache, mid, rstring);
+        if (!victim && !entry->referenced) {
+            victim = entry;
+        }
     }
-    return rstring;
-}
 
-static VALUE rsymbol_cache_fetch(msgpack_key_cache_t *cache, const char *str, const long length)
-{
-    int low = 0;
-    int high = cache->length - 1;
-    int mid = 0;
-    int last_cmp = 0;
+    if (!victim) {
+        /* every entry of the window was hit, give them a second chance */
+        for (uint32_t i = 0; i < probes; i++) {
+            cache->entries[(hash + i) & mask].referenced = false;
+        }
+        victim = &cache->entries[hash & mask];
+    }
 
-    while (low <= high) {
-        mid = (high + low) >> 1;
-        VALUE entry = cache->entries[mid];
-        last_cmp = rstring_cache_cmp(str, length, rb_sym2str(entry));
+    VALUE value = symbol ? build_symbol(str, length) : build_interned_string(str, length);
 
-        if (last_cmp == 0) {
-            return entry;
-        } else if (last_cmp > 0) {
-            low = mid + 1;
-        } else {
-            high = mid - 1;
-        }
+    cache->misses++;
+    if (victim->value) {
+        cache->evictions++;
+    } else {
+        cache->length++;
     }
+    victim->value = value;
+    victim->hash = hash;
+    victim->referenced = false;
+
+    return value;
+}
+
+// A key dictionary is an immutable table of keys attached to a Factory and
+// shared by all its unpackers, which consult it before their own key cache.
+// It is filled once and never modified, so it can be read concurrently.
+typedef struct {
+    VALUE string; /* interned frozen String */
+    VALUE symbol;
+    uint32_t hash;
+} msgpack_key_dictionary_entry_t;
+
+typedef struct msgpack_key_dictionary_t msgpack_key_dictionary_t;
+struct msgpack_key_dictionary_t {
+    msgpack_key_dictionary_entry_t *entries;
+    uint32_t capacity; /* power of two, at least twice the number of keys */
+    uint32_t length;
+};
 
-    VALUE rsymbol = build_symbol(str, length);
+static inline VALUE msgpack_key_dictionary_lookup(const msgpack_key_dictionary_t *dict, const char *str, const long length, bool symbol)
+{
+    uint32_t hash = key_cache_hash(str, length);
+    uint32_t mask = dict->capacity - 1;
 
-    if (cache->length < MSGPACK_KEY_CACHE_CAPACITY) {
-        if (last_cmp > 0) {
-            mid += 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        const msgpack_key_dictionary_entry_t *entry = &dict->entries[i];
+        if (!entry->string) {
+            return Qundef;
+        }
+        if (entry->hash == hash && RSTRING_LEN(entry->string) == length && memcmp(str, RSTRING_PTR(entry->string), length) == 0) {
+            return symbol ? entry->symbol : entry->string;
         }
-
-        rvalue_cache_insert_at(cache, mid, rsymbol);
     }
-    return rsymbol;
+}
+
+static inline VALUE rstring_cache_fetch(msgpack_key_cache_t *cache, const char *str, const long length)
+{
+    return key_cache_fetch(cache, str, length, false);
+}
+
+static inline VALUE rsymbol_cache_fetch(msgpack_key_cache_t *cache, const char *str, const long length)
+{
+    return key_cache_fetch(cache, str, length, true);
 }
 
 static inline VALUE msgpack_buffer_read_top_as_interned_symbol(msgpack_buffer_t* b, msgpack_key_cache_t *cache, size_t length)
@@ -20,6 +20,11 @@
 #include "ruby.h"
 #include "buffer.h"
 #include "buffer_class.h"
+#include "unpacker_class.h"
+
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
 
 VALUE cMessagePack_Buffer = Qnil;
 VALUE cMessagePack_HeldBuffer = Qnil;
@@ -34,25 +39,38 @@ static ID s_at_owner;
 static VALUE sym_read_reference_threshold;
 static VALUE sym_write_reference_threshold;
 static VALUE sym_io_buffer_size;
+static VALUE sym_io_zero_copy;
+static VALUE sym_nogvl_threshold;
 
 typedef struct msgpack_held_buffer_t msgpack_held_buffer_t;
 struct msgpack_held_buffer_t {
-    size_t size;
-    VALUE mapped_strings[];
+    const msgpack_buffer_t* buffer; /* NULL once released */
+    const msgpack_buffer_chunk_t* tail;
 };
 
 static void HeldBuffer_mark(void *data)
 {
     msgpack_held_buffer_t* held_buffer = (msgpack_held_buffer_t*)data;
-    for (size_t index = 0; index < held_buffer->size; index++) {
-        rb_gc_mark(held_buffer->mapped_strings[index]);
+    const msgpack_buffer_t* b = held_buffer->buffer;
+    if(b == NULL) {
+        return;
     }
+
+    /* the chunks of the copy are still linked to the tail of the original */
+    const msgpack_buffer_chunk_t* c = b->head;
+    while(c != held_buffer->tail) {
+        rb_gc_mark(c->mapped_string);
+        c = c->next;
+    }
+    rb_gc_mark(b->tail.mapped_string);
+
+    rb_gc_mark(b->io);
+    rb_gc_mark(b->io_buffer);
 }
 
 static size_t HeldBuffer_memsize(const void *data)
 {
-    const msgpack_held_buffer_t* held_buffer = (msgpack_held_buffer_t*)data;
-    return sizeof(size_t) + sizeof(VALUE) * held_buffer->size;
+    return sizeof(msgpack_held_buffer_t);
 }
 
 static const rb_data_type_t held_buffer_data_type = {
@@ -65,41 +83,20 @@ static const rb_data_type_t held_buffer_data_type = {
     .flags = RUBY_TYPED_FREE_IMMEDIATELY
 };
 
-VALUE MessagePack_Buffer_hold(msgpack_buffer_t* buffer)
+VALUE MessagePack_Buffer_hold(const msgpack_buffer_t* copy, const msgpack_buffer_t* original)
 {
-    size_t mapped_strings_count = 0;
-    msgpack_buffer_chunk_t* c = buffer->head;
-    while (c != &buffer->tail) {
-        if (c->mapped_string != NO_MAPPED_STRING) {
-            mapped_strings_count++;
-        }
-        c = c->next;
-    }
-    if (c->mapped_string != NO_MAPPED_STRING) {
-        mapped_strings_count++;
-    }
-
-    if (mapped_strings_count == 0) {
-        return Qnil;
-    }
-
-    msgpack_held_buffer_t* held_buffer = xmalloc(sizeof(msgpack_held_buffer_t) + mapped_strings_count * sizeof(VALUE));
+    msgpack_held_buffer_t* held_buffer;
+    VALUE held = TypedData_Make_Struct(cMessagePack_HeldBuffer, msgpack_held_buffer_t, &held_buffer_data_type, held_buffer);
+    held_buffer->buffer = copy;
+    held_buffer->tail = &original->tail;
+    return held;
+}
 
-    c = buffer->head;
-    mapped_strings_count = 0;
-    while (c != &buffer->tail) {
-        if (c->mapped_string != NO_MAPPED_STRING) {
-            held_buffer->mapped_strings[mapped_strings_count] = c->mapped_string;
-            mapped_strings_count++;
-        }
-        c = c->next;
-    }
-    if (c->mapped_string != NO_MAPPED_STRING) {
-        held_buffer->mapped_strings[mapped_strings_count] = c->mapped_string;
-        mapped_strings_count++;
-    }
-    held_buffer->size = mapped_strings_count;
-    return TypedData_Wrap_Struct(cMessagePack_HeldBuffer, &held_buffer_data_type, held_buffer);
+void MessagePack_Buffer_release(VALUE held)
+{
+    msgpack_held_buffer_t* held_buffer;
+    TypedData_Get_Struct(held, msgpack_held_buffer_t, &held_buffer_data_type, held_buffer);
+    held_buffer->buffer = NULL;
 }
 
 
@@ -207,6 +204,14 @@ void MessagePack_Buffer_set_options(msgpack_buffer_t* b, VALUE io, VALUE options
         if(v != Qnil) {
             msgpack_buffer_set_io_buffer_size(b, NUM2SIZET(v));
         }
+
+        v = rb_hash_aref(options, sym_io_zero_copy);
+        msgpack_buffer_set_io_zero_copy(b, RTEST(v));
+
+        v = rb_hash_aref(options, sym_nogvl_threshold);
+        if(v != Qnil) {
+            msgpack_buffer_set_nogvl_threshold(b, NUM2SIZET(v));
+        }
     }
 }
 
@@ -544,6 +549,21 @@ static VALUE Buffer_to_a(VALUE self)
     return msgpack_buffer_all_as_string_array(b);
 }
 
+static VALUE Buffer_scan_boundaries(VALUE self)
+{
+    msgpack_buffer_t *b = MessagePack_Buffer_get(self);
+
+    VALUE segments_v;
+    size_t count = msgpack_unpacker_buffer_segments(b, NULL);
+    msgpack_unpacker_segment_t* segments = ALLOCV_N(msgpack_unpacker_segment_t, segments_v, count);
+    msgpack_unpacker_buffer_segments(b, segments);
+
+    /* other threads could modify the chunks, so the GVL is held */
+    VALUE boundaries = MessagePack_scan_boundaries(segments, count, false);
+    ALLOCV_END(segments_v);
+    return boundaries;
+}
+
 static VALUE Buffer_flush(VALUE self)
 {
     msgpack_buffer_t *b = MessagePack_Buffer_get(self);
@@ -573,6 +593,61 @@ static VALUE Buffer_write_to(VALUE self, VALUE io)
     return SIZET2NUM(sz);
 }
 
+static VALUE rmem_pools_stats(msgpack_rmem_t* pools, int count)
+{
+    VALUE array = rb_ary_new_capa(count);
+    if(pools == NULL) {
+        return array;
+    }
+
+    for(int i = 0; i < count; i++) {
+        msgpack_rmem_stats_t pool;
+        msgpack_rmem_stats(&pools[i], &pool);
+
+        VALUE stats = rb_hash_new();
+        rb_hash_aset(stats, ID2SYM(rb_intern("page_size")), SIZET2NUM(pool.page_size));
+        rb_hash_aset(stats, ID2SYM(rb_intern("chunks")), SIZET2NUM(pool.chunks));
+        rb_hash_aset(stats, ID2SYM(rb_intern("pages")), SIZET2NUM(pool.pages));
+        rb_hash_aset(stats, ID2SYM(rb_intern("pages_in_use")), SIZET2NUM(pool.pages_in_use));
+        rb_hash_aset(stats, ID2SYM(rb_intern("bytes")), SIZET2NUM(pool.pages * pool.page_size));
+        rb_ary_push(array, stats);
+    }
+    return array;
+}
+
+static VALUE MessagePack_module_memory_stats(VALUE self)
+{
+    VALUE stats = rb_hash_new();
+    rb_hash_aset(stats, ID2SYM(rb_intern("buffer")), rmem_pools_stats(msgpack_buffer_rmem_pools(), MSGPACK_RMEM_CLASSES));
+    rb_hash_aset(stats, ID2SYM(rb_intern("unpacker_stack")), rmem_pools_stats(msgpack_unpacker_stack_rmem_pool(), 1));
+    return stats;
+}
+
+static VALUE MessagePack_module_trim_memory(VALUE self)
+{
+    size_t freed = 0;
+
+    msgpack_rmem_t* pools = msgpack_buffer_rmem_pools();
+    if(pools != NULL) {
+        for(int i = 0; i < MSGPACK_RMEM_CLASSES; i++) {
+            freed += msgpack_rmem_trim(&pools[i]);
+        }
+    }
+
+    msgpack_rmem_t* stack_pool = msgpack_unpacker_stack_rmem_pool();
+    if(stack_pool != NULL) {
+        freed += msgpack_rmem_trim(stack_pool);
+    }
+
+#ifdef HAVE_MALLOC_TRIM
+    if(freed > 0) {
+        malloc_trim(0);
+    }
+#endif
+
+    return SIZET2NUM(freed);
+}
+
 void MessagePack_Buffer_module_init(VALUE mMessagePack)
 {
     s_read = rb_intern("read");
@@ -585,6 +660,8 @@ void MessagePack_Buffer_module_init(VALUE mMessagePack)
     sym_read_reference_threshold = ID2SYM(rb_intern("read_reference_threshold"));
     sym_write_reference_threshold = ID2SYM(rb_intern("write_reference_threshold"));
     sym_io_buffer_size = ID2SYM(rb_intern("io_buffer_size"));
+    sym_io_zero_copy = ID2SYM(rb_intern("io_zero_copy"));
+    sym_nogvl_threshold = ID2SYM(rb_intern("nogvl_threshold"));
 
     msgpack_buffer_static_init();
 
@@ -612,5 +689,9 @@ void MessagePack_Buffer_module_init(VALUE mMessagePack)
     rb_define_method(cMessagePack_Buffer, "to_str", Buffer_to_str, 0);
     rb_define_alias(cMessagePack_Buffer, "to_s", "to_str");
     rb_define_method(cMessagePack_Buffer, "to_a", Buffer_to_a, 0);
+    rb_define_method(cMessagePack_Buffer, "scan_boundaries", Buffer_scan_boundaries, 0);
+
+    rb_define_module_function(mMessagePack, "memory_stats", MessagePack_module_memory_stats, 0);
+    rb_define_module_function(mMessagePack, "trim_memory", MessagePack_module_trim_memory, 0);
 }
 
@@ -25,7 +25,13 @@ extern VALUE cMessagePack_Buffer;
 void MessagePack_Buffer_module_init(VALUE mMessagePack);
 
 VALUE MessagePack_Buffer_wrap(msgpack_buffer_t* b, VALUE owner);
-VALUE MessagePack_Buffer_hold(msgpack_buffer_t* b);
+/*
+ * Keeps the strings referred to by copy, a copy of the buffer at original
+ * swapped out of it, alive until MessagePack_Buffer_release is called.
+ */
+VALUE MessagePack_Buffer_hold(const msgpack_buffer_t* copy, const msgpack_buffer_t* original);
+
+void MessagePack_Buffer_release(VALUE held);
 
 void MessagePack_Buffer_set_options(msgpack_buffer_t* b, VALUE io, VALUE options);
 
@@ -22,5 +22,20 @@
 #include "ruby.h"
 #include "ruby/encoding.h"
 
+#ifdef HAVE_RUBY_RACTOR_H
+#include "ruby/ractor.h"
+#include "ruby/atomic.h"
+#define msgpack_atomic_inc(var) RUBY_ATOMIC_INC(var)
+#define msgpack_atomic_fetch_sub(var, val) RUBY_ATOMIC_FETCH_SUB(var, val)
+#else
+#define rb_ractor_shareable_p(obj) false
+#define msgpack_atomic_inc(var) ((var)++)
+#define msgpack_atomic_fetch_sub(var, val) ((var) -= (val), (var) + (val))
+#endif
+
+#ifndef RUBY_TYPED_FROZEN_SHAREABLE
+#define RUBY_TYPED_FROZEN_SHAREABLE 0
+#endif
+
 #endif
 
@@ -4,6 +4,14 @@ have_func("rb_enc_interned_str", "ruby.h") # Ruby 3.0+
 have_func("rb_hash_new_capa", "ruby.h") # Ruby 3.2+
 have_func("rb_proc_call_with_block", "ruby.h") # CRuby (TruffleRuby doesn't have it)
 have_func("rb_gc_mark_locations", "ruby.h") # Missing on TruffleRuby
+have_func("rb_gc_adjust_memory_usage", "ruby.h") # Ruby 2.4+
+have_header("ruby/ractor.h") # Ruby 3.0+
+have_func("rb_ext_ractor_safe", "ruby.h") # Ruby 3.0+
+have_func("writev", "sys/uio.h")
+have_func("malloc_trim", "malloc.h") # glibc
+have_func("rb_io_descriptor", "ruby/io.h") # Ruby 3.1+
+have_func("rb_io_mode", "ruby/io.h") # Ruby 3.3+
+have_func("rb_io_maybe_wait_writable", "ruby/io.h") # Ruby 3.0+
 
 append_cflags([
   "-fvisibility=hidden",
@@ -22,6 +22,9 @@
 #include "buffer_class.h"
 #include "packer_class.h"
 #include "unpacker_class.h"
+#include "schema_class.h"
+#include "key_dictionary_class.h"
+#include "native_ext_class.h"
 
 VALUE cMessagePack_Factory;
 
@@ -31,10 +34,17 @@ typedef struct msgpack_factory_t msgpack_factory_t;
 struct msgpack_factory_t {
     msgpack_packer_ext_registry_t pkrg;
     msgpack_unpacker_ext_registry_t *ukrg;
+    VALUE key_dictionary;
     bool has_bigint_ext_type;
     bool has_symbol_ext_type;
     bool optimized_symbol_ext_type;
+    bool has_timestamp_ext_type;
+    bool optimized_timestamp_ext_type;
+    bool has_native_bigint_ext_type;
+    bool optimized_bigint_ext_type;
     int symbol_ext_type;
+    int timestamp_ext_type;
+    int bigint_ext_type;
 };
 
 static void Factory_free(void *ptr)
@@ -54,6 +64,7 @@ void Factory_mark(void *ptr)
     msgpack_factory_t *fc = ptr;
     msgpack_packer_ext_registry_mark(&fc->pkrg);
     msgpack_unpacker_ext_registry_mark(fc->ukrg);
+    rb_gc_mark(fc->key_dictionary);
 }
 
 static size_t Factory_memsize(const void *ptr)
@@ -75,7 +86,7 @@ static const rb_data_type_t factory_data_type = {
         .dfree = Factory_free,
         .dsize = Factory_memsize,
     },
-    .flags = RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED | RUBY_TYPED_FROZEN_SHAREABLE
 };
 
 static inline msgpack_factory_t *Factory_get(VALUE object)
@@ -91,7 +102,9 @@ static inline msgpack_factory_t *Factory_get(VALUE object)
 static VALUE Factory_alloc(VALUE klass)
 {
     msgpack_factory_t *fc;
-    return TypedData_Make_Struct(klass, msgpack_factory_t, &factory_data_type, fc);
+    VALUE self = TypedData_Make_Struct(klass, msgpack_factory_t, &factory_data_type, fc);
+    fc->key_dictionary = Qnil;
+    return self;
 }
 
 static VALUE Factory_initialize(int argc, VALUE* argv, VALUE self)
@@ -122,6 +135,14 @@ static VALUE Factory_dup(VALUE self)
     msgpack_factory_t *cloned_fc = Factory_get(clone);
 
     cloned_fc->has_symbol_ext_type = fc->has_symbol_ext_type;
+    cloned_fc->has_timestamp_ext_type = fc->has_timestamp_ext_type;
+    cloned_fc->optimized_timestamp_ext_type = fc->optimized_timestamp_ext_type;
+    cloned_fc->timestamp_ext_type = fc->timestamp_ext_type;
+    cloned_fc->has_bigint_ext_type = fc->has_bigint_ext_type;
+    cloned_fc->has_native_bigint_ext_type = fc->has_native_bigint_ext_type;
+    cloned_fc->optimized_bigint_ext_type = fc->optimized_bigint_ext_type;
+    cloned_fc->bigint_ext_type = fc->bigint_ext_type;
+    RB_OBJ_WRITE(clone, &cloned_fc->key_dictionary, fc->key_dictionary);
     cloned_fc->pkrg = fc->pkrg;
     msgpack_unpacker_ext_registry_borrow(fc->ukrg, &cloned_fc->ukrg);
     msgpack_packer_ext_registry_dup(clone, &fc->pkrg, &cloned_fc->pkrg);
@@ -161,6 +182,10 @@ VALUE MessagePack_Factory_packer(int argc, VALUE* argv, VALUE self)
     msgpack_packer_ext_registry_borrow(packer, &fc->pkrg, &pk->ext_registry);
     pk->has_bigint_ext_type = fc->has_bigint_ext_type;
     pk->has_symbol_ext_type = fc->has_symbol_ext_type;
+    pk->has_timestamp_ext_type = fc->has_timestamp_ext_type;
+    pk->timestamp_ext_type = fc->timestamp_ext_type;
+    pk->has_native_bigint_ext_type = fc->has_native_bigint_ext_type;
+    pk->bigint_ext_type = fc->bigint_ext_type;
 
     return packer;
 }
@@ -176,6 +201,14 @@ VALUE MessagePack_Factory_unpacker(int argc, VALUE* argv, VALUE self)
     msgpack_unpacker_ext_registry_borrow(fc->ukrg, &uk->ext_registry);
     uk->optimized_symbol_ext_type = fc->optimized_symbol_ext_type;
     uk->symbol_ext_type = fc->symbol_ext_type;
+    uk->optimized_timestamp_ext_type = fc->optimized_timestamp_ext_type;
+    uk->timestamp_ext_type = fc->timestamp_ext_type;
+    uk->optimized_bigint_ext_type = fc->optimized_bigint_ext_type;
+    uk->bigint_ext_type = fc->bigint_ext_type;
+    if(!NIL_P(fc->key_dictionary)) {
+        uk->key_dictionary = MessagePack_KeyDictionary_get(fc->key_dictionary);
+        uk->key_dictionary_ref = fc->key_dictionary;
+    }
 
     return unpacker;
 }
@@ -184,22 +217,40 @@ static VALUE Factory_registered_types_internal(VALUE self)
 {
     msgpack_factory_t *fc = Factory_get(self);
 
-    VALUE uk_mapping = rb_hash_new();
-    if (fc->ukrg) {
-        for(int i=0; i < 256; i++) {
-            if(!NIL_P(fc->ukrg->array[i])) {
-                rb_hash_aset(uk_mapping, INT2FIX(i - 128), fc->ukrg->array[i]);
-            }
-        }
-    }
-
     return rb_ary_new3(
         2,
         RTEST(fc->pkrg.hash) ? rb_hash_dup(fc->pkrg.hash) : rb_hash_new(),
-        uk_mapping
+        msgpack_unpacker_ext_registry_to_hash(fc->ukrg)
     );
 }
 
+static VALUE Factory_key_dictionary(VALUE self)
+{
+    return Factory_get(self)->key_dictionary;
+}
+
+static VALUE Factory_set_key_dictionary(VALUE self, VALUE dictionary)
+{
+    msgpack_factory_t *fc = Factory_get(self);
+
+    if (OBJ_FROZEN(self)) {
+        rb_raise(rb_eFrozenError, "can't modify frozen MessagePack::Factory");
+    }
+
+    if(!NIL_P(dictionary) && !rb_obj_is_kind_of(dictionary, cMessagePack_KeyDictionary)) {
+        dictionary = MessagePack_KeyDictionary_new(dictionary);
+    }
+
+    RB_OBJ_WRITE(self, &fc->key_dictionary, dictionary);
+    return dictionary;
+}
+
+static VALUE Factory_compile_schema_internal(VALUE self, VALUE klass, VALUE keys)
+{
+    Factory_get(self);
+    return MessagePack_Schema_compile(self, klass, keys);
+}
+
 static VALUE Factory_register_type_internal(VALUE self, VALUE rb_ext_type, VALUE ext_module, VALUE options)
 {
     msgpack_factory_t *fc = Factory_get(self);
@@ -229,6 +280,30 @@ static VALUE Factory_register_type_internal(VALUE self, VALUE rb_ext_type, VALUE
         rb_raise(rb_eRangeError, "integer %d too big to convert to `signed char'", ext_type);
     }
 
+    if(RTEST(options)) {
+        VALUE payload = rb_hash_aref(options, ID2SYM(rb_intern("payload")));
+        if(payload == ID2SYM(rb_intern("view"))) {
+            if(RTEST(rb_hash_aref(options, ID2SYM(rb_intern("recursive")))) || RTEST(rb_hash_aref(options, ID2SYM(rb_intern("native"))))
+                    || RTEST(rb_hash_aref(options, ID2SYM(rb_intern("optimized_symbols_parsing"))))) {
+                rb_raise(rb_eArgError, "payload: :view can't be combined with recursive, native or optimized_symbols_parsing");
+            }
+            flags |= MSGPACK_EXT_PAYLOAD_VIEW;
+        } else if(!NIL_P(payload) && payload != ID2SYM(rb_intern("string"))) {
+            rb_raise(rb_eArgError, "expected payload: to be :string or :view, got: %+"PRIsVALUE, payload);
+        }
+    }
+
+    if(MessagePack_NativeExt_is_native_ext(packer_proc) && !MessagePack_NativeExt_get(packer_proc)->pack) {
+        rb_raise(rb_eArgError, "%"PRIsVALUE" has no pack function", rb_inspect(packer_proc));
+    }
+    if(MessagePack_NativeExt_is_native_ext(unpacker_proc) && !MessagePack_NativeExt_get(unpacker_proc)->unpack) {
+        rb_raise(rb_eArgError, "%"PRIsVALUE" has no unpack function", rb_inspect(unpacker_proc));
+    }
+    if((MessagePack_NativeExt_is_native_ext(packer_proc) || MessagePack_NativeExt_is_native_ext(unpacker_proc))
+            && ((flags & MSGPACK_EXT_PAYLOAD_VIEW) || RTEST(rb_hash_aref(options, ID2SYM(rb_intern("recursive")))))) {
+        rb_raise(rb_eArgError, "a MessagePack::NativeExt can't be combined with recursive or payload: :view");
+    }
+
     if(ext_module == rb_cSymbol) {
         if(NIL_P(options) || RTEST(rb_hash_aref(options, ID2SYM(rb_intern("packer"))))) {
             fc->has_symbol_ext_type = true;
@@ -238,7 +313,37 @@ static VALUE Factory_register_type_internal(VALUE self, VALUE rb_ext_type, VALUE
         }
     }
 
+    if(ext_module == rb_cTime || (fc->optimized_timestamp_ext_type && ext_type == fc->timestamp_ext_type)) {
+        /* a later registration overrides the native timestamp support */
+        fc->has_timestamp_ext_type = false;
+        fc->optimized_timestamp_ext_type = false;
+    }
+
+    if(ext_module == rb_cInteger || (fc->optimized_bigint_ext_type && ext_type == fc->bigint_ext_type)) {
+        /* a later registration overrides the native bigint support */
+        fc->has_native_bigint_ext_type = false;
+        fc->optimized_bigint_ext_type = false;
+    }
+
     if(RTEST(options)) {
+        VALUE native = rb_hash_aref(options, ID2SYM(rb_intern("native")));
+        if(RTEST(native)) {
+            /* :packer or :unpacker only, when only that side uses the Bigint procs */
+            bool native_packer = native != ID2SYM(rb_intern("unpacker"));
+            bool native_unpacker = native != ID2SYM(rb_intern("packer"));
+            if(ext_module == rb_cTime) {
+                fc->timestamp_ext_type = ext_type;
+                fc->has_timestamp_ext_type = RTEST(packer_proc);
+                fc->optimized_timestamp_ext_type = RTEST(unpacker_proc);
+            } else if(ext_module == rb_cInteger) {
+                fc->bigint_ext_type = ext_type;
+                fc->has_native_bigint_ext_type = native_packer && RTEST(packer_proc);
+                fc->optimized_bigint_ext_type = native_unpacker && RTEST(unpacker_proc);
+            } else {
+                rb_raise(rb_eArgError, "native: true is only for Time and Integer classes");
+            }
+        }
+
         if(RTEST(rb_hash_aref(options, ID2SYM(rb_intern("oversized_integer_extension"))))) {
             if(ext_module == rb_cInteger) {
                 fc->has_bigint_ext_type = true;
@@ -252,8 +357,17 @@ static VALUE Factory_register_type_internal(VALUE self, VALUE rb_ext_type, VALUE
         }
     }
 
-    msgpack_packer_ext_registry_put(self, &fc->pkrg, ext_module, ext_type, flags, packer_proc);
-    msgpack_unpacker_ext_registry_put(self, &fc->ukrg, ext_module, ext_type, flags, unpacker_proc);
+    int packer_flags = flags;
+    int unpacker_flags = flags;
+    if(MessagePack_NativeExt_is_native_ext(packer_proc)) {
+        packer_flags |= MSGPACK_EXT_NATIVE_FUNC;
+    }
+    if(MessagePack_NativeExt_is_native_ext(unpacker_proc)) {
+        unpacker_flags |= MSGPACK_EXT_NATIVE_FUNC;
+    }
+
+    msgpack_packer_ext_registry_put(self, &fc->pkrg, ext_module, ext_type, packer_flags, packer_proc);
+    msgpack_unpacker_ext_registry_put(self, &fc->ukrg, ext_module, ext_type, unpacker_flags, unpacker_proc);
 
     return Qnil;
 }
@@ -271,6 +385,10 @@ void MessagePack_Factory_module_init(VALUE mMessagePack)
     rb_define_method(cMessagePack_Factory, "packer", MessagePack_Factory_packer, -1);
     rb_define_method(cMessagePack_Factory, "unpacker", MessagePack_Factory_unpacker, -1);
 
+    rb_define_method(cMessagePack_Factory, "key_dictionary", Factory_key_dictionary, 0);
+    rb_define_method(cMessagePack_Factory, "key_dictionary=", Factory_set_key_dictionary, 1);
+
     rb_define_private_method(cMessagePack_Factory, "registered_types_internal", Factory_registered_types_internal, 0);
+    rb_define_private_method(cMessagePack_Factory, "compile_schema_internal", Factory_compile_schema_internal, 2);
     rb_define_private_method(cMessagePack_Factory, "register_type_internal", Factory_register_type_internal, 3);
 }
@@ -0,0 +1,182 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "compat.h"
+#include "ruby.h"
+#include "buffer.h"
+#include "key_dictionary_class.h"
+
+VALUE cMessagePack_KeyDictionary;
+
+static void KeyDictionary_free(void *ptr)
+{
+    msgpack_key_dictionary_t *dict = ptr;
+    if(dict == NULL) {
+        return;
+    }
+    xfree(dict->entries);
+    xfree(dict);
+}
+
+static void KeyDictionary_mark(void *ptr)
+{
+    msgpack_key_dictionary_t *dict = ptr;
+    if(dict->entries) {
+        for(uint32_t i = 0; i < dict->capacity; i++) {
+            rb_gc_mark(dict->entries[i].string);
+            rb_gc_mark(dict->entries[i].symbol);
+        }
+    }
+}
+
+static size_t KeyDictionary_memsize(const void *ptr)
+{
+    const msgpack_key_dictionary_t *dict = ptr;
+    return sizeof(msgpack_key_dictionary_t) + dict->capacity * sizeof(msgpack_key_dictionary_entry_t);
+}
+
+/* Instances are frozen upon creation and only hold interned Strings and Symbols,
+ * so they can be shared between Ractors. */
+static const rb_data_type_t key_dictionary_data_type = {
+    .wrap_struct_name = "msgpack:key_dictionary",
+    .function = {
+        .dmark = KeyDictionary_mark,
+        .dfree = KeyDictionary_free,
+        .dsize = KeyDictionary_memsize,
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+};
+
+const msgpack_key_dictionary_t *MessagePack_KeyDictionary_get(VALUE self)
+{
+    msgpack_key_dictionary_t *dict;
+    TypedData_Get_Struct(self, msgpack_key_dictionary_t, &key_dictionary_data_type, dict);
+    if (!dict || !dict->entries) {
+        rb_raise(rb_eArgError, "Uninitialized KeyDictionary object");
+    }
+    return dict;
+}
+
+static VALUE KeyDictionary_alloc(VALUE klass)
+{
+    msgpack_key_dictionary_t *dict;
+    return TypedData_Make_Struct(klass, msgpack_key_dictionary_t, &key_dictionary_data_type, dict);
+}
+
+static VALUE KeyDictionary_initialize(VALUE self, VALUE keys)
+{
+    msgpack_key_dictionary_t *dict;
+    TypedData_Get_Struct(self, msgpack_key_dictionary_t, &key_dictionary_data_type, dict);
+
+    if(dict->entries) {
+        rb_raise(rb_eFrozenError, "can't modify frozen MessagePack::KeyDictionary");
+    }
+
+    keys = rb_Array(keys);
+    long count = RARRAY_LEN(keys);
+    if(count > MSGPACK_KEY_CACHE_MAX_CAPACITY) {
+        rb_raise(rb_eArgError, "too many keys for a KeyDictionary: %ld should be <= %d", count, MSGPACK_KEY_CACHE_MAX_CAPACITY);
+    }
+
+    uint32_t capacity = 2;
+    while(capacity < count * 2) {
+        capacity <<= 1;
+    }
+
+    /* attached right away so the interned keys are marked while building */
+    msgpack_key_dictionary_entry_t *entries = ZALLOC_N(msgpack_key_dictionary_entry_t, capacity);
+    dict->entries = entries;
+    dict->capacity = capacity;
+    uint32_t mask = capacity - 1;
+
+    for(long i = 0; i < count; i++) {
+        VALUE key = rb_ary_entry(keys, i);
+        if(SYMBOL_P(key)) {
+            key = rb_sym2str(key);
+        } else if(!RB_TYPE_P(key, T_STRING)) {
+            rb_raise(rb_eTypeError, "expected String or Symbol key but found %s", rb_obj_classname(key));
+        }
+
+        const char *ptr = RSTRING_PTR(key);
+        long len = RSTRING_LEN(key);
+        uint32_t hash = key_cache_hash(ptr, len);
+
+        for(uint32_t j = hash & mask;; j = (j + 1) & mask) {
+            msgpack_key_dictionary_entry_t *entry = &entries[j];
+            if(!entry->string) {
+                /* keys are read as UTF-8, whatever their encoding here */
+                entry->string = build_interned_string(ptr, len);
+                entry->symbol = rb_str_intern(entry->string);
+                entry->hash = hash;
+                dict->length++;
+                break;
+            }
+            if(entry->hash == hash && RSTRING_LEN(entry->string) == len && memcmp(ptr, RSTRING_PTR(entry->string), len) == 0) {
+                break;
+            }
+        }
+    }
+
+    RB_GC_GUARD(keys);
+
+    rb_obj_freeze(self);
+    return self;
+}
+
+VALUE MessagePack_KeyDictionary_new(VALUE keys)
+{
+    return rb_class_new_instance(1, &keys, cMessagePack_KeyDictionary);
+}
+
+static VALUE KeyDictionary_size(VALUE self)
+{
+    return UINT2NUM(MessagePack_KeyDictionary_get(self)->length);
+}
+
+static VALUE KeyDictionary_keys(VALUE self)
+{
+    const msgpack_key_dictionary_t *dict = MessagePack_KeyDictionary_get(self);
+    VALUE keys = rb_ary_new_capa(dict->length);
+    for(uint32_t i = 0; i < dict->capacity; i++) {
+        if(dict->entries[i].string) {
+            rb_ary_push(keys, dict->entries[i].string);
+        }
+    }
+    return keys;
+}
+
+static VALUE KeyDictionary_include_p(VALUE self, VALUE key)
+{
+    const msgpack_key_dictionary_t *dict = MessagePack_KeyDictionary_get(self);
+    if(SYMBOL_P(key)) {
+        key = rb_sym2str(key);
+    }
+    StringValue(key);
+    return msgpack_key_dictionary_lookup(dict, RSTRING_PTR(key), RSTRING_LEN(key), false) == Qundef ? Qfalse : Qtrue;
+}
+
+void MessagePack_KeyDictionary_module_init(VALUE mMessagePack)
+{
+    cMessagePack_KeyDictionary = rb_define_class_under(mMessagePack, "KeyDictionary", rb_cObject);
+    rb_define_alloc_func(cMessagePack_KeyDictionary, KeyDictionary_alloc);
+
+    rb_define_method(cMessagePack_KeyDictionary, "initialize", KeyDictionary_initialize, 1);
+    rb_define_method(cMessagePack_KeyDictionary, "size", KeyDictionary_size, 0);
+    rb_define_method(cMessagePack_KeyDictionary, "keys", KeyDictionary_keys, 0);
+    rb_define_method(cMessagePack_KeyDictionary, "include?", KeyDictionary_include_p, 1);
+}
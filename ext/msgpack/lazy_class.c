@@ -0,0 +1,440 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "compat.h"
+#include "ruby.h"
+#include "unpacker.h"
+#include "unpacker_class.h"
+#include "lazy_class.h"
+
+VALUE cMessagePack_LazyArray;
+VALUE cMessagePack_LazyMap;
+
+static ID s_keys;
+
+/*
+ * A lazy Array or Map refers to the encoded elements and decodes each of
+ * them on first access. Containers nested in it are lazy too, sharing the
+ * same source String and decoding Unpacker.
+ */
+typedef struct {
+    VALUE source;     /* frozen String holding the encoded elements */
+    VALUE unpacker;   /* decodes elements with the options of the Unpacker that read the container */
+    VALUE key_list;   /* maps: Array of decoded keys, nil until indexed */
+    VALUE keys;       /* maps: Hash of decoded keys to their pair index, nil until indexed */
+    size_t offset;    /* of the first element in source */
+    size_t size;      /* bytes of all the elements */
+    uint32_t count;   /* elements, or pairs for maps */
+    bool is_map;
+    size_t *index;    /* index[i] is the offset of object i, relative to offset. NULL until indexed */
+    VALUE *values;    /* decoded elements, or values for maps, Qundef until accessed */
+} msgpack_lazy_t;
+
+static inline size_t Lazy_objects(const msgpack_lazy_t* lz)
+{
+    return lz->is_map ? (size_t)lz->count * 2 : lz->count;
+}
+
+static void Lazy_free(void *ptr)
+{
+    msgpack_lazy_t* lz = ptr;
+    if(lz == NULL) {
+        return;
+    }
+    xfree(lz->index);
+    xfree(lz->values);
+    xfree(lz);
+}
+
+static void Lazy_mark(void *ptr)
+{
+    msgpack_lazy_t* lz = ptr;
+    rb_gc_mark(lz->source);
+    rb_gc_mark(lz->unpacker);
+    rb_gc_mark(lz->key_list);
+    rb_gc_mark(lz->keys);
+    if(lz->values) {
+        for(uint32_t i = 0; i < lz->count; i++) {
+            if(lz->values[i] != Qundef) {
+                rb_gc_mark(lz->values[i]);
+            }
+        }
+    }
+}
+
+static size_t Lazy_memsize(const void *ptr)
+{
+    const msgpack_lazy_t* lz = ptr;
+    size_t total_size = sizeof(msgpack_lazy_t);
+    if(lz->index) {
+        total_size += sizeof(size_t) * (Lazy_objects(lz) + 1) + sizeof(VALUE) * lz->count;
+    }
+    return total_size;
+}
+
+static const rb_data_type_t lazy_data_type = {
+    .wrap_struct_name = "msgpack:lazy",
+    .function = {
+        .dmark = Lazy_mark,
+        .dfree = Lazy_free,
+        .dsize = Lazy_memsize,
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static inline msgpack_lazy_t *Lazy_get(VALUE object)
+{
+    msgpack_lazy_t *lz;
+    TypedData_Get_Struct(object, msgpack_lazy_t, &lazy_data_type, lz);
+    if (!lz || !RTEST(lz->source)) {
+        rb_raise(rb_eArgError, "Uninitialized lazy object");
+    }
+    return lz;
+}
+
+static VALUE Lazy_alloc(VALUE source, VALUE unpacker, size_t offset, size_t size, uint32_t count, bool is_map)
+{
+    msgpack_lazy_t *lz;
+    VALUE self = TypedData_Make_Struct(is_map ? cMessagePack_LazyMap : cMessagePack_LazyArray,
+            msgpack_lazy_t, &lazy_data_type, lz);
+    lz->source = source;
+    lz->unpacker = unpacker;
+    lz->key_list = Qnil;
+    lz->keys = Qnil;
+    lz->offset = offset;
+    lz->size = size;
+    lz->count = count;
+    lz->is_map = is_map;
+    return self;
+}
+
+/* an Unpacker without IO nor buffered data, which decodes like uk */
+static VALUE Lazy_unpacker_new(msgpack_unpacker_t* uk)
+{
+    VALUE unpacker = MessagePack_Unpacker_alloc(cMessagePack_Unpacker);
+    msgpack_unpacker_t* lk = MessagePack_Unpacker_get(unpacker);
+
+    lk->buffer_ref = Qnil;
+    msgpack_buffer_set_read_reference_threshold(UNPACKER_BUFFER_(lk), UNPACKER_BUFFER_(uk)->read_reference_threshold);
+    UNPACKER_BUFFER_(lk)->nogvl_threshold = UNPACKER_BUFFER_(uk)->nogvl_threshold;
+
+    msgpack_unpacker_ext_registry_borrow(uk->ext_registry, &lk->ext_registry);
+    lk->symbolize_keys = uk->symbolize_keys;
+    lk->freeze = uk->freeze;
+    lk->allow_unknown_ext = uk->allow_unknown_ext;
+    lk->optimized_symbol_ext_type = uk->optimized_symbol_ext_type;
+    lk->symbol_ext_type = uk->symbol_ext_type;
+    lk->optimized_timestamp_ext_type = uk->optimized_timestamp_ext_type;
+    lk->timestamp_ext_type = uk->timestamp_ext_type;
+    lk->optimized_bigint_ext_type = uk->optimized_bigint_ext_type;
+    lk->bigint_ext_type = uk->bigint_ext_type;
+    lk->key_dictionary = uk->key_dictionary;
+    lk->key_dictionary_ref = uk->key_dictionary_ref;
+    lk->raw_keys = uk->raw_keys;
+
+    return unpacker;
+}
+
+struct lazy_decode_args {
+    VALUE unpacker;
+    VALUE source;
+    size_t offset;
+    size_t length;
+    const char* header;
+    size_t header_length;
+};
+
+static VALUE Lazy_decode_protected(VALUE ptr)
+{
+    struct lazy_decode_args* args = (struct lazy_decode_args*)ptr;
+    msgpack_unpacker_t* uk = MessagePack_Unpacker_get(args->unpacker);
+    msgpack_buffer_t* b = UNPACKER_BUFFER_(uk);
+
+    if(args->header_length > 0) {
+        msgpack_buffer_append(b, args->header, args->header_length);
+    }
+    if(args->length >= b->write_reference_threshold) {
+        msgpack_buffer_append_string_reference(b, rb_str_substr(args->source, args->offset, args->length));
+    } else {
+        msgpack_buffer_append(b, RSTRING_PTR(args->source) + args->offset, args->length);
+    }
+
+    int r = msgpack_unpacker_read(uk, 0);
+    if(r < 0) {
+        MessagePack_Unpacker_raise_error(uk, r);
+    }
+    return msgpack_unpacker_get_last_object(uk);
+}
+
+static VALUE Lazy_decode_ensure(VALUE unpacker)
+{
+    _msgpack_unpacker_reset(MessagePack_Unpacker_get(unpacker));
+    return Qnil;
+}
+
+static VALUE Lazy_decode(msgpack_lazy_t* lz, size_t offset, size_t length, const char* header, size_t header_length)
+{
+    VALUE unpacker = lz->unpacker;
+    msgpack_unpacker_t* uk = MessagePack_Unpacker_get(unpacker);
+    if(uk->stack.depth > 0 || msgpack_buffer_all_readable_size(UNPACKER_BUFFER_(uk)) > 0) {
+        /* reentered from an extension type proc */
+        unpacker = Lazy_unpacker_new(uk);
+    }
+
+    struct lazy_decode_args args = { unpacker, lz->source, offset, length, header, header_length };
+    return rb_ensure(Lazy_decode_protected, (VALUE)&args, Lazy_decode_ensure, unpacker);
+}
+
+static void Lazy_index(msgpack_lazy_t* lz)
+{
+    if(lz->index) {
+        return;
+    }
+
+    size_t objects = Lazy_objects(lz);
+    const char* data = RSTRING_PTR(lz->source) + lz->offset;
+    size_t* index = ALLOC_N(size_t, objects + 1);
+
+    msgpack_unpacker_scan_t scan = { 0, 0 };
+    for(size_t i = 0; i < objects; i++) {
+        index[i] = scan.offset;
+        scan.pending = 1;
+        if(msgpack_unpacker_scan(data, lz->size, &scan) != PRIMITIVE_OBJECT_COMPLETE) {
+            /* the elements were scanned when the container was read, and
+             * the source is frozen, so this is not expected to happen */
+            xfree(index);
+            MessagePack_Unpacker_raise_error(MessagePack_Unpacker_get(lz->unpacker), PRIMITIVE_INVALID_BYTE);
+        }
+    }
+    index[objects] = scan.offset;
+
+    VALUE* values = ALLOC_N(VALUE, lz->count);
+    for(uint32_t i = 0; i < lz->count; i++) {
+        values[i] = Qundef;
+    }
+
+    lz->index = index;
+    lz->values = values;
+}
+
+static void Lazy_index_keys(msgpack_lazy_t* lz)
+{
+    if(!NIL_P(lz->keys)) {
+        return;
+    }
+    Lazy_index(lz);
+
+    msgpack_unpacker_t* uk = MessagePack_Unpacker_get(lz->unpacker);
+    VALUE key_list = rb_ary_new_capa(lz->count);
+    VALUE keys = rb_hash_new();
+    for(uint32_t i = 0; i < lz->count; i++) {
+        size_t start = lz->index[i * 2];
+        VALUE key = Lazy_decode(lz, lz->offset + start, lz->index[i * 2 + 1] - start, NULL, 0);
+        if(uk->symbolize_keys && RB_TYPE_P(key, T_STRING)) {
+            key = rb_str_intern(key);
+        }
+        rb_ary_push(key_list, key);
+        rb_hash_aset(keys, key, UINT2NUM(i));
+    }
+
+    lz->key_list = key_list;
+    lz->keys = keys;
+}
+
+static VALUE Lazy_object(msgpack_lazy_t* lz, size_t offset, size_t length)
+{
+    const unsigned char* p = (const unsigned char*)RSTRING_PTR(lz->source) + offset;
+    int b = p[0];
+
+    size_t header;
+    uint32_t count;
+    if(b >= 0x80 && b <= 0x9f) {
+        header = 1;
+        count = b & 0x0f;
+    } else if(b == 0xdc || b == 0xde) {
+        header = 3;
+        count = ((uint32_t)p[1] << 8) | p[2];
+    } else if(b == 0xdd || b == 0xdf) {
+        header = 5;
+        count = ((uint32_t)p[1] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 8) | p[4];
+    } else {
+        return Lazy_decode(lz, offset, length, NULL, 0);
+    }
+
+    bool is_map = b <= 0x8f || b == 0xde || b == 0xdf;
+    return Lazy_alloc(lz->source, lz->unpacker, offset + header, length - header, count, is_map);
+}
+
+/* whether value i of a Map is read raw, once its keys are indexed */
+static bool Lazy_is_raw_value(msgpack_lazy_t* lz, uint32_t i)
+{
+    VALUE raw_keys = MessagePack_Unpacker_get(lz->unpacker)->raw_keys;
+    return raw_keys != Qnil && lz->is_map && !NIL_P(lz->key_list)
+        && rb_hash_lookup2(raw_keys, rb_ary_entry(lz->key_list, i), Qfalse) != Qfalse;
+}
+
+/* element i of an Array, or value i of a Map */
+static VALUE Lazy_element(msgpack_lazy_t* lz, uint32_t i)
+{
+    Lazy_index(lz);
+    if(lz->values[i] == Qundef) {
+        size_t n = lz->is_map ? (size_t)i * 2 + 1 : i;
+        size_t start = lz->index[n];
+        if(Lazy_is_raw_value(lz, i)) {
+            VALUE raw = rb_str_substr(lz->source, lz->offset + start, lz->index[n + 1] - start);
+            if(MessagePack_Unpacker_get(lz->unpacker)->freeze) {
+                rb_obj_freeze(raw);
+            }
+            lz->values[i] = raw;
+        } else {
+            lz->values[i] = Lazy_object(lz, lz->offset + start, lz->index[n + 1] - start);
+        }
+    }
+    return lz->values[i];
+}
+
+static VALUE Lazy_size(VALUE self)
+{
+    return UINT2NUM(Lazy_get(self)->count);
+}
+
+static VALUE Lazy_to_obj(VALUE self)
+{
+    msgpack_lazy_t* lz = Lazy_get(self);
+
+    unsigned char header[5];
+    size_t header_length;
+    if(lz->count < 16) {
+        header[0] = (lz->is_map ? 0x80 : 0x90) | lz->count;
+        header_length = 1;
+    } else if(lz->count < 65536) {
+        header[0] = lz->is_map ? 0xde : 0xdc;
+        header[1] = (unsigned char)(lz->count >> 8);
+        header[2] = (unsigned char)lz->count;
+        header_length = 3;
+    } else {
+        header[0] = lz->is_map ? 0xdf : 0xdd;
+        header[1] = (unsigned char)(lz->count >> 24);
+        header[2] = (unsigned char)(lz->count >> 16);
+        header[3] = (unsigned char)(lz->count >> 8);
+        header[4] = (unsigned char)lz->count;
+        header_length = 5;
+    }
+
+    return Lazy_decode(lz, lz->offset, lz->size, (const char*)header, header_length);
+}
+
+static VALUE LazyArray_aref(VALUE self, VALUE index)
+{
+    msgpack_lazy_t* lz = Lazy_get(self);
+    long i = NUM2LONG(index);
+    if(i < 0) {
+        i += lz->count;
+    }
+    if(i < 0 || i >= (long)lz->count) {
+        return Qnil;
+    }
+    return Lazy_element(lz, (uint32_t)i);
+}
+
+static VALUE LazyArray_each(VALUE self)
+{
+    RETURN_ENUMERATOR(self, 0, 0);
+
+    msgpack_lazy_t* lz = Lazy_get(self);
+    for(uint32_t i = 0; i < lz->count; i++) {
+        rb_yield(Lazy_element(lz, i));
+    }
+    return self;
+}
+
+static VALUE LazyMap_aref(VALUE self, VALUE key)
+{
+    msgpack_lazy_t* lz = Lazy_get(self);
+    Lazy_index_keys(lz);
+    VALUE i = rb_hash_lookup2(lz->keys, key, Qundef);
+    if(i == Qundef) {
+        return Qnil;
+    }
+    return Lazy_element(lz, NUM2UINT(i));
+}
+
+static VALUE LazyMap_key_p(VALUE self, VALUE key)
+{
+    msgpack_lazy_t* lz = Lazy_get(self);
+    Lazy_index_keys(lz);
+    return rb_hash_lookup2(lz->keys, key, Qundef) == Qundef ? Qfalse : Qtrue;
+}
+
+static VALUE LazyMap_keys(VALUE self)
+{
+    msgpack_lazy_t* lz = Lazy_get(self);
+    Lazy_index_keys(lz);
+    return rb_funcall(lz->keys, s_keys, 0);
+}
+
+static VALUE LazyMap_each(VALUE self)
+{
+    RETURN_ENUMERATOR(self, 0, 0);
+
+    msgpack_lazy_t* lz = Lazy_get(self);
+    Lazy_index_keys(lz);
+    for(uint32_t i = 0; i < lz->count; i++) {
+        VALUE key = rb_ary_entry(lz->key_list, i);
+        /* like Hash, a duplicated key only yields its last value */
+        if(NUM2UINT(rb_hash_lookup2(lz->keys, key, Qundef)) == i) {
+            rb_yield_values(2, key, Lazy_element(lz, i));
+        }
+    }
+    return self;
+}
+
+VALUE MessagePack_Lazy_new(VALUE unpacker, VALUE body, uint32_t count, bool is_map)
+{
+    rb_obj_freeze(body);
+    VALUE decoder = Lazy_unpacker_new(MessagePack_Unpacker_get(unpacker));
+    return Lazy_alloc(body, decoder, 0, RSTRING_LEN(body), count, is_map);
+}
+
+void MessagePack_Lazy_module_init(VALUE mMessagePack)
+{
+    s_keys = rb_intern("keys");
+
+    cMessagePack_LazyArray = rb_define_class_under(mMessagePack, "LazyArray", rb_cObject);
+    rb_undef_alloc_func(cMessagePack_LazyArray);
+
+    rb_define_method(cMessagePack_LazyArray, "size", Lazy_size, 0);
+    rb_define_alias(cMessagePack_LazyArray, "length", "size");
+    rb_define_method(cMessagePack_LazyArray, "[]", LazyArray_aref, 1);
+    rb_define_method(cMessagePack_LazyArray, "each", LazyArray_each, 0);
+    rb_define_method(cMessagePack_LazyArray, "to_a", Lazy_to_obj, 0);
+
+    cMessagePack_LazyMap = rb_define_class_under(mMessagePack, "LazyMap", rb_cObject);
+    rb_undef_alloc_func(cMessagePack_LazyMap);
+
+    rb_define_method(cMessagePack_LazyMap, "size", Lazy_size, 0);
+    rb_define_alias(cMessagePack_LazyMap, "length", "size");
+    rb_define_method(cMessagePack_LazyMap, "[]", LazyMap_aref, 1);
+    rb_define_method(cMessagePack_LazyMap, "key?", LazyMap_key_p, 1);
+    rb_define_alias(cMessagePack_LazyMap, "has_key?", "key?");
+    rb_define_alias(cMessagePack_LazyMap, "include?", "key?");
+    rb_define_method(cMessagePack_LazyMap, "keys", LazyMap_keys, 0);
+    rb_define_method(cMessagePack_LazyMap, "each", LazyMap_each, 0);
+    rb_define_alias(cMessagePack_LazyMap, "each_pair", "each");
+    rb_define_method(cMessagePack_LazyMap, "to_h", Lazy_to_obj, 0);
+}
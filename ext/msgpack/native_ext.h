@@ -0,0 +1,111 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+#ifndef MSGPACK_RUBY_NATIVE_EXT_H__
+#define MSGPACK_RUBY_NATIVE_EXT_H__
+
+/*
+ * C API for other extensions to pack and unpack their extension types with
+ * C functions instead of Ruby procs:
+ *
+ *     static size_t uuid_pack(VALUE object, char* dest, size_t capacity, void* data)
+ *     {
+ *         if(capacity >= 16) {
+ *             memcpy(dest, uuid_bytes(object), 16);
+ *         }
+ *         return 16;
+ *     }
+ *
+ *     static VALUE uuid_unpack(const char* payload, size_t length, void* data)
+ *     {
+ *         return uuid_new(payload, length);
+ *     }
+ *
+ *     static const msgpack_native_ext_t uuid_ext = {
+ *         MSGPACK_NATIVE_EXT_ABI_VERSION, "UUID", uuid_pack, uuid_unpack, NULL
+ *     };
+ *
+ *     rb_define_const(cUUID, "MSGPACK_EXT", msgpack_native_ext_new(&uuid_ext));
+ *
+ * and then in Ruby:
+ *
+ *     factory.register_type(0x10, UUID, packer: UUID::MSGPACK_EXT, unpacker: UUID::MSGPACK_EXT)
+ *
+ * This header only depends on ruby.h and is shipped in the ext/msgpack
+ * directory of the gem. The ABI of msgpack_native_ext_t only changes along
+ * with MSGPACK_NATIVE_EXT_ABI_VERSION.
+ */
+
+#include "ruby.h"
+
+#define MSGPACK_NATIVE_EXT_ABI_VERSION 1
+
+/*
+ * Writes the payload of object to dest if it fits in capacity bytes, and
+ * returns its size either way. When that's more than capacity, the packer
+ * calls it again with at least that much room.
+ */
+typedef size_t (*msgpack_native_ext_pack_func_t)(VALUE object, char* dest, size_t capacity, void* data);
+
+/*
+ * Returns the object of the length bytes at payload. payload points into
+ * the buffer of the unpacker and is only valid during the call.
+ */
+typedef VALUE (*msgpack_native_ext_unpack_func_t)(const char* payload, size_t length, void* data);
+
+typedef struct msgpack_native_ext_t {
+    int abi_version;  /* MSGPACK_NATIVE_EXT_ABI_VERSION */
+    const char* name;
+    msgpack_native_ext_pack_func_t pack;  /* or NULL if it's only an unpacker */
+    msgpack_native_ext_unpack_func_t unpack;  /* or NULL if it's only a packer */
+    void* data;  /* passed to pack and unpack */
+} msgpack_native_ext_t;
+
+/*
+ * Returns a frozen MessagePack::NativeExt for ext, which must outlive it.
+ * The functions of ext may run in any Ractor and may raise.
+ */
+#define MSGPACK_NATIVE_EXT_NEW_SYMBOL "MessagePack_NativeExt_new"
+
+typedef VALUE (*msgpack_native_ext_new_func_t)(const msgpack_native_ext_t* ext);
+
+#ifndef MSGPACK_NATIVE_EXT_INTERNAL
+/*
+ * The msgpack extension must be loaded first. On Ruby 3.3+, check for
+ * rb_ext_resolve_symbol with have_func("rb_ext_resolve_symbol", "ruby.h")
+ * in extconf.rb to look the function up at runtime; otherwise it's linked
+ * to directly.
+ */
+#ifdef HAVE_RB_EXT_RESOLVE_SYMBOL
+static inline VALUE msgpack_native_ext_new(const msgpack_native_ext_t* ext)
+{
+    static msgpack_native_ext_new_func_t func = NULL;
+    if(func == NULL) {
+        func = (msgpack_native_ext_new_func_t)rb_ext_resolve_symbol("msgpack/msgpack", MSGPACK_NATIVE_EXT_NEW_SYMBOL);
+        if(func == NULL) {
+            rb_raise(rb_eLoadError, "require 'msgpack' before creating a MessagePack::NativeExt");
+        }
+    }
+    return func(ext);
+}
+#else
+VALUE MessagePack_NativeExt_new(const msgpack_native_ext_t* ext);
+#define msgpack_native_ext_new MessagePack_NativeExt_new
+#endif
+#endif
+
+#endif
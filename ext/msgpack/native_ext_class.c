@@ -0,0 +1,103 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "compat.h"
+#include "ruby.h"
+#include "native_ext_class.h"
+
+VALUE cMessagePack_NativeExt;
+
+/*
+ * Wraps a msgpack_native_ext_t owned by another extension, so that its C
+ * functions can be registered with Factory#register_type.
+ */
+static size_t NativeExt_memsize(const void *ptr)
+{
+    return 0;
+}
+
+static const rb_data_type_t native_ext_data_type = {
+    .wrap_struct_name = "msgpack:native_ext",
+    .function = {
+        .dmark = NULL,
+        .dfree = NULL,
+        .dsize = NativeExt_memsize,
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+};
+
+VALUE MessagePack_NativeExt_new(const msgpack_native_ext_t* ext)
+{
+    if(ext == NULL) {
+        rb_raise(rb_eArgError, "MessagePack::NativeExt needs a msgpack_native_ext_t");
+    }
+    if(ext->abi_version != MSGPACK_NATIVE_EXT_ABI_VERSION) {
+        rb_raise(rb_eArgError, "%s was built for the MessagePack::NativeExt ABI version %d but this msgpack has version %d",
+                ext->name ? ext->name : "msgpack_native_ext_t", ext->abi_version, MSGPACK_NATIVE_EXT_ABI_VERSION);
+    }
+    if(ext->pack == NULL && ext->unpack == NULL) {
+        rb_raise(rb_eArgError, "MessagePack::NativeExt needs a pack or an unpack function");
+    }
+
+    VALUE self = TypedData_Wrap_Struct(cMessagePack_NativeExt, &native_ext_data_type, (void*)ext);
+    return rb_obj_freeze(self);
+}
+
+bool MessagePack_NativeExt_is_native_ext(VALUE v)
+{
+    return rb_typeddata_is_kind_of(v, &native_ext_data_type);
+}
+
+static inline const msgpack_native_ext_t* NativeExt_get(VALUE self)
+{
+    const msgpack_native_ext_t* ext;
+    TypedData_Get_Struct(self, const msgpack_native_ext_t, &native_ext_data_type, ext);
+    return ext;
+}
+
+static VALUE NativeExt_name(VALUE self)
+{
+    const msgpack_native_ext_t* ext = NativeExt_get(self);
+    return ext->name ? rb_str_new_cstr(ext->name) : Qnil;
+}
+
+static VALUE NativeExt_packer_p(VALUE self)
+{
+    return NativeExt_get(self)->pack ? Qtrue : Qfalse;
+}
+
+static VALUE NativeExt_unpacker_p(VALUE self)
+{
+    return NativeExt_get(self)->unpack ? Qtrue : Qfalse;
+}
+
+static VALUE NativeExt_inspect(VALUE self)
+{
+    return rb_sprintf("#<%"PRIsVALUE" %"PRIsVALUE">", rb_obj_class(self), rb_inspect(NativeExt_name(self)));
+}
+
+void MessagePack_NativeExt_module_init(VALUE mMessagePack)
+{
+    cMessagePack_NativeExt = rb_define_class_under(mMessagePack, "NativeExt", rb_cObject);
+    rb_undef_alloc_func(cMessagePack_NativeExt);
+
+    rb_define_method(cMessagePack_NativeExt, "name", NativeExt_name, 0);
+    rb_define_method(cMessagePack_NativeExt, "packer?", NativeExt_packer_p, 0);
+    rb_define_method(cMessagePack_NativeExt, "unpacker?", NativeExt_unpacker_p, 0);
+    rb_define_method(cMessagePack_NativeExt, "inspect", NativeExt_inspect, 0);
+}
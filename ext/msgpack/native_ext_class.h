@@ -0,0 +1,42 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+#ifndef MSGPACK_RUBY_NATIVE_EXT_CLASS_H__
+#define MSGPACK_RUBY_NATIVE_EXT_CLASS_H__
+
+#include "compat.h"
+#include "sysdep.h"
+
+#define MSGPACK_NATIVE_EXT_INTERNAL
+#include "native_ext.h"
+
+extern VALUE cMessagePack_NativeExt;
+
+RUBY_FUNC_EXPORTED VALUE MessagePack_NativeExt_new(const msgpack_native_ext_t* ext);
+
+bool MessagePack_NativeExt_is_native_ext(VALUE v);
+
+/* v must be a MessagePack::NativeExt */
+static inline const msgpack_native_ext_t* MessagePack_NativeExt_get(VALUE v)
+{
+    return (const msgpack_native_ext_t*)RTYPEDDATA_DATA(v);
+}
+
+void MessagePack_NativeExt_module_init(VALUE mMessagePack);
+
+#endif
+
@@ -18,6 +18,7 @@
 
 #include "packer.h"
 #include "buffer_class.h"
+#include "native_ext_class.h"
 
 #if !defined(HAVE_RB_PROC_CALL_WITH_BLOCK)
 #define rb_proc_call_with_block(recv, argc, argv, block) rb_funcallv(recv, rb_intern("call"), argc, argv)
@@ -49,7 +50,7 @@ void msgpack_packer_reset(msgpack_packer_t* pk)
 }
 
 
-void msgpack_packer_write_array_value(msgpack_packer_t* pk, VALUE v)
+static unsigned int write_array_header_of(msgpack_packer_t* pk, VALUE v)
 {
     /* actual return type of RARRAY_LEN is long */
     unsigned long len = RARRAY_LEN(v);
@@ -58,11 +59,177 @@ void msgpack_packer_write_array_value(msgpack_packer_t* pk, VALUE v)
     }
     unsigned int len32 = (unsigned int)len;
     msgpack_packer_write_array_header(pk, len32);
+    return len32;
+}
+
+static inline char* encode_double(char* p, double v)
+{
+    union {
+        double d;
+        uint64_t u64;
+    } castbuf = { v };
+    castbuf.u64 = _msgpack_be_double(castbuf.u64);
+    *p = (char)0xcb;
+    memcpy(p + 1, &castbuf.u64, 8);
+    return p + 9;
+}
+
+/* encodes v as _msgpack_packer_write_long_long64 does */
+static inline char* encode_long_long(char* p, long long v)
+{
+    uint16_t be16;
+    uint32_t be32;
+    uint64_t be64;
+    if(v >= -0x20LL && v <= 0x7fLL) {
+        *p = (char)v;
+        return p + 1;
+    }
+    if(v < 0) {
+        if(v >= -0x80LL) {
+            p[0] = (char)0xd0;
+            p[1] = (char)v;
+            return p + 2;
+        } else if(v >= -0x8000LL) {
+            be16 = _msgpack_be16((int16_t)v);
+            p[0] = (char)0xd1;
+            memcpy(p + 1, &be16, 2);
+            return p + 3;
+        } else if(v >= -0x80000000LL) {
+            be32 = _msgpack_be32((int32_t)v);
+            p[0] = (char)0xd2;
+            memcpy(p + 1, &be32, 4);
+            return p + 5;
+        }
+        be64 = _msgpack_be64((int64_t)v);
+        p[0] = (char)0xd3;
+    } else {
+        if(v <= 0xffLL) {
+            p[0] = (char)0xcc;
+            p[1] = (char)v;
+            return p + 2;
+        } else if(v <= 0xffffLL) {
+            be16 = _msgpack_be16((uint16_t)v);
+            p[0] = (char)0xcd;
+            memcpy(p + 1, &be16, 2);
+            return p + 3;
+        } else if(v <= 0xffffffffLL) {
+            be32 = _msgpack_be32((uint32_t)v);
+            p[0] = (char)0xce;
+            memcpy(p + 1, &be32, 4);
+            return p + 5;
+        }
+        be64 = _msgpack_be64((uint64_t)v);
+        p[0] = (char)0xcf;
+    }
+    memcpy(p + 1, &be64, 8);
+    return p + 9;
+}
+
+enum numeric_elements_t {
+    NUMERIC_ELEMENTS_ANY,   /* Floats as doubles and Integers as integers */
+    NUMERIC_ELEMENTS_FLOAT, /* Floats and Integers as doubles */
+    NUMERIC_ELEMENTS_INT,   /* Integers only */
+};
+
+/*
+ * Writes the Floats and Fixnums from index i of the array straight to the
+ * buffer, without a type switch nor a capacity check per element. Stops at
+ * the first other element and returns the index of it.
+ */
+static unsigned int write_numeric_elements(msgpack_packer_t* pk, VALUE v, unsigned int i, unsigned int len,
+        enum numeric_elements_t mode)
+{
+    msgpack_buffer_t* b = PACKER_BUFFER_(pk);
+
+    while(i < len) {
+        /* reserve room for the elements at their largest size, 9 bytes */
+        size_t room = msgpack_buffer_writable_size(b) / 9;
+        if(room == 0) {
+            msgpack_buffer_ensure_writable(b, 9);
+            room = msgpack_buffer_writable_size(b) / 9;
+        }
+
+        /* flushing to the IO calls io.write, which may have modified the array */
+        if(len > (unsigned long)RARRAY_LEN(v)) {
+            len = (unsigned int)RARRAY_LEN(v);
+            if(i >= len) {
+                break;
+            }
+        }
+        const VALUE* elements = RARRAY_CONST_PTR(v);
+
+        unsigned int end = len - i < room ? len : i + (unsigned int)room;
+
+        char* p = b->tail.last;
+        for(; i < end; i++) {
+            VALUE e = elements[i];
+            if(RB_FLOAT_TYPE_P(e) && mode != NUMERIC_ELEMENTS_INT) {
+                p = encode_double(p, RFLOAT_VALUE(e));
+            } else if(RB_FIXNUM_P(e)) {
+                if(mode == NUMERIC_ELEMENTS_FLOAT) {
+                    p = encode_double(p, (double)FIX2LONG(e));
+                } else {
+                    p = encode_long_long(p, FIX2LONG(e));
+                }
+            } else {
+                break;
+            }
+        }
+        b->tail.last = p;
+
+        if(i < end) {
+            break;
+        }
+    }
+
+    return i;
+}
 
-    unsigned int i;
-    for(i=0; i < len32; ++i) {
+void msgpack_packer_write_array_value(msgpack_packer_t* pk, VALUE v)
+{
+    unsigned int len32 = write_array_header_of(pk, v);
+
+    unsigned int i = 0;
+    while(i < len32) {
         VALUE e = rb_ary_entry(v, i);
-        msgpack_packer_write_value(pk, e);
+        if(RB_FLOAT_TYPE_P(e) || RB_FIXNUM_P(e)) {
+            i = write_numeric_elements(pk, v, i, len32, NUMERIC_ELEMENTS_ANY);
+        } else {
+            msgpack_packer_write_value(pk, e);
+            i++;
+        }
+    }
+}
+
+void msgpack_packer_write_float_array_value(msgpack_packer_t* pk, VALUE v)
+{
+    unsigned int len32 = write_array_header_of(pk, v);
+
+    unsigned int i = 0;
+    while(i < len32) {
+        i = write_numeric_elements(pk, v, i, len32, NUMERIC_ELEMENTS_FLOAT);
+        if(i < len32) {
+            msgpack_packer_write_float_value(pk, rb_ary_entry(v, i));
+            i++;
+        }
+    }
+}
+
+void msgpack_packer_write_int_array_value(msgpack_packer_t* pk, VALUE v)
+{
+    unsigned int len32 = write_array_header_of(pk, v);
+
+    unsigned int i = 0;
+    while(i < len32) {
+        i = write_numeric_elements(pk, v, i, len32, NUMERIC_ELEMENTS_INT);
+        if(i < len32) {
+            VALUE e = rb_ary_entry(v, i);
+            if(!RB_TYPE_P(e, T_BIGNUM)) {
+                rb_raise(rb_eTypeError, "expected Integer but found %s", rb_obj_classname(e));
+            }
+            msgpack_packer_write_bignum_value(pk, e);
+            i++;
+        }
     }
 }
 
@@ -104,6 +271,137 @@ VALUE msgpack_packer_try_calling_proc(VALUE value)
     return rb_proc_call_with_block(args->proc, 2, args->args, Qnil);
 }
 
+/* writes the smallest ext header for a payload of len bytes into dest and returns its size */
+static size_t msgpack_packer_build_ext_header(char* dest, int ext_type, size_t len)
+{
+    switch(len) {
+    case 1:
+        dest[0] = (char)0xd4;
+        break;
+    case 2:
+        dest[0] = (char)0xd5;
+        break;
+    case 4:
+        dest[0] = (char)0xd6;
+        break;
+    case 8:
+        dest[0] = (char)0xd7;
+        break;
+    case 16:
+        dest[0] = (char)0xd8;
+        break;
+    default:
+        if(len < 256) {
+            dest[0] = (char)0xc7;
+            dest[1] = (char)len;
+            dest[2] = (char)ext_type;
+            return 3;
+        } else if(len < 65536) {
+            uint16_t be = _msgpack_be16(len);
+            dest[0] = (char)0xc8;
+            memcpy(dest + 1, &be, 2);
+            dest[3] = (char)ext_type;
+            return 4;
+        } else {
+            uint32_t be = _msgpack_be32(len);
+            dest[0] = (char)0xc9;
+            memcpy(dest + 1, &be, 4);
+            dest[5] = (char)ext_type;
+            return 6;
+        }
+    }
+    dest[1] = (char)ext_type;
+    return 2;
+}
+
+/*
+ * Reserves an ext 32 header, lets the proc pack the payload right after it,
+ * then replaces it with the smallest header for the payload length.
+ */
+static void msgpack_packer_write_recursive_ext_in_place(msgpack_packer_t* pk, int ext_type, VALUE proc, VALUE v)
+{
+    msgpack_buffer_t* b = PACKER_BUFFER_(pk);
+
+    msgpack_buffer_ensure_writable(b, 6);
+    msgpack_buffer_position_t pos;
+    msgpack_buffer_get_position(b, &pos);
+    const uint32_t placeholder = 0;
+    msgpack_buffer_write_byte_and_data(b, 0xc9, (const void*)&placeholder, 4);
+    msgpack_buffer_write_1(b, ext_type);
+
+    int exception_occured = 0;
+    msgpack_call_proc_args_t args = { proc, { v, pk->to_msgpack_arg } };
+    rb_protect(msgpack_packer_try_calling_proc, (VALUE)&args, &exception_occured);
+
+    if(exception_occured) {
+        msgpack_buffer_truncate(b, &pos);
+        rb_jump_tag(exception_occured); // re-raise the exception
+    }
+
+    char* reserved = msgpack_buffer_position_pointer(b, &pos);
+    if(reserved == NULL) {
+        rb_raise(rb_eRuntimeError, "the buffer of the packer was read while packing a recursive extension");
+    }
+
+    char header[6];
+    size_t payload_size = msgpack_buffer_all_readable_size(b) - pos.size - 6;
+    size_t header_size = msgpack_packer_build_ext_header(header, ext_type, payload_size);
+    memcpy(reserved + 6 - header_size, header, header_size);
+    if(header_size < 6) {
+        msgpack_buffer_erase(b, &pos, 6 - header_size);
+    }
+}
+
+static void msgpack_packer_write_recursive_ext_by_copy(msgpack_packer_t* pk, int ext_type, VALUE proc, VALUE v)
+{
+    msgpack_buffer_t parent_buffer = pk->buffer;
+    VALUE held_buffer = MessagePack_Buffer_hold(&parent_buffer, PACKER_BUFFER_(pk));
+    msgpack_buffer_init(PACKER_BUFFER_(pk));
+
+    int exception_occured = 0;
+    msgpack_call_proc_args_t args = { proc, { v, pk->to_msgpack_arg } };
+    rb_protect(msgpack_packer_try_calling_proc, (VALUE)&args, &exception_occured);
+
+    if (exception_occured) {
+        msgpack_buffer_destroy(PACKER_BUFFER_(pk));
+        pk->buffer = parent_buffer;
+        MessagePack_Buffer_release(held_buffer);
+        rb_jump_tag(exception_occured); // re-raise the exception
+    } else {
+        VALUE payload = msgpack_buffer_all_as_string(PACKER_BUFFER_(pk));
+        StringValue(payload);
+        msgpack_buffer_destroy(PACKER_BUFFER_(pk));
+        pk->buffer = parent_buffer;
+        MessagePack_Buffer_release(held_buffer);
+        msgpack_packer_write_ext(pk, ext_type, payload);
+    }
+}
+
+/* payloads up to this size are packed on the stack rather than into a String */
+#define MSGPACK_NATIVE_EXT_STACK_SIZE 256
+
+static void msgpack_packer_write_native_ext(msgpack_packer_t* pk, int ext_type, VALUE native_ext, VALUE v)
+{
+    const msgpack_native_ext_t* ext = MessagePack_NativeExt_get(native_ext);
+    char stack_payload[MSGPACK_NATIVE_EXT_STACK_SIZE];
+
+    size_t size = ext->pack(v, stack_payload, sizeof(stack_payload), ext->data);
+    if(size <= sizeof(stack_payload)) {
+        msgpack_packer_write_ext_header(pk, ext_type, size);
+        msgpack_buffer_append(PACKER_BUFFER_(pk), stack_payload, size);
+        return;
+    }
+
+    VALUE payload = rb_str_buf_new(size);
+    size_t written = ext->pack(v, RSTRING_PTR(payload), size, ext->data);
+    if(written > size) {
+        rb_raise(rb_eRuntimeError, "%s asked for %zu bytes to pack a %"PRIsVALUE" but then wrote %zu",
+                ext->name ? ext->name : "MessagePack::NativeExt", size, rb_obj_class(v), written);
+    }
+    rb_str_set_len(payload, written);
+    msgpack_packer_write_ext(pk, ext_type, payload);
+}
+
 bool msgpack_packer_try_write_with_ext_type_lookup(msgpack_packer_t* pk, VALUE v)
 {
     int ext_type, ext_flags;
@@ -114,29 +412,17 @@ bool msgpack_packer_try_write_with_ext_type_lookup(msgpack_packer_t* pk, VALUE v
         return false;
     }
 
-    if(ext_flags & MSGPACK_EXT_RECURSIVE) {
-        VALUE held_buffer = MessagePack_Buffer_hold(&pk->buffer);
-
-        msgpack_buffer_t parent_buffer = pk->buffer;
-        msgpack_buffer_init(PACKER_BUFFER_(pk));
-
-        int exception_occured = 0;
-        msgpack_call_proc_args_t args = { proc, { v, pk->to_msgpack_arg } };
-        rb_protect(msgpack_packer_try_calling_proc, (VALUE)&args, &exception_occured);
-
-        if (exception_occured) {
-            msgpack_buffer_destroy(PACKER_BUFFER_(pk));
-            pk->buffer = parent_buffer;
-            rb_jump_tag(exception_occured); // re-raise the exception
+    if(ext_flags & MSGPACK_EXT_NATIVE_FUNC) {
+        msgpack_packer_write_native_ext(pk, ext_type, proc, v);
+    } else if(ext_flags & MSGPACK_EXT_RECURSIVE) {
+        msgpack_buffer_t* b = PACKER_BUFFER_(pk);
+        /* the header can't be patched once flushed to the IO, and the payload
+         * must not outgrow the String an exactly sized buffer writes into */
+        if(msgpack_buffer_has_io(b) || (b->tail.mapped_string != NO_MAPPED_STRING && msgpack_buffer_writable_size(b) > 0)) {
+            msgpack_packer_write_recursive_ext_by_copy(pk, ext_type, proc, v);
         } else {
-            VALUE payload = msgpack_buffer_all_as_string(PACKER_BUFFER_(pk));
-            StringValue(payload);
-            msgpack_buffer_destroy(PACKER_BUFFER_(pk));
-            pk->buffer = parent_buffer;
-            msgpack_packer_write_ext(pk, ext_type, payload);
+            msgpack_packer_write_recursive_ext_in_place(pk, ext_type, proc, v);
         }
-
-        RB_GC_GUARD(held_buffer);
     } else {
         VALUE payload = rb_proc_call_with_block(proc, 1, &v, Qnil);
         StringValue(payload);
@@ -192,8 +478,346 @@ void msgpack_packer_write_value(msgpack_packer_t* pk, VALUE v)
     case T_FLOAT:
         msgpack_packer_write_float_value(pk, v);
         break;
+    case T_DATA:
+        if(pk->has_timestamp_ext_type && rb_class_of(v) == rb_cTime) {
+            msgpack_packer_write_time_value(pk, v);
+        } else {
+            msgpack_packer_write_other_value(pk, v);
+        }
+        break;
     default:
         msgpack_packer_write_other_value(pk, v);
     }
 }
 
+
+static inline size_t packed_size_of_u64(uint64_t v)
+{
+    if(v <= 0x7fULL) {
+        return 1;
+    } else if(v <= 0xffULL) {
+        return 2;
+    } else if(v <= 0xffffULL) {
+        return 3;
+    } else if(v <= 0xffffffffULL) {
+        return 5;
+    }
+    return 9;
+}
+
+static inline size_t packed_size_of_long_long(long long v)
+{
+    if(v >= 0) {
+        return packed_size_of_u64((uint64_t)v);
+    } else if(v >= -0x20LL) {
+        return 1;
+    } else if(v >= -0x80LL) {
+        return 2;
+    } else if(v >= -0x8000LL) {
+        return 3;
+    } else if(v >= -0x80000000LL) {
+        return 5;
+    }
+    return 9;
+}
+
+static inline size_t packed_size_of_container_header(unsigned long n)
+{
+    return n < 16 ? 1 : n < 65536 ? 3 : 5;
+}
+
+static inline size_t packed_size_of_ext_header(unsigned long len)
+{
+    switch(len) {
+    case 1:
+    case 2:
+    case 4:
+    case 8:
+    case 16:
+        return 2;
+    default:
+        return len < 256 ? 3 : len < 65536 ? 4 : 6;
+    }
+}
+
+static size_t packed_size_of_string(msgpack_packer_t* pk, VALUE v)
+{
+    long len = RSTRING_LEN(v);
+
+    if(RB_UNLIKELY(len > 0xffffffffL)) {
+        rb_raise(rb_eArgError, "size of string is too long to pack: %lu bytes should be <= %ld", len, 0xffffffffL);
+    }
+
+    int encindex = ENCODING_GET_INLINED(v);
+    if(!pk->compatibility_mode && msgpack_packer_is_binary(v, encindex)) {
+        return (len < 256 ? 2 : len < 65536 ? 3 : 5) + len;
+    }
+    if(!pk->compatibility_mode && !msgpack_packer_is_utf8_compat_string(v, encindex)) {
+        VALUE enc = rb_enc_from_encoding(rb_utf8_encoding());
+        len = RSTRING_LEN(rb_str_encode(v, enc, 0, Qnil));
+    }
+    if(len < 32) {
+        return 1 + len;
+    } else if(len < 256 && !pk->compatibility_mode) {
+        return 2 + len;
+    }
+    return (len < 65536 ? 3 : 5) + len;
+}
+
+/*
+ * The same traversal measures v and, once its size is known, writes it. The
+ * bytes of objects packed by Ruby code are kept from the measuring pass and
+ * spliced in by the writing pass, so that the Ruby code runs only once.
+ */
+struct packed_size_ctx_t {
+    msgpack_packer_t* pk;
+    VALUE packed;  /* Array of the bytes packed by Ruby code, or Qnil */
+    long next;     /* index of the next bytes to splice in */
+    bool write;
+};
+
+static size_t packed_size_of_value(struct packed_size_ctx_t* ctx, VALUE v);
+
+struct packed_size_args_t {
+    msgpack_packer_t* pk;
+    VALUE v;
+    size_t size;
+};
+
+static VALUE write_value_with_args(VALUE value)
+{
+    struct packed_size_args_t* args = (struct packed_size_args_t*)value;
+    msgpack_packer_write_value(args->pk, args->v);
+    return Qnil;
+}
+
+static inline size_t packed_natively(struct packed_size_ctx_t* ctx, VALUE v, size_t size)
+{
+    if(ctx->write) {
+        msgpack_packer_write_value(ctx->pk, v);
+    }
+    return size;
+}
+
+/*
+ * Objects packed by Ruby code (extension types and to_msgpack) are measured
+ * by packing them into a separate buffer, as recursive extensions do.
+ */
+static size_t packed_size_by_packing(struct packed_size_ctx_t* ctx, VALUE v)
+{
+    msgpack_packer_t* pk = ctx->pk;
+
+    if(ctx->write) {
+        if(ctx->next < RARRAY_LEN(ctx->packed)) {
+            VALUE bytes = RARRAY_AREF(ctx->packed, ctx->next++);
+            msgpack_buffer_append(PACKER_BUFFER_(pk), RSTRING_PTR(bytes), RSTRING_LEN(bytes));
+            return RSTRING_LEN(bytes);
+        }
+        /* the measuring pass saw fewer objects, if Ruby code modified v */
+        msgpack_packer_write_value(pk, v);
+        return 0;
+    }
+
+    msgpack_buffer_t parent_buffer = pk->buffer;
+    VALUE held_buffer = MessagePack_Buffer_hold(&parent_buffer, PACKER_BUFFER_(pk));
+    msgpack_buffer_init(PACKER_BUFFER_(pk));
+
+    int exception_occured = 0;
+    struct packed_size_args_t args = { pk, v, 0 };
+    rb_protect(write_value_with_args, (VALUE)&args, &exception_occured);
+
+    size_t size = msgpack_buffer_all_readable_size(PACKER_BUFFER_(pk));
+    if(!exception_occured && ctx->packed != Qnil) {
+        rb_ary_push(ctx->packed, msgpack_buffer_all_as_string(PACKER_BUFFER_(pk)));
+    }
+    msgpack_buffer_destroy(PACKER_BUFFER_(pk));
+    pk->buffer = parent_buffer;
+    MessagePack_Buffer_release(held_buffer);
+
+    if(exception_occured) {
+        rb_jump_tag(exception_occured);
+    }
+
+    return size;
+}
+
+static inline bool packed_by_ext_type(msgpack_packer_t* pk, VALUE v)
+{
+    int ext_type, ext_flags;
+    return msgpack_packer_ext_registry_lookup(&pk->ext_registry, v, &ext_type, &ext_flags) != Qnil;
+}
+
+static size_t packed_size_of_bignum(struct packed_size_ctx_t* ctx, VALUE v)
+{
+    msgpack_packer_t* pk = ctx->pk;
+    int leading_zero_bits;
+    size_t required_size = rb_absint_size(v, &leading_zero_bits);
+    if(!RBIGNUM_POSITIVE_P(v) && leading_zero_bits == 0) {
+        required_size += 1;
+    }
+
+    if(required_size > 8 && pk->has_bigint_ext_type) {
+        if(pk->has_native_bigint_ext_type) {
+            size_t len = 1 + rb_absint_numwords(v, 32, NULL) * 4;
+            return packed_natively(ctx, v, packed_size_of_ext_header(len) + len);
+        }
+        if(packed_by_ext_type(pk, v)) {
+            return packed_size_by_packing(ctx, v);
+        }
+    }
+
+    if(RBIGNUM_POSITIVE_P(v)) {
+        return packed_natively(ctx, v, packed_size_of_u64(rb_big2ull(v)));
+    }
+    return packed_natively(ctx, v, packed_size_of_long_long(rb_big2ll(v)));
+}
+
+static size_t packed_size_of_time(VALUE v)
+{
+    struct timespec ts = rb_time_timespec(v);
+    int64_t sec = (int64_t)ts.tv_sec;
+    if(sec >= 0 && (uint64_t)sec <= 0x3ffffffffULL) {
+        return ts.tv_nsec == 0 && (uint64_t)sec <= 0xffffffffULL ? 6 : 10;
+    }
+    return 15;
+}
+
+struct packed_size_of_hash_args_t {
+    struct packed_size_ctx_t* ctx;
+    size_t size;
+};
+
+static int packed_size_of_hash_foreach(VALUE key, VALUE value, VALUE args_value)
+{
+    if (key == Qundef) {
+        return ST_CONTINUE;
+    }
+    struct packed_size_of_hash_args_t* args = (struct packed_size_of_hash_args_t*)args_value;
+    args->size += packed_size_of_value(args->ctx, key);
+    args->size += packed_size_of_value(args->ctx, value);
+    return ST_CONTINUE;
+}
+
+static size_t packed_size_of_value(struct packed_size_ctx_t* ctx, VALUE v)
+{
+    msgpack_packer_t* pk = ctx->pk;
+
+    switch(rb_type(v)) {
+    case T_NIL:
+    case T_TRUE:
+    case T_FALSE:
+        return packed_natively(ctx, v, 1);
+    case T_FIXNUM:
+        return packed_natively(ctx, v, packed_size_of_long_long(FIX2LONG(v)));
+    case T_SYMBOL:
+        if(pk->has_symbol_ext_type) {
+            return packed_size_by_packing(ctx, v);
+        }
+        return packed_natively(ctx, v, packed_size_of_string(pk, rb_sym2str(v)));
+    case T_STRING:
+        if(rb_class_of(v) != rb_cString && packed_by_ext_type(pk, v)) {
+            return packed_size_by_packing(ctx, v);
+        }
+        return ctx->write ? packed_natively(ctx, v, 0) : packed_size_of_string(pk, v);
+    case T_ARRAY:
+        if(rb_class_of(v) != rb_cArray && packed_by_ext_type(pk, v)) {
+            return packed_size_by_packing(ctx, v);
+        } else {
+            unsigned long len = RARRAY_LEN(v);
+            if(len > 0xffffffffUL) {
+                rb_raise(rb_eArgError, "size of array is too long to pack: %lu bytes should be <= %lu", len, 0xffffffffUL);
+            }
+            if(ctx->write) {
+                msgpack_packer_write_array_header(pk, (unsigned int)len);
+            }
+            size_t size = packed_size_of_container_header(len);
+            for(long i = 0; i < (long)len; i++) {
+                VALUE e = rb_ary_entry(v, i);
+                if(RB_FLOAT_TYPE_P(e)) {
+                    size += packed_natively(ctx, e, 9);
+                } else if(RB_FIXNUM_P(e)) {
+                    size += packed_natively(ctx, e, packed_size_of_long_long(FIX2LONG(e)));
+                } else {
+                    size += packed_size_of_value(ctx, e);
+                }
+            }
+            return size;
+        }
+    case T_HASH:
+        if(rb_class_of(v) != rb_cHash && packed_by_ext_type(pk, v)) {
+            return packed_size_by_packing(ctx, v);
+        } else {
+            unsigned long len = RHASH_SIZE(v);
+            if(len > 0xffffffffUL) {
+                rb_raise(rb_eArgError, "size of array is too long to pack: %ld bytes should be <= %lu", len, 0xffffffffUL);
+            }
+            if(ctx->write) {
+                msgpack_packer_write_map_header(pk, (unsigned int)len);
+            }
+            struct packed_size_of_hash_args_t args = { ctx, packed_size_of_container_header(len) };
+            rb_hash_foreach(v, packed_size_of_hash_foreach, (VALUE)&args);
+            return args.size;
+        }
+    case T_BIGNUM:
+        return packed_size_of_bignum(ctx, v);
+    case T_FLOAT:
+        return packed_natively(ctx, v, 9);
+    case T_DATA:
+        if(pk->has_timestamp_ext_type && rb_class_of(v) == rb_cTime) {
+            return packed_natively(ctx, v, packed_size_of_time(v));
+        }
+        return packed_size_by_packing(ctx, v);
+    default:
+        return packed_size_by_packing(ctx, v);
+    }
+}
+
+size_t msgpack_packer_packed_size(msgpack_packer_t* pk, VALUE v)
+{
+    struct packed_size_ctx_t ctx = { pk, Qnil, 0, false };
+    return packed_size_of_value(&ctx, v);
+}
+
+struct write_value_exactly_args_t {
+    struct packed_size_ctx_t ctx;
+    VALUE v;
+    size_t write_reference_threshold;
+};
+
+static VALUE write_value_exactly_body(VALUE value)
+{
+    struct write_value_exactly_args_t* args = (struct write_value_exactly_args_t*)value;
+    if(RARRAY_LEN(args->ctx.packed) == 0) {
+        /* no Ruby code packed anything, the usual writer is faster */
+        msgpack_packer_write_value(args->ctx.pk, args->v);
+    } else {
+        packed_size_of_value(&args->ctx, args->v);
+    }
+    return Qnil;
+}
+
+static VALUE restore_write_reference_threshold(VALUE value)
+{
+    struct write_value_exactly_args_t* args = (struct write_value_exactly_args_t*)value;
+    PACKER_BUFFER_(args->ctx.pk)->write_reference_threshold = args->write_reference_threshold;
+    return Qnil;
+}
+
+void msgpack_packer_write_value_exactly(msgpack_packer_t* pk, VALUE v)
+{
+    msgpack_buffer_t* b = PACKER_BUFFER_(pk);
+    if(msgpack_buffer_has_io(b) || msgpack_buffer_all_readable_size(b) > 0) {
+        msgpack_packer_write_value(pk, v);
+        return;
+    }
+
+    struct write_value_exactly_args_t args = { { pk, rb_ary_new(), 0, false }, v, b->write_reference_threshold };
+    size_t size = packed_size_of_value(&args.ctx, v);
+    msgpack_buffer_write_into_string(b, rb_str_new(NULL, size));
+
+    /* copy long strings too, rather than referring to them from new chunks */
+    args.ctx.write = true;
+    b->write_reference_threshold = SIZE_MAX;
+    rb_ensure(write_value_exactly_body, (VALUE)&args, restore_write_reference_threshold, (VALUE)&args);
+    RB_GC_GUARD(args.ctx.packed);
+}
@@ -44,6 +44,11 @@ struct msgpack_packer_t {
     bool compatibility_mode;
     bool has_bigint_ext_type;
     bool has_symbol_ext_type;
+    bool has_timestamp_ext_type;
+    bool has_native_bigint_ext_type;
+    bool exact_size;
+    int timestamp_ext_type;
+    int bigint_ext_type;
 
     /* options */
     bool comaptibility_mode;
@@ -356,9 +361,8 @@ static inline void msgpack_packer_write_map_header(msgpack_packer_t* pk, unsigne
     }
 }
 
-static inline void msgpack_packer_write_ext(msgpack_packer_t* pk, int ext_type, VALUE payload)
+static inline void msgpack_packer_write_ext_header(msgpack_packer_t* pk, int ext_type, unsigned long len)
 {
-    unsigned long len = RSTRING_LEN(payload);
     switch (len) {
     case 1:
         msgpack_buffer_ensure_writable(PACKER_BUFFER_(pk), 2);
@@ -397,9 +401,47 @@ static inline void msgpack_packer_write_ext(msgpack_packer_t* pk, int ext_type,
             msgpack_buffer_write_1(PACKER_BUFFER_(pk), ext_type);
         }
     }
+}
+
+static inline void msgpack_packer_write_ext(msgpack_packer_t* pk, int ext_type, VALUE payload)
+{
+    msgpack_packer_write_ext_header(pk, ext_type, RSTRING_LEN(payload));
     msgpack_buffer_append_string(PACKER_BUFFER_(pk), payload);
 }
 
+/*
+ * Timestamp extension type, see
+ * https://github.com/msgpack/msgpack/blob/master/spec.md#timestamp-extension-type
+ */
+static inline void msgpack_packer_write_timestamp(msgpack_packer_t* pk, int ext_type, int64_t sec, uint32_t nsec)
+{
+    if(sec >= 0 && (uint64_t)sec <= 0x3ffffffffULL) {
+        if(nsec == 0 && (uint64_t)sec <= 0xffffffffULL) {
+            /* timestamp32 (sec: uint32be) */
+            msgpack_buffer_ensure_writable(PACKER_BUFFER_(pk), 6);
+            uint32_t be = _msgpack_be32((uint32_t)sec);
+            msgpack_buffer_write_1(PACKER_BUFFER_(pk), 0xd6);
+            msgpack_buffer_write_byte_and_data(PACKER_BUFFER_(pk), ext_type, (const void*)&be, 4);
+        } else {
+            /* timestamp64 (nsec: uint30be, sec: uint34be) */
+            msgpack_buffer_ensure_writable(PACKER_BUFFER_(pk), 10);
+            uint64_t be = _msgpack_be64(((uint64_t)nsec << 34) | (uint64_t)sec);
+            msgpack_buffer_write_1(PACKER_BUFFER_(pk), 0xd7);
+            msgpack_buffer_write_byte_and_data(PACKER_BUFFER_(pk), ext_type, (const void*)&be, 8);
+        }
+    } else {
+        /* timestamp96 (nsec: uint32be, sec: int64be) */
+        msgpack_buffer_ensure_writable(PACKER_BUFFER_(pk), 15);
+        char payload[12];
+        uint32_t nsec_be = _msgpack_be32(nsec);
+        uint64_t sec_be = _msgpack_be64((uint64_t)sec);
+        memcpy(payload, &nsec_be, 4);
+        memcpy(payload + 4, &sec_be, 8);
+        msgpack_buffer_write_2(PACKER_BUFFER_(pk), 0xc7, 12);
+        msgpack_buffer_write_byte_and_data(PACKER_BUFFER_(pk), ext_type, payload, 12);
+    }
+}
+
 static inline bool msgpack_packer_is_binary(VALUE v, int encindex)
 {
     return encindex == msgpack_rb_encindex_ascii8bit;
@@ -467,6 +509,28 @@ static inline void msgpack_packer_write_fixnum_value(msgpack_packer_t* pk, VALUE
     msgpack_packer_write_long(pk, FIX2LONG(v));
 }
 
+/*
+ * Same format as MessagePack::Bigint.to_msgpack_ext: a sign byte followed by
+ * the absolute value as 32bit big endian chunks, least significant chunk first.
+ */
+static inline void msgpack_packer_write_bigint_ext(msgpack_packer_t* pk, VALUE v)
+{
+    size_t numwords = rb_absint_numwords(v, 32, NULL);
+    size_t len = 1 + numwords * 4;
+
+    if(RB_UNLIKELY(len > 0xffffffffUL)) {
+        rb_raise(rb_eArgError, "size of integer is too long to pack: %lu bytes should be <= %lu", (unsigned long)len, 0xffffffffUL);
+    }
+
+    msgpack_packer_write_ext_header(pk, pk->bigint_ext_type, len);
+    msgpack_buffer_ensure_writable(PACKER_BUFFER_(pk), len);
+
+    msgpack_buffer_write_1(PACKER_BUFFER_(pk), RBIGNUM_POSITIVE_P(v) ? 0 : 1);
+    rb_integer_pack(v, PACKER_BUFFER_(pk)->tail.last, numwords, 4, 0,
+            INTEGER_PACK_LSWORD_FIRST | INTEGER_PACK_MSBYTE_FIRST);
+    PACKER_BUFFER_(pk)->tail.last += numwords * 4;
+}
+
 static inline void msgpack_packer_write_bignum_value(msgpack_packer_t* pk, VALUE v)
 {
     int leading_zero_bits;
@@ -474,6 +538,10 @@ static inline void msgpack_packer_write_bignum_value(msgpack_packer_t* pk, VALUE
 
     if(RBIGNUM_POSITIVE_P(v)) {
         if(required_size > 8 && pk->has_bigint_ext_type) {
+            if(pk->has_native_bigint_ext_type) {
+                msgpack_packer_write_bigint_ext(pk, v);
+                return;
+            }
             if(msgpack_packer_try_write_with_ext_type_lookup(pk, v)) {
                 return;
             }
@@ -487,6 +555,10 @@ static inline void msgpack_packer_write_bignum_value(msgpack_packer_t* pk, VALUE
         }
 
         if(required_size > 8 && pk->has_bigint_ext_type) {
+            if(pk->has_native_bigint_ext_type) {
+                msgpack_packer_write_bigint_ext(pk, v);
+                return;
+            }
             if(msgpack_packer_try_write_with_ext_type_lookup(pk, v)) {
                 return;
             }
@@ -502,12 +574,33 @@ static inline void msgpack_packer_write_float_value(msgpack_packer_t* pk, VALUE
     msgpack_packer_write_double(pk, rb_num2dbl(v));
 }
 
+static inline void msgpack_packer_write_time_value(msgpack_packer_t* pk, VALUE v)
+{
+    struct timespec ts = rb_time_timespec(v);
+    msgpack_packer_write_timestamp(pk, pk->timestamp_ext_type, (int64_t)ts.tv_sec, (uint32_t)ts.tv_nsec);
+}
+
 void msgpack_packer_write_array_value(msgpack_packer_t* pk, VALUE v);
 
+/* writes an Array of Numerics as doubles */
+void msgpack_packer_write_float_array_value(msgpack_packer_t* pk, VALUE v);
+
+/* writes an Array of Integers */
+void msgpack_packer_write_int_array_value(msgpack_packer_t* pk, VALUE v);
+
 void msgpack_packer_write_hash_value(msgpack_packer_t* pk, VALUE v);
 
 void msgpack_packer_write_value(msgpack_packer_t* pk, VALUE v);
 
+/* returns the exact number of bytes v takes when packed */
+size_t msgpack_packer_packed_size(msgpack_packer_t* pk, VALUE v);
+
+/*
+ * Writes v as msgpack_packer_write_value does, but into a single String of
+ * its exact packed size if the buffer is empty and has no IO.
+ */
+void msgpack_packer_write_value_exactly(msgpack_packer_t* pk, VALUE v);
+
 
 #endif
 
@@ -22,6 +22,7 @@
 #include "packer_class.h"
 #include "buffer_class.h"
 #include "factory_class.h"
+#include "schema_class.h"
 
 VALUE cMessagePack_Packer;
 
@@ -29,6 +30,7 @@ static ID s_to_msgpack;
 static ID s_write;
 
 static VALUE sym_compatibility_mode;
+static VALUE sym_exact_size;
 
 //static VALUE s_packer_value;
 //static msgpack_packer_t* s_packer;
@@ -116,6 +118,9 @@ VALUE MessagePack_Packer_initialize(int argc, VALUE* argv, VALUE self)
 
         v = rb_hash_aref(options, sym_compatibility_mode);
         msgpack_packer_set_compat(pk, RTEST(v));
+
+        v = rb_hash_aref(options, sym_exact_size);
+        pk->exact_size = RTEST(v);
     }
 
     return self;
@@ -139,10 +144,20 @@ static VALUE Packer_buffer(VALUE self)
 static VALUE Packer_write(VALUE self, VALUE v)
 {
     msgpack_packer_t *pk = MessagePack_Packer_get(self);
-    msgpack_packer_write_value(pk, v);
+    if(pk->exact_size) {
+        msgpack_packer_write_value_exactly(pk, v);
+    } else {
+        msgpack_packer_write_value(pk, v);
+    }
     return self;
 }
 
+static VALUE Packer_packed_size(VALUE self, VALUE v)
+{
+    msgpack_packer_t *pk = MessagePack_Packer_get(self);
+    return SIZET2NUM(msgpack_packer_packed_size(pk, v));
+}
+
 static VALUE Packer_write_nil(VALUE self)
 {
     msgpack_packer_t *pk = MessagePack_Packer_get(self);
@@ -199,6 +214,22 @@ static VALUE Packer_write_array(VALUE self, VALUE obj)
     return self;
 }
 
+static VALUE Packer_write_float_array(VALUE self, VALUE obj)
+{
+    msgpack_packer_t *pk = MessagePack_Packer_get(self);
+    Check_Type(obj, T_ARRAY);
+    msgpack_packer_write_float_array_value(pk, obj);
+    return self;
+}
+
+static VALUE Packer_write_int_array(VALUE self, VALUE obj)
+{
+    msgpack_packer_t *pk = MessagePack_Packer_get(self);
+    Check_Type(obj, T_ARRAY);
+    msgpack_packer_write_int_array_value(pk, obj);
+    return self;
+}
+
 static VALUE Packer_write_hash(VALUE self, VALUE obj)
 {
     msgpack_packer_t *pk = MessagePack_Packer_get(self);
@@ -249,6 +280,13 @@ static VALUE Packer_write_extension(VALUE self, VALUE obj)
     return self;
 }
 
+static VALUE Packer_write_with_schema(VALUE self, VALUE schema, VALUE obj)
+{
+    msgpack_packer_t *pk = MessagePack_Packer_get(self);
+    MessagePack_Schema_write(pk, schema, obj);
+    return self;
+}
+
 static VALUE Packer_write_array_header(VALUE self, VALUE n)
 {
     msgpack_packer_t *pk = MessagePack_Packer_get(self);
@@ -371,6 +409,16 @@ static VALUE Packer_register_type_internal(VALUE self, VALUE rb_ext_type, VALUE
         pk->has_symbol_ext_type = true;
     }
 
+    if (ext_module == rb_cTime) {
+        /* the registered proc takes precedence over the factory's native timestamp support */
+        pk->has_timestamp_ext_type = false;
+    }
+
+    if (ext_module == rb_cInteger) {
+        /* the registered proc takes precedence over the factory's native bigint support */
+        pk->has_native_bigint_ext_type = false;
+    }
+
     return Qnil;
 }
 
@@ -398,6 +446,7 @@ void MessagePack_Packer_module_init(VALUE mMessagePack)
     s_write = rb_intern("write");
 
     sym_compatibility_mode = ID2SYM(rb_intern("compatibility_mode"));
+    sym_exact_size = ID2SYM(rb_intern("exact_size"));
     cMessagePack_Packer = rb_define_class_under(mMessagePack, "Packer", rb_cObject);
 
     rb_define_alloc_func(cMessagePack_Packer, MessagePack_Packer_alloc);
@@ -407,6 +456,7 @@ void MessagePack_Packer_module_init(VALUE mMessagePack)
     rb_define_method(cMessagePack_Packer, "buffer", Packer_buffer, 0);
     rb_define_method(cMessagePack_Packer, "write", Packer_write, 1);
     rb_define_alias(cMessagePack_Packer, "pack", "write");
+    rb_define_method(cMessagePack_Packer, "packed_size", Packer_packed_size, 1);
     rb_define_method(cMessagePack_Packer, "write_nil", Packer_write_nil, 0);
     rb_define_method(cMessagePack_Packer, "write_true", Packer_write_true, 0);
     rb_define_method(cMessagePack_Packer, "write_false", Packer_write_false, 0);
@@ -414,10 +464,13 @@ void MessagePack_Packer_module_init(VALUE mMessagePack)
     rb_define_method(cMessagePack_Packer, "write_string", Packer_write_string, 1);
     rb_define_method(cMessagePack_Packer, "write_bin", Packer_write_bin, 1);
     rb_define_method(cMessagePack_Packer, "write_array", Packer_write_array, 1);
+    rb_define_method(cMessagePack_Packer, "write_float_array", Packer_write_float_array, 1);
+    rb_define_method(cMessagePack_Packer, "write_int_array", Packer_write_int_array, 1);
     rb_define_method(cMessagePack_Packer, "write_hash", Packer_write_hash, 1);
     rb_define_method(cMessagePack_Packer, "write_symbol", Packer_write_symbol, 1);
     rb_define_method(cMessagePack_Packer, "write_int", Packer_write_int, 1);
     rb_define_method(cMessagePack_Packer, "write_extension", Packer_write_extension, 1);
+    rb_define_method(cMessagePack_Packer, "write_with_schema", Packer_write_with_schema, 2);
     rb_define_method(cMessagePack_Packer, "write_array_header", Packer_write_array_header, 1);
     rb_define_method(cMessagePack_Packer, "write_map_header", Packer_write_map_header, 1);
     rb_define_method(cMessagePack_Packer, "write_bin_header", Packer_write_bin_header, 1);
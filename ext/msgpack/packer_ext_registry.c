@@ -22,12 +22,17 @@ void msgpack_packer_ext_registry_init(VALUE owner, msgpack_packer_ext_registry_t
 {
     RB_OBJ_WRITE(owner, &pkrg->hash, Qnil);
     RB_OBJ_WRITE(owner, &pkrg->cache, Qnil);
+    msgpack_packer_ext_registry_clear_inline_cache(pkrg);
 }
 
 void msgpack_packer_ext_registry_mark(msgpack_packer_ext_registry_t* pkrg)
 {
     rb_gc_mark(pkrg->hash);
     rb_gc_mark(pkrg->cache);
+    for(int i = 0; i < MSGPACK_PACKER_EXT_INLINE_CACHE_SIZE; i++) {
+        rb_gc_mark(pkrg->inline_cache[i].lookup_class);
+        rb_gc_mark(pkrg->inline_cache[i].proc);
+    }
 }
 
 void msgpack_packer_ext_registry_borrow(VALUE owner, msgpack_packer_ext_registry_t* src,
@@ -36,8 +41,14 @@ void msgpack_packer_ext_registry_borrow(VALUE owner, msgpack_packer_ext_registry
     if(RTEST(src->hash)) {
         if(rb_obj_frozen_p(src->hash)) {
             // If the type registry is frozen we can safely share it, and share the cache as well.
+            // Unless the Factory was made shareable: the cache is frozen then, and Ractors
+            // can't write to the same Hash, so each packer gets its own.
             RB_OBJ_WRITE(owner, &dst->hash, src->hash);
-            RB_OBJ_WRITE(owner, &dst->cache, src->cache);
+            if(rb_ractor_shareable_p(src->cache)) {
+                RB_OBJ_WRITE(owner, &dst->cache, rb_hash_new());
+            } else {
+                RB_OBJ_WRITE(owner, &dst->cache, src->cache);
+            }
         } else {
             RB_OBJ_WRITE(owner, &dst->hash, rb_hash_dup(src->hash));
             RB_OBJ_WRITE(owner, &dst->cache, NIL_P(src->cache) ? Qnil : rb_hash_dup(src->cache));
@@ -46,6 +57,7 @@ void msgpack_packer_ext_registry_borrow(VALUE owner, msgpack_packer_ext_registry
         RB_OBJ_WRITE(owner, &dst->hash, Qnil);
         RB_OBJ_WRITE(owner, &dst->cache, Qnil);
     }
+    msgpack_packer_ext_registry_clear_inline_cache(dst);
 }
 
 void msgpack_packer_ext_registry_dup(VALUE owner, msgpack_packer_ext_registry_t* src,
@@ -53,6 +65,7 @@ void msgpack_packer_ext_registry_dup(VALUE owner, msgpack_packer_ext_registry_t*
 {
     RB_OBJ_WRITE(owner, &dst->hash, NIL_P(src->hash) ? Qnil : rb_hash_dup(src->hash));
     RB_OBJ_WRITE(owner, &dst->cache, NIL_P(src->cache) ? Qnil : rb_hash_dup(src->cache));
+    msgpack_packer_ext_registry_clear_inline_cache(dst);
 }
 
 void msgpack_packer_ext_registry_put(VALUE owner, msgpack_packer_ext_registry_t* pkrg,
@@ -68,7 +81,90 @@ void msgpack_packer_ext_registry_put(VALUE owner, msgpack_packer_ext_registry_t*
         /* clear lookup cache not to miss added type */
         rb_hash_clear(pkrg->cache);
     }
+    msgpack_packer_ext_registry_clear_inline_cache(pkrg);
 
     VALUE entry = rb_ary_new3(3, INT2FIX(ext_type), proc, INT2FIX(flags));
     rb_hash_aset(pkrg->hash, ext_module, entry);
 }
+
+static int msgpack_packer_ext_find_superclass(VALUE key, VALUE value, VALUE arg)
+{
+    VALUE *args = (VALUE *) arg;
+    if(key == Qundef) {
+        return ST_CONTINUE;
+    }
+    if(rb_class_inherited_p(args[0], key) == Qtrue) {
+        args[1] = key;
+        return ST_STOP;
+    }
+    return ST_CONTINUE;
+}
+
+static inline VALUE msgpack_packer_ext_registry_fetch(msgpack_packer_ext_registry_t* pkrg,
+        VALUE lookup_class, int* ext_type_result, int* ext_flags_result)
+{
+    // fetch lookup_class from hash, which is a hash to register classes
+    VALUE type = rb_hash_lookup(pkrg->hash, lookup_class);
+    if(type != Qnil) {
+        *ext_type_result = FIX2INT(rb_ary_entry(type, 0));
+        *ext_flags_result = FIX2INT(rb_ary_entry(type, 2));
+        return rb_ary_entry(type, 1);
+    }
+
+    // fetch lookup_class from cache, which stores results of searching ancestors from pkrg->hash
+    if (RTEST(pkrg->cache)) {
+        VALUE type_inht = rb_hash_lookup(pkrg->cache, lookup_class);
+        if(type_inht != Qnil) {
+            *ext_type_result = FIX2INT(rb_ary_entry(type_inht, 0));
+            *ext_flags_result = FIX2INT(rb_ary_entry(type_inht, 2));
+            return rb_ary_entry(type_inht, 1);
+        }
+    }
+
+    return Qnil;
+}
+
+VALUE msgpack_packer_ext_registry_lookup_class(msgpack_packer_ext_registry_t* pkrg,
+        VALUE instance, VALUE lookup_class, int* ext_type_result, int* ext_flags_result)
+{
+    VALUE type;
+
+   /*
+    * 1. check whether singleton_class or class of this instance is registered (or resolved in past) or not.
+    */
+    type = msgpack_packer_ext_registry_fetch(pkrg, lookup_class, ext_type_result, ext_flags_result);
+    if(type != Qnil) {
+        return type;
+    }
+
+    /*
+     * 2. If the object had a singleton_class check if the real class of instance is registered
+     * (or resolved in past) or not.
+     */
+    VALUE real_class = rb_obj_class(instance);
+    if(lookup_class != real_class) {
+        type = msgpack_packer_ext_registry_fetch(pkrg, real_class, ext_type_result, ext_flags_result);
+        if(type != Qnil) {
+            return type;
+        }
+    }
+
+    /*
+     * 3. check all keys whether it is an ancestor of lookup_class, or not
+     */
+    VALUE args[2];
+    args[0] = lookup_class;
+    args[1] = Qnil;
+    rb_hash_foreach(pkrg->hash, msgpack_packer_ext_find_superclass, (VALUE) args);
+
+    VALUE superclass = args[1];
+    if(superclass != Qnil) {
+        VALUE superclass_type = rb_hash_lookup(pkrg->hash, superclass);
+        rb_hash_aset(pkrg->cache, lookup_class, superclass_type);
+        *ext_type_result = FIX2INT(rb_ary_entry(superclass_type, 0));
+        *ext_flags_result = FIX2INT(rb_ary_entry(superclass_type, 2));
+        return rb_ary_entry(superclass_type, 1);
+    }
+
+    return Qnil;
+}
@@ -22,13 +22,31 @@
 #include "ruby.h"
 
 #define MSGPACK_EXT_RECURSIVE 0b0001
+#define MSGPACK_EXT_NATIVE_FUNC 0b0100
+
+#define MSGPACK_PACKER_EXT_INLINE_CACHE_SIZE 4
 
 struct msgpack_packer_ext_registry_t;
 typedef struct msgpack_packer_ext_registry_t msgpack_packer_ext_registry_t;
 
+struct msgpack_packer_ext_entry_t;
+typedef struct msgpack_packer_ext_entry_t msgpack_packer_ext_entry_t;
+
+/* result of a lookup, proc is Qnil if lookup_class isn't packed as an ext type */
+struct msgpack_packer_ext_entry_t {
+    VALUE lookup_class;
+    VALUE proc;
+    int ext_type;
+    int flags;
+};
+
 struct msgpack_packer_ext_registry_t {
     VALUE hash;
     VALUE cache; // lookup cache for ext types inherited from a super class
+
+    // last classes looked up, emptied whenever hash changes
+    msgpack_packer_ext_entry_t inline_cache[MSGPACK_PACKER_EXT_INLINE_CACHE_SIZE];
+    unsigned int inline_cache_next;
 };
 
 void msgpack_packer_ext_registry_init(VALUE owner, msgpack_packer_ext_registry_t* pkrg);
@@ -47,94 +65,60 @@ void msgpack_packer_ext_registry_dup(VALUE owner, msgpack_packer_ext_registry_t*
 void msgpack_packer_ext_registry_put(VALUE owner, msgpack_packer_ext_registry_t* pkrg,
         VALUE ext_module, int ext_type, int flags, VALUE proc);
 
-static int msgpack_packer_ext_find_superclass(VALUE key, VALUE value, VALUE arg)
+static inline void msgpack_packer_ext_registry_clear_inline_cache(msgpack_packer_ext_registry_t* pkrg)
 {
-    VALUE *args = (VALUE *) arg;
-    if(key == Qundef) {
-        return ST_CONTINUE;
-    }
-    if(rb_class_inherited_p(args[0], key) == Qtrue) {
-        args[1] = key;
-        return ST_STOP;
-    }
-    return ST_CONTINUE;
+    memset(pkrg->inline_cache, 0, sizeof(pkrg->inline_cache));
+    pkrg->inline_cache_next = 0;
 }
 
-static inline VALUE msgpack_packer_ext_registry_fetch(msgpack_packer_ext_registry_t* pkrg,
-        VALUE lookup_class, int* ext_type_result, int* ext_flags_result)
+static inline VALUE msgpack_packer_ext_registry_cache_inline(msgpack_packer_ext_registry_t* pkrg,
+        VALUE lookup_class, VALUE proc, int* ext_type_result, int* ext_flags_result)
 {
-    // fetch lookup_class from hash, which is a hash to register classes
-    VALUE type = rb_hash_lookup(pkrg->hash, lookup_class);
-    if(type != Qnil) {
-        *ext_type_result = FIX2INT(rb_ary_entry(type, 0));
-        *ext_flags_result = FIX2INT(rb_ary_entry(type, 2));
-        return rb_ary_entry(type, 1);
-    }
-
-    // fetch lookup_class from cache, which stores results of searching ancestors from pkrg->hash
-    if (RTEST(pkrg->cache)) {
-        VALUE type_inht = rb_hash_lookup(pkrg->cache, lookup_class);
-        if(type_inht != Qnil) {
-            *ext_type_result = FIX2INT(rb_ary_entry(type_inht, 0));
-            *ext_flags_result = FIX2INT(rb_ary_entry(type_inht, 2));
-            return rb_ary_entry(type_inht, 1);
-        }
-    }
-
-    return Qnil;
+    msgpack_packer_ext_entry_t* entry = &pkrg->inline_cache[pkrg->inline_cache_next];
+    pkrg->inline_cache_next = (pkrg->inline_cache_next + 1) % MSGPACK_PACKER_EXT_INLINE_CACHE_SIZE;
+
+    entry->lookup_class = lookup_class;
+    entry->proc = proc;
+    entry->ext_type = *ext_type_result;
+    entry->flags = *ext_flags_result;
+    return proc;
 }
 
+/* looks up lookup_class, the class of instance, bypassing the inline cache */
+VALUE msgpack_packer_ext_registry_lookup_class(msgpack_packer_ext_registry_t* pkrg,
+        VALUE instance, VALUE lookup_class, int* ext_type_result, int* ext_flags_result);
+
 static inline VALUE msgpack_packer_ext_registry_lookup(msgpack_packer_ext_registry_t* pkrg,
         VALUE instance, int* ext_type_result, int* ext_flags_result)
 {
-    VALUE type;
-
     if (pkrg->hash == Qnil) { // No extensions registered
         return Qnil;
     }
 
-   /*
-    * 1. check whether singleton_class or class of this instance is registered (or resolved in past) or not.
-    *
-    * Objects of type Integer (Fixnum, Bignum), Float, Symbol and frozen
-    * `rb_class_of` returns the singleton_class if the object has one, or the "real class" otherwise.
-    */
-    VALUE lookup_class = rb_class_of(instance);
-    type = msgpack_packer_ext_registry_fetch(pkrg, lookup_class, ext_type_result, ext_flags_result);
-    if(type != Qnil) {
-        return type;
-    }
-
     /*
-     * 2. If the object had a singleton_class check if the real class of instance is registered
-     * (or resolved in past) or not.
+     * Objects of type Integer (Fixnum, Bignum), Float, Symbol and frozen
+     * `rb_class_of` returns the singleton_class if the object has one, or the "real class" otherwise.
      */
-    VALUE real_class = rb_obj_class(instance);
-    if(lookup_class != real_class) {
-        type = msgpack_packer_ext_registry_fetch(pkrg, real_class, ext_type_result, ext_flags_result);
-        if(type != Qnil) {
-            return type;
+    VALUE lookup_class = rb_class_of(instance);
+    for(int i = 0; i < MSGPACK_PACKER_EXT_INLINE_CACHE_SIZE; i++) {
+        const msgpack_packer_ext_entry_t* entry = &pkrg->inline_cache[i];
+        if(entry->lookup_class == lookup_class) {
+            *ext_type_result = entry->ext_type;
+            *ext_flags_result = entry->flags;
+            return entry->proc;
         }
     }
 
-    /*
-     * 3. check all keys whether it is an ancestor of lookup_class, or not
-     */
-    VALUE args[2];
-    args[0] = lookup_class;
-    args[1] = Qnil;
-    rb_hash_foreach(pkrg->hash, msgpack_packer_ext_find_superclass, (VALUE) args);
-
-    VALUE superclass = args[1];
-    if(superclass != Qnil) {
-        VALUE superclass_type = rb_hash_lookup(pkrg->hash, superclass);
-        rb_hash_aset(pkrg->cache, lookup_class, superclass_type);
-        *ext_type_result = FIX2INT(rb_ary_entry(superclass_type, 0));
-        *ext_flags_result = FIX2INT(rb_ary_entry(superclass_type, 2));
-        return rb_ary_entry(superclass_type, 1);
+    VALUE proc = msgpack_packer_ext_registry_lookup_class(pkrg, instance, lookup_class, ext_type_result, ext_flags_result);
+    if(proc == Qnil) {
+        /* misses aren't cached, the class could include a registered module later */
+        return proc;
     }
-
-    return Qnil;
+    if(lookup_class != rb_obj_class(instance)) {
+        /* singleton classes are seldom looked up twice */
+        return proc;
+    }
+    return msgpack_packer_ext_registry_cache_inline(pkrg, lookup_class, proc, ext_type_result, ext_flags_result);
 }
 
 #endif
@@ -0,0 +1,236 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "compat.h"
+#include "ruby.h"
+#include "payload_view_class.h"
+
+VALUE cMessagePack_PayloadView;
+
+/*
+ * A view over the payload of an extension type, passed instead of a String
+ * to the unpacker procs of the types registered with payload: :view. An
+ * Unpacker reuses its view for all the payloads, so a view is only readable
+ * while the proc it's passed to runs.
+ */
+typedef struct {
+    const char* data;
+    size_t length;
+    VALUE string;  /* String data points into, or Qnil */
+    bool open;
+    char inline_data[MSGPACK_PAYLOAD_VIEW_INLINE_SIZE];
+} msgpack_payload_view_t;
+
+static void PayloadView_mark(void *ptr)
+{
+    msgpack_payload_view_t* pv = ptr;
+    rb_gc_mark(pv->string);
+}
+
+static size_t PayloadView_memsize(const void *ptr)
+{
+    return sizeof(msgpack_payload_view_t);
+}
+
+static const rb_data_type_t payload_view_data_type = {
+    .wrap_struct_name = "msgpack:payload_view",
+    .function = {
+        .dmark = PayloadView_mark,
+        .dfree = RUBY_TYPED_DEFAULT_FREE,
+        .dsize = PayloadView_memsize,
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static inline msgpack_payload_view_t* PayloadView_get(VALUE self)
+{
+    msgpack_payload_view_t* pv;
+    TypedData_Get_Struct(self, msgpack_payload_view_t, &payload_view_data_type, pv);
+    return pv;
+}
+
+static inline msgpack_payload_view_t* PayloadView_get_open(VALUE self)
+{
+    msgpack_payload_view_t* pv = PayloadView_get(self);
+    if(!pv->open) {
+        rb_raise(rb_eRuntimeError, "payload view is only readable in the unpacker proc it's passed to");
+    }
+    return pv;
+}
+
+/* returns the size bytes at offset */
+static const char* PayloadView_at(VALUE self, VALUE offset, size_t size)
+{
+    long off = NUM2LONG(offset);
+    msgpack_payload_view_t* pv = PayloadView_get_open(self);
+    if(off < 0 || (size_t)off > pv->length || pv->length - (size_t)off < size) {
+        rb_raise(rb_eIndexError, "%lu bytes at offset %ld out of payload of %lu bytes",
+                (unsigned long)size, off, (unsigned long)pv->length);
+    }
+    return pv->data + off;
+}
+
+VALUE MessagePack_PayloadView_new(void)
+{
+    msgpack_payload_view_t* pv;
+    VALUE self = TypedData_Make_Struct(cMessagePack_PayloadView, msgpack_payload_view_t, &payload_view_data_type, pv);
+    pv->string = Qnil;
+    return self;
+}
+
+bool MessagePack_PayloadView_is_open(VALUE self)
+{
+    return PayloadView_get(self)->open;
+}
+
+char* MessagePack_PayloadView_open_inline(VALUE self, size_t length)
+{
+    msgpack_payload_view_t* pv = PayloadView_get(self);
+    pv->data = pv->inline_data;
+    pv->length = length;
+    pv->string = Qnil;
+    pv->open = true;
+    return pv->inline_data;
+}
+
+void MessagePack_PayloadView_open_string(VALUE self, VALUE string)
+{
+    msgpack_payload_view_t* pv = PayloadView_get(self);
+    pv->data = RSTRING_PTR(string);
+    pv->length = RSTRING_LEN(string);
+    pv->string = string;
+    pv->open = true;
+}
+
+void MessagePack_PayloadView_close(VALUE self)
+{
+    msgpack_payload_view_t* pv = PayloadView_get(self);
+    pv->data = NULL;
+    pv->length = 0;
+    pv->string = Qnil;
+    pv->open = false;
+}
+
+static VALUE PayloadView_bytesize(VALUE self)
+{
+    return SIZET2NUM(PayloadView_get_open(self)->length);
+}
+
+static VALUE PayloadView_to_s(VALUE self)
+{
+    msgpack_payload_view_t* pv = PayloadView_get_open(self);
+    return rb_str_new(pv->data, pv->length);
+}
+
+static VALUE PayloadView_byteslice(VALUE self, VALUE offset, VALUE length)
+{
+    long len = NUM2LONG(length);
+    if(len < 0) {
+        rb_raise(rb_eArgError, "negative length %ld", len);
+    }
+    return rb_str_new(PayloadView_at(self, offset, (size_t)len), len);
+}
+
+static VALUE PayloadView_u8(VALUE self, VALUE offset)
+{
+    return INT2FIX(*(const uint8_t*)PayloadView_at(self, offset, 1));
+}
+
+static VALUE PayloadView_i8(VALUE self, VALUE offset)
+{
+    return INT2FIX(*(const int8_t*)PayloadView_at(self, offset, 1));
+}
+
+static VALUE PayloadView_u16be(VALUE self, VALUE offset)
+{
+    uint16_t u16;
+    memcpy(&u16, PayloadView_at(self, offset, 2), 2);
+    return INT2FIX(_msgpack_be16(u16));
+}
+
+static VALUE PayloadView_i16be(VALUE self, VALUE offset)
+{
+    uint16_t u16;
+    memcpy(&u16, PayloadView_at(self, offset, 2), 2);
+    return INT2FIX((int16_t)_msgpack_be16(u16));
+}
+
+static VALUE PayloadView_u32be(VALUE self, VALUE offset)
+{
+    uint32_t u32;
+    memcpy(&u32, PayloadView_at(self, offset, 4), 4);
+    return UINT2NUM(_msgpack_be32(u32));
+}
+
+static VALUE PayloadView_i32be(VALUE self, VALUE offset)
+{
+    uint32_t u32;
+    memcpy(&u32, PayloadView_at(self, offset, 4), 4);
+    return INT2NUM((int32_t)_msgpack_be32(u32));
+}
+
+static VALUE PayloadView_u64be(VALUE self, VALUE offset)
+{
+    uint64_t u64;
+    memcpy(&u64, PayloadView_at(self, offset, 8), 8);
+    return ULL2NUM(_msgpack_be64(u64));
+}
+
+static VALUE PayloadView_i64be(VALUE self, VALUE offset)
+{
+    uint64_t u64;
+    memcpy(&u64, PayloadView_at(self, offset, 8), 8);
+    return LL2NUM((int64_t)_msgpack_be64(u64));
+}
+
+static VALUE PayloadView_f32be(VALUE self, VALUE offset)
+{
+    union { uint32_t u32; float f; } cb;
+    memcpy(&cb.u32, PayloadView_at(self, offset, 4), 4);
+    cb.u32 = _msgpack_be_float(cb.u32);
+    return rb_float_new(cb.f);
+}
+
+static VALUE PayloadView_f64be(VALUE self, VALUE offset)
+{
+    union { uint64_t u64; double d; } cb;
+    memcpy(&cb.u64, PayloadView_at(self, offset, 8), 8);
+    cb.u64 = _msgpack_be_double(cb.u64);
+    return rb_float_new(cb.d);
+}
+
+void MessagePack_PayloadView_module_init(VALUE mMessagePack)
+{
+    cMessagePack_PayloadView = rb_define_class_under(mMessagePack, "PayloadView", rb_cObject);
+    rb_undef_alloc_func(cMessagePack_PayloadView);
+
+    rb_define_method(cMessagePack_PayloadView, "bytesize", PayloadView_bytesize, 0);
+    rb_define_alias(cMessagePack_PayloadView, "size", "bytesize");
+    rb_define_method(cMessagePack_PayloadView, "to_s", PayloadView_to_s, 0);
+    rb_define_method(cMessagePack_PayloadView, "byteslice", PayloadView_byteslice, 2);
+    rb_define_method(cMessagePack_PayloadView, "u8", PayloadView_u8, 1);
+    rb_define_method(cMessagePack_PayloadView, "i8", PayloadView_i8, 1);
+    rb_define_method(cMessagePack_PayloadView, "u16be", PayloadView_u16be, 1);
+    rb_define_method(cMessagePack_PayloadView, "i16be", PayloadView_i16be, 1);
+    rb_define_method(cMessagePack_PayloadView, "u32be", PayloadView_u32be, 1);
+    rb_define_method(cMessagePack_PayloadView, "i32be", PayloadView_i32be, 1);
+    rb_define_method(cMessagePack_PayloadView, "u64be", PayloadView_u64be, 1);
+    rb_define_method(cMessagePack_PayloadView, "i64be", PayloadView_i64be, 1);
+    rb_define_method(cMessagePack_PayloadView, "f32be", PayloadView_f32be, 1);
+    rb_define_method(cMessagePack_PayloadView, "f64be", PayloadView_f64be, 1);
+}
@@ -0,0 +1,46 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+#ifndef MSGPACK_RUBY_PAYLOAD_VIEW_CLASS_H__
+#define MSGPACK_RUBY_PAYLOAD_VIEW_CLASS_H__
+
+#include "compat.h"
+#include "sysdep.h"
+
+/* payloads up to this size are copied into the view instead of a String */
+#define MSGPACK_PAYLOAD_VIEW_INLINE_SIZE 64
+
+extern VALUE cMessagePack_PayloadView;
+
+VALUE MessagePack_PayloadView_new(void);
+
+/* true while the view is passed to an unpacker proc */
+bool MessagePack_PayloadView_is_open(VALUE self);
+
+/* opens the view over length bytes, up to MSGPACK_PAYLOAD_VIEW_INLINE_SIZE,
+ * to be written to the returned pointer */
+char* MessagePack_PayloadView_open_inline(VALUE self, size_t length);
+
+/* opens the view over the bytes of string */
+void MessagePack_PayloadView_open_string(VALUE self, VALUE string);
+
+void MessagePack_PayloadView_close(VALUE self);
+
+void MessagePack_PayloadView_module_init(VALUE mMessagePack);
+
+#endif
+
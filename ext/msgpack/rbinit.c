@@ -21,9 +21,18 @@
 #include "unpacker_class.h"
 #include "factory_class.h"
 #include "extension_value_class.h"
+#include "schema_class.h"
+#include "key_dictionary_class.h"
+#include "lazy_class.h"
+#include "payload_view_class.h"
+#include "native_ext_class.h"
 
 RUBY_FUNC_EXPORTED void Init_msgpack(void)
 {
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    rb_ext_ractor_safe(true);
+#endif
+
     VALUE mMessagePack = rb_define_module("MessagePack");
 
     MessagePack_Buffer_module_init(mMessagePack);
@@ -31,5 +40,10 @@ RUBY_FUNC_EXPORTED void Init_msgpack(void)
     MessagePack_Unpacker_module_init(mMessagePack);
     MessagePack_Factory_module_init(mMessagePack);
     MessagePack_ExtensionValue_module_init(mMessagePack);
+    MessagePack_Schema_module_init(mMessagePack);
+    MessagePack_KeyDictionary_module_init(mMessagePack);
+    MessagePack_Lazy_module_init(mMessagePack);
+    MessagePack_PayloadView_module_init(mMessagePack);
+    MessagePack_NativeExt_module_init(mMessagePack);
 }
 
@@ -18,11 +18,91 @@
 
 #include "rmem.h"
 
-void msgpack_rmem_init(msgpack_rmem_t* pm)
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+static rb_ractor_local_key_t s_main_ractor_key;
+#endif
+
+#ifdef HAVE_RB_GC_ADJUST_MEMORY_USAGE
+/* chunks are allocated out of the GC's sight, which accounts the pages in use instead */
+static void* _msgpack_rmem_pages_alloc(size_t size)
+{
+    void* pages = malloc(size);
+    if(pages == NULL) {
+        rb_gc();
+        pages = malloc(size);
+        if(pages == NULL) {
+            rb_memerror();
+        }
+    }
+    return pages;
+}
+
+#define _msgpack_rmem_pages_free(pages) free(pages)
+#else
+#define _msgpack_rmem_pages_alloc(size) xmalloc(size)
+#define _msgpack_rmem_pages_free(pages) xfree(pages)
+#endif
+
+void msgpack_rmem_static_init(void)
+{
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    /* the extension is always loaded by the main Ractor */
+    s_main_ractor_key = rb_ractor_local_storage_ptr_newkey(NULL);
+    rb_ractor_local_storage_ptr_set(s_main_ractor_key, &s_main_ractor_key);
+#endif
+}
+
+msgpack_rmem_t* msgpack_rmem_for_current_ractor(msgpack_rmem_t* pm)
+{
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    if(!msgpack_rmem_main_ractor_p()) {
+        return NULL;
+    }
+#endif
+    return pm;
+}
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+bool msgpack_rmem_main_ractor_p(void)
+{
+    return rb_ractor_local_storage_ptr(s_main_ractor_key) != NULL;
+}
+
+void _msgpack_rmem_defer_free(msgpack_rmem_t* pm, void* mem)
+{
+    void* head;
+    do {
+        head = pm->deferred;
+        *(void**)mem = head;
+    } while(RUBY_ATOMIC_PTR_CAS(pm->deferred, head, mem) != head);
+}
+
+void _msgpack_rmem_free_deferred(msgpack_rmem_t* pm)
+{
+    void* mem = RUBY_ATOMIC_PTR_EXCHANGE(pm->deferred, NULL);
+    while(mem != NULL) {
+        void* next = *(void**)mem;
+        if(!msgpack_rmem_free(pm, mem)) {
+            rb_bug("Failed to free an rmem pointer, memory leak?");
+        }
+        mem = next;
+    }
+}
+#endif
+
+void msgpack_rmem_init_lazy(msgpack_rmem_t* pm, size_t page_size, unsigned int pages)
 {
     memset(pm, 0, sizeof(msgpack_rmem_t));
-    pm->head.pages = xmalloc(MSGPACK_RMEM_PAGE_SIZE * 32);
-    pm->head.mask = 0xffffffff;  /* all bit is 1 = available */
+    pm->page_size = page_size;
+    pm->chunk_size = page_size * pages;
+    pm->full_mask = 0xffffffff >> (32 - pages);
+}
+
+void msgpack_rmem_init(msgpack_rmem_t* pm)
+{
+    msgpack_rmem_init_lazy(pm, MSGPACK_RMEM_PAGE_SIZE, 32);
+    pm->head.pages = _msgpack_rmem_pages_alloc(pm->chunk_size);
+    pm->head.mask = pm->full_mask;  /* all bit is 1 = available */
 }
 
 void msgpack_rmem_destroy(msgpack_rmem_t* pm)
@@ -30,19 +110,95 @@ void msgpack_rmem_destroy(msgpack_rmem_t* pm)
     msgpack_rmem_chunk_t* c = pm->array_first;
     msgpack_rmem_chunk_t* cend = pm->array_last;
     for(; c != cend; c++) {
-        xfree(c->pages);
+        _msgpack_rmem_pages_free(c->pages);
     }
-    xfree(pm->head.pages);
+    _msgpack_rmem_pages_free(pm->head.pages);
     xfree(pm->array_first);
 }
 
+static inline size_t _msgpack_rmem_chunk_pages_in_use(const msgpack_rmem_t* pm, const msgpack_rmem_chunk_t* c)
+{
+    unsigned int used = pm->full_mask & ~c->mask;
+    size_t count = 0;
+    for(; used != 0; used &= used - 1) {
+        count++;
+    }
+    return count;
+}
+
+void msgpack_rmem_stats(const msgpack_rmem_t* pm, msgpack_rmem_stats_t* stats)
+{
+    stats->page_size = pm->page_size;
+    stats->chunks = pm->array_last - pm->array_first;
+    stats->pages_in_use = 0;
+    if(pm->head.pages != NULL) {
+        stats->chunks++;
+        stats->pages_in_use += _msgpack_rmem_chunk_pages_in_use(pm, &pm->head);
+    }
+
+    const msgpack_rmem_chunk_t* c = pm->array_first;
+    for(; c != pm->array_last; c++) {
+        stats->pages_in_use += _msgpack_rmem_chunk_pages_in_use(pm, c);
+    }
+    stats->pages = stats->chunks * (pm->chunk_size / pm->page_size);
+}
+
+size_t msgpack_rmem_trim(msgpack_rmem_t* pm)
+{
+    size_t freed = 0;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    if(pm->deferred != NULL) {
+        _msgpack_rmem_free_deferred(pm);
+    }
+#endif
+
+    msgpack_rmem_chunk_t* c = pm->array_first;
+    msgpack_rmem_chunk_t* kept = pm->array_first;
+    for(; c != pm->array_last; c++) {
+        if(c->mask == pm->full_mask) {
+            _msgpack_rmem_pages_free(c->pages);
+            freed += pm->chunk_size;
+        } else {
+            *kept++ = *c;
+        }
+    }
+    pm->array_last = kept;
+
+    if(pm->head.pages != NULL && pm->head.mask == pm->full_mask) {
+        _msgpack_rmem_pages_free(pm->head.pages);
+        freed += pm->chunk_size;
+        if(pm->array_last != pm->array_first) {
+            /* head is never empty while the array isn't */
+            pm->head = *--pm->array_last;
+        } else {
+            pm->head.pages = NULL;
+            pm->head.mask = 0;
+        }
+    }
+
+    if(pm->array_first == pm->array_last) {
+        xfree(pm->array_first);
+        pm->array_first = pm->array_last = pm->array_end = NULL;
+    }
+
+    return freed;
+}
+
 void* _msgpack_rmem_alloc2(msgpack_rmem_t* pm)
 {
+    if(pm->head.pages == NULL) {
+        /* first allocation of a lazily initialized or trimmed pool */
+        pm->head.pages = _msgpack_rmem_pages_alloc(pm->chunk_size);
+        pm->head.mask = pm->full_mask & (~1);
+        return pm->head.pages;
+    }
+
     msgpack_rmem_chunk_t* c = pm->array_first;
     msgpack_rmem_chunk_t* last = pm->array_last;
     for(; c != last; c++) {
         if(_msgpack_rmem_chunk_available(c)) {
-            void* mem = _msgpack_rmem_chunk_alloc(c);
+            void* mem = _msgpack_rmem_chunk_alloc(pm, c);
 
             /* move to head */
             msgpack_rmem_chunk_t tmp = pm->head;
@@ -68,19 +224,19 @@ void* _msgpack_rmem_alloc2(msgpack_rmem_t* pm)
     /* move head to array */
     *c = pm->head;
 
-    pm->head.pages = NULL; /* make sure we don't point to another chunk's pages in case xmalloc triggers GC */
-    pm->head.mask = 0xffffffff & (~1);  /* "& (~1)" means first chunk is already allocated */
-    pm->head.pages = xmalloc(MSGPACK_RMEM_PAGE_SIZE * 32);
+    pm->head.pages = NULL; /* make sure we don't point to another chunk's pages in case the allocation triggers GC */
+    pm->head.mask = pm->full_mask & (~1);  /* "& (~1)" means first chunk is already allocated */
+    pm->head.pages = _msgpack_rmem_pages_alloc(pm->chunk_size);
 
     return pm->head.pages;
 }
 
 void _msgpack_rmem_chunk_free(msgpack_rmem_t* pm, msgpack_rmem_chunk_t* c)
 {
-    if(pm->array_first->mask == 0xffffffff) {
+    if(pm->array_first->mask == pm->full_mask) {
         /* free and move to last */
         pm->array_last--;
-        xfree(c->pages);
+        _msgpack_rmem_pages_free(c->pages);
         *c = *pm->array_last;
         return;
     }
@@ -25,6 +25,16 @@
 #define MSGPACK_RMEM_PAGE_SIZE (4*1024)
 #endif
 
+/*
+ * Buffers use a pool per size class. Pages of class i are
+ * MSGPACK_RMEM_PAGE_SIZE << (2*i) bytes (4KB, 16KB, 64KB and 256KB),
+ * and a chunk of class i contains 32 >> i pages.
+ */
+#define MSGPACK_RMEM_CLASSES 4
+#define MSGPACK_RMEM_CLASS_PAGE_SIZE(i) (((size_t)MSGPACK_RMEM_PAGE_SIZE) << (2*(i)))
+#define MSGPACK_RMEM_CLASS_PAGES(i) (32 >> (i))
+#define MSGPACK_RMEM_MAX_PAGE_SIZE MSGPACK_RMEM_CLASS_PAGE_SIZE(MSGPACK_RMEM_CLASSES - 1)
+
 struct msgpack_rmem_t;
 typedef struct msgpack_rmem_t msgpack_rmem_t;
 
@@ -32,8 +42,8 @@ struct msgpack_rmem_chunk_t;
 typedef struct msgpack_rmem_chunk_t msgpack_rmem_chunk_t;
 
 /*
- * a chunk contains 32 pages.
- * size of each buffer is MSGPACK_RMEM_PAGE_SIZE bytes.
+ * a chunk contains up to 32 pages.
+ * size of each buffer is page_size bytes of the pool.
  */
 struct msgpack_rmem_chunk_t {
     unsigned int mask;
@@ -45,48 +55,128 @@ struct msgpack_rmem_t {
     msgpack_rmem_chunk_t* array_first;
     msgpack_rmem_chunk_t* array_last;
     msgpack_rmem_chunk_t* array_end;
+    size_t page_size;
+    size_t chunk_size;
+    unsigned int full_mask;
+    /* pages freed by other Ractors, linked through their first word */
+    void* deferred;
 };
 
 /* assert MSGPACK_RMEM_PAGE_SIZE % sysconf(_SC_PAGE_SIZE) == 0 */
 void msgpack_rmem_init(msgpack_rmem_t* pm);
 
+/*
+ * Initializes a pool of pages of page_size bytes, 1 to 32 pages per chunk.
+ * Unlike msgpack_rmem_init, the first chunk is allocated on first use.
+ */
+void msgpack_rmem_init_lazy(msgpack_rmem_t* pm, size_t page_size, unsigned int pages);
+
+void msgpack_rmem_static_init(void);
+
+/*
+ * Pools aren't thread-safe, so they are only used by the main Ractor.
+ * Returns pm in the main Ractor and NULL in others, which allocate with xmalloc instead.
+ */
+msgpack_rmem_t* msgpack_rmem_for_current_ractor(msgpack_rmem_t* pm);
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+/*
+ * Objects of the main Ractor can still be swept by the GC from another
+ * Ractor's thread, which only pushes the pages it frees to pm->deferred.
+ * The main Ractor returns them to the pool on its next allocation.
+ * Their free functions check it once with msgpack_rmem_free_deferred_p,
+ * other frees come from the main Ractor, which owns the pools.
+ */
+bool msgpack_rmem_main_ractor_p(void);
+
+void _msgpack_rmem_defer_free(msgpack_rmem_t* pm, void* mem);
+
+void _msgpack_rmem_free_deferred(msgpack_rmem_t* pm);
+#endif
+
 void msgpack_rmem_destroy(msgpack_rmem_t* pm);
 
+struct msgpack_rmem_stats_t {
+    size_t page_size;
+    size_t chunks;
+    size_t pages;
+    size_t pages_in_use;
+};
+typedef struct msgpack_rmem_stats_t msgpack_rmem_stats_t;
+
+void msgpack_rmem_stats(const msgpack_rmem_t* pm, msgpack_rmem_stats_t* stats);
+
+/*
+ * Frees the chunks none of whose pages are in use, including the first one.
+ * Returns the number of bytes freed.
+ */
+size_t msgpack_rmem_trim(msgpack_rmem_t* pm);
+
 void* _msgpack_rmem_alloc2(msgpack_rmem_t* pm);
 
 #define _msgpack_rmem_chunk_available(c) ((c)->mask != 0)
 
-static inline void* _msgpack_rmem_chunk_alloc(msgpack_rmem_chunk_t* c)
+static inline void* _msgpack_rmem_chunk_alloc(msgpack_rmem_t* pm, msgpack_rmem_chunk_t* c)
 {
     _msgpack_bsp32(pos, c->mask);
     (c)->mask &= ~(1 << pos);
-    return ((char*)(c)->pages) + (pos * (MSGPACK_RMEM_PAGE_SIZE));
+    return ((char*)(c)->pages) + (pos * pm->page_size);
 }
 
-static inline bool _msgpack_rmem_chunk_try_free(msgpack_rmem_chunk_t* c, void* mem)
+static inline bool _msgpack_rmem_chunk_try_free(msgpack_rmem_t* pm, msgpack_rmem_chunk_t* c, void* mem)
 {
     ptrdiff_t pdiff = ((char*)(mem)) - ((char*)(c)->pages);
-    if(0 <= pdiff && pdiff < MSGPACK_RMEM_PAGE_SIZE * 32) {
-        size_t pos = pdiff / MSGPACK_RMEM_PAGE_SIZE;
+    if(0 <= pdiff && (size_t)pdiff < pm->chunk_size) {
+        size_t pos = pdiff / pm->page_size;
         (c)->mask |= (1 << pos);
         return true;
     }
     return false;
 }
 
+/* the smallest class whose pages can hold size bytes, size <= MSGPACK_RMEM_MAX_PAGE_SIZE */
+static inline unsigned int msgpack_rmem_class_of(size_t size)
+{
+    unsigned int i = 0;
+    while(MSGPACK_RMEM_CLASS_PAGE_SIZE(i) < size) {
+        i++;
+    }
+    return i;
+}
+
+/* reports the pages in use to the GC as malloc()ed memory */
+static inline void _msgpack_rmem_adjust_memory_usage(ssize_t diff)
+{
+#ifdef HAVE_RB_GC_ADJUST_MEMORY_USAGE
+    rb_gc_adjust_memory_usage(diff);
+#endif
+}
+
 static inline void* msgpack_rmem_alloc(msgpack_rmem_t* pm)
 {
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    if(RB_UNLIKELY(pm->deferred != NULL)) {
+        _msgpack_rmem_free_deferred(pm);
+    }
+#endif
+
+    void* mem;
     if(_msgpack_rmem_chunk_available(&pm->head)) {
-        return _msgpack_rmem_chunk_alloc(&pm->head);
+        mem = _msgpack_rmem_chunk_alloc(pm, &pm->head);
+    } else {
+        mem = _msgpack_rmem_alloc2(pm);
     }
-    return _msgpack_rmem_alloc2(pm);
+    _msgpack_rmem_adjust_memory_usage((ssize_t)pm->page_size);
+    return mem;
 }
 
 void _msgpack_rmem_chunk_free(msgpack_rmem_t* pm, msgpack_rmem_chunk_t* c);
 
+/* returns mem to pm, from the main Ractor */
 static inline bool msgpack_rmem_free(msgpack_rmem_t* pm, void* mem)
 {
-    if(_msgpack_rmem_chunk_try_free(&pm->head, mem)) {
+    if(_msgpack_rmem_chunk_try_free(pm, &pm->head, mem)) {
+        _msgpack_rmem_adjust_memory_usage(-(ssize_t)pm->page_size);
         return true;
     }
 
@@ -94,8 +184,9 @@ static inline bool msgpack_rmem_free(msgpack_rmem_t* pm, void* mem)
     msgpack_rmem_chunk_t* c = pm->array_last - 1;
     msgpack_rmem_chunk_t* before_first = pm->array_first - 1;
     for(; c != before_first; c--) {
-        if(_msgpack_rmem_chunk_try_free(c, mem)) {
-            if(c != pm->array_first && c->mask == 0xffffffff) {
+        if(_msgpack_rmem_chunk_try_free(pm, c, mem)) {
+            _msgpack_rmem_adjust_memory_usage(-(ssize_t)pm->page_size);
+            if(c != pm->array_first && c->mask == pm->full_mask) {
                 _msgpack_rmem_chunk_free(pm, c);
             }
             return true;
@@ -104,6 +195,28 @@ static inline bool msgpack_rmem_free(msgpack_rmem_t* pm, void* mem)
     return false;
 }
 
+/* true if the pages of pm freed by the current thread have to be deferred */
+static inline bool msgpack_rmem_free_deferred_p(const msgpack_rmem_t* pm)
+{
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    return pm != NULL && !msgpack_rmem_main_ractor_p();
+#else
+    return false;
+#endif
+}
+
+/* frees mem, or defers it as told by msgpack_rmem_free_deferred_p */
+static inline bool msgpack_rmem_free_or_defer(msgpack_rmem_t* pm, void* mem, bool deferred)
+{
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    if(deferred) {
+        _msgpack_rmem_defer_free(pm, mem);
+        return true;
+    }
+#endif
+    return msgpack_rmem_free(pm, mem);
+}
+
 
 #endif
 
@@ -0,0 +1,208 @@
+/*
+ * MessagePack for Ruby
+ *
+ * Copyright (C) 2008-2015 Sadayuki Furuhashi
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "compat.h"
+#include "ruby.h"
+#include "packer.h"
+#include "packer_class.h"
+#include "factory_class.h"
+#include "schema_class.h"
+
+VALUE cMessagePack_Schema;
+
+/*
+ * A schema holds the map header and every key already encoded by the
+ * factory, so packing a record only has to copy these bytes and write
+ * the values.
+ */
+typedef struct {
+    VALUE klass;      /* Struct or Data subclass, Qnil for Hash records */
+    VALUE keys;       /* frozen Array of keys, looked up in Hash records */
+    VALUE template;   /* map header followed by every encoded key */
+    long count;
+    long *key_ends;   /* key_ends[i] is the offset right after key i in template */
+} msgpack_schema_t;
+
+static void Schema_free(void *ptr)
+{
+    msgpack_schema_t* schema = ptr;
+    if(schema == NULL) {
+        return;
+    }
+    xfree(schema->key_ends);
+    xfree(schema);
+}
+
+static void Schema_mark(void *ptr)
+{
+    msgpack_schema_t* schema = ptr;
+    rb_gc_mark(schema->klass);
+    rb_gc_mark(schema->keys);
+    rb_gc_mark(schema->template);
+}
+
+static size_t Schema_memsize(const void *ptr)
+{
+    const msgpack_schema_t* schema = ptr;
+    return sizeof(msgpack_schema_t) + sizeof(long) * schema->count;
+}
+
+static const rb_data_type_t schema_data_type = {
+    .wrap_struct_name = "msgpack:schema",
+    .function = {
+        .dmark = Schema_mark,
+        .dfree = Schema_free,
+        .dsize = Schema_memsize,
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED
+};
+
+static inline msgpack_schema_t *Schema_get(VALUE object)
+{
+    msgpack_schema_t *schema;
+    TypedData_Get_Struct(object, msgpack_schema_t, &schema_data_type, schema);
+    if (!schema || NIL_P(schema->template)) {
+        rb_raise(rb_eArgError, "Uninitialized Schema object");
+    }
+    return schema;
+}
+
+VALUE MessagePack_Schema_compile(VALUE factory, VALUE klass, VALUE keys)
+{
+    Check_Type(keys, T_ARRAY);
+    if(RARRAY_LEN(keys) > 0xffffffffL) {
+        rb_raise(rb_eArgError, "too many keys in schema: %ld", RARRAY_LEN(keys));
+    }
+
+    msgpack_schema_t *schema;
+    VALUE self = TypedData_Make_Struct(cMessagePack_Schema, msgpack_schema_t, &schema_data_type, schema);
+    schema->klass = Qnil;
+    schema->keys = Qnil;
+    schema->template = Qnil;
+
+    keys = rb_ary_freeze(rb_ary_dup(keys));
+    long count = RARRAY_LEN(keys);
+    schema->key_ends = ALLOC_N(long, count);
+
+    /* encode the keys with the factory, so registered types (e.g. Symbol) are honored */
+    VALUE packer = MessagePack_Factory_packer(0, NULL, factory);
+    msgpack_packer_t *pk = MessagePack_Packer_get(packer);
+
+    msgpack_packer_write_map_header(pk, (unsigned int)count);
+    for(long i = 0; i < count; i++) {
+        msgpack_packer_write_value(pk, rb_ary_entry(keys, i));
+        schema->key_ends[i] = (long)msgpack_buffer_all_readable_size(PACKER_BUFFER_(pk));
+    }
+
+    schema->count = count;
+    RB_OBJ_WRITE(self, &schema->klass, klass);
+    RB_OBJ_WRITE(self, &schema->keys, keys);
+    RB_OBJ_WRITE(self, &schema->template, rb_str_freeze(msgpack_buffer_all_as_string(PACKER_BUFFER_(pk))));
+    RB_GC_GUARD(packer);
+
+    return rb_obj_freeze(self);
+}
+
+static inline void Schema_write_key(msgpack_packer_t* pk, msgpack_schema_t* schema, long i)
+{
+    long start = i == 0 ? 0 : schema->key_ends[i - 1];
+    msgpack_buffer_append(PACKER_BUFFER_(pk), RSTRING_PTR(schema->template) + start, schema->key_ends[i] - start);
+}
+
+struct schema_write_hash_arg {
+    msgpack_packer_t* pk;
+    msgpack_schema_t* schema;
+    long index;
+};
+
+static int Schema_write_hash_foreach(VALUE key, VALUE value, VALUE data)
+{
+    struct schema_write_hash_arg *arg = (struct schema_write_hash_arg *)data;
+    VALUE expected = rb_ary_entry(arg->schema->keys, arg->index);
+
+    if(key != expected && !rb_eql(key, expected)) {
+        return ST_STOP;
+    }
+
+    Schema_write_key(arg->pk, arg->schema, arg->index);
+    msgpack_packer_write_value(arg->pk, value);
+
+    return ++arg->index < arg->schema->count ? ST_CONTINUE : ST_STOP;
+}
+
+void MessagePack_Schema_write(msgpack_packer_t* pk, VALUE self, VALUE object)
+{
+    msgpack_schema_t *schema = Schema_get(self);
+
+    if(NIL_P(schema->klass)) {
+        Check_Type(object, T_HASH);
+    } else if(!rb_obj_is_kind_of(object, schema->klass)) {
+        rb_raise(rb_eTypeError, "expected %"PRIsVALUE" but found %s", schema->klass, rb_obj_classname(object));
+    }
+
+    if(schema->count == 0) {
+        msgpack_buffer_append_string(PACKER_BUFFER_(pk), schema->template);
+        return;
+    }
+
+    if(!NIL_P(schema->klass)) {
+        for(long i = 0; i < schema->count; i++) {
+            Schema_write_key(pk, schema, i);
+            msgpack_packer_write_value(pk, rb_struct_aref(object, LONG2FIX(i)));
+        }
+        return;
+    }
+
+    /* Records are usually built with the keys in the schema order, so walk
+     * the Hash and only fall back to lookups from the first mismatching key,
+     * which avoids hashing every key. */
+    struct schema_write_hash_arg arg = { pk, schema, 0 };
+    rb_hash_foreach(object, Schema_write_hash_foreach, (VALUE)&arg);
+
+    for(long i = arg.index; i < schema->count; i++) {
+        Schema_write_key(pk, schema, i);
+        /* missing keys are packed as nil */
+        msgpack_packer_write_value(pk, rb_hash_lookup(object, rb_ary_entry(schema->keys, i)));
+    }
+}
+
+static VALUE Schema_keys(VALUE self)
+{
+    return Schema_get(self)->keys;
+}
+
+static VALUE Schema_size(VALUE self)
+{
+    return LONG2NUM(Schema_get(self)->count);
+}
+
+static VALUE Schema_target(VALUE self)
+{
+    msgpack_schema_t *schema = Schema_get(self);
+    return NIL_P(schema->klass) ? rb_cHash : schema->klass;
+}
+
+void MessagePack_Schema_module_init(VALUE mMessagePack)
+{
+    cMessagePack_Schema = rb_define_class_under(mMessagePack, "Schema", rb_cObject);
+    rb_undef_alloc_func(cMessagePack_Schema);
+
+    rb_define_method(cMessagePack_Schema, "keys", Schema_keys, 0);
+    rb_define_method(cMessagePack_Schema, "size", Schema_size, 0);
+    rb_define_method(cMessagePack_Schema, "target", Schema_target, 0);
+}
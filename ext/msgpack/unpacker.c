@@ -19,6 +19,8 @@
 #include "unpacker.h"
 #include "rmem.h"
 #include "extension_value_class.h"
+#include "payload_view_class.h"
+#include "native_ext_class.h"
 #include <assert.h>
 #include <limits.h>
 
@@ -91,21 +93,32 @@ void msgpack_unpacker_static_destroy(void)
     msgpack_rmem_destroy(&s_stack_rmem);
 }
 
+msgpack_rmem_t* msgpack_unpacker_stack_rmem_pool(void)
+{
+    return msgpack_rmem_for_current_ractor(&s_stack_rmem);
+}
+
 #define HEAD_BYTE_REQUIRED 0xc1
 
 static inline bool _msgpack_unpacker_stack_init(msgpack_unpacker_stack_t *stack) {
     if (!stack->data) {
         stack->capacity = MSGPACK_UNPACKER_STACK_CAPACITY;
-        stack->data = msgpack_rmem_alloc(&s_stack_rmem);
         stack->depth = 0;
-        return true;
+        if (stack->rmem) {
+            stack->data = msgpack_rmem_alloc(stack->rmem);
+            return true;
+        }
+        /* without a pool, the stack is kept until the unpacker is destroyed */
+        stack->data = ALLOC_N(msgpack_unpacker_stack_entry_t, MSGPACK_UNPACKER_STACK_CAPACITY);
     }
     return false;
 }
 
-static inline void _msgpack_unpacker_free_stack(msgpack_unpacker_stack_t* stack) {
+static inline void _msgpack_unpacker_free_stack(msgpack_unpacker_stack_t* stack, bool rmem_deferred) {
     if (stack->data) {
-        if (!msgpack_rmem_free(&s_stack_rmem, stack->data)) {
+        if (!stack->rmem) {
+            xfree(stack->data);
+        } else if (!msgpack_rmem_free_or_defer(stack->rmem, stack->data, rmem_deferred)) {
             rb_bug("Failed to free an rmem pointer, memory leak?");
         }
         stack->data = NULL;
@@ -114,21 +127,27 @@ static inline void _msgpack_unpacker_free_stack(msgpack_unpacker_stack_t* stack)
 }
 
 #define STACK_INIT(uk) bool stack_allocated = _msgpack_unpacker_stack_init(&uk->stack);
-#define STACK_FREE(uk) if (stack_allocated) { _msgpack_unpacker_free_stack(&uk->stack); }
+#define STACK_FREE(uk) if (stack_allocated) { _msgpack_unpacker_free_stack(&uk->stack, false); }
 
 void _msgpack_unpacker_init(msgpack_unpacker_t* uk)
 {
     msgpack_buffer_init(UNPACKER_BUFFER_(uk));
 
     uk->head_byte = HEAD_BYTE_REQUIRED;
+    uk->stack.rmem = msgpack_rmem_for_current_ractor(&s_stack_rmem);
 
     uk->last_object = Qnil;
     uk->reading_raw = Qnil;
+    uk->key_dictionary_ref = Qnil;
+    uk->payload_view = Qnil;
+    uk->raw_keys = Qnil;
 }
 
 void _msgpack_unpacker_destroy(msgpack_unpacker_t* uk)
 {
-    _msgpack_unpacker_free_stack(&uk->stack);
+    /* the GC may sweep the unpacker from another Ractor's thread */
+    _msgpack_unpacker_free_stack(&uk->stack, msgpack_rmem_free_deferred_p(uk->stack.rmem));
+    msgpack_key_cache_destroy(&uk->key_cache);
     msgpack_buffer_destroy(UNPACKER_BUFFER_(uk));
 }
 
@@ -146,14 +165,20 @@ void msgpack_unpacker_mark_stack(msgpack_unpacker_stack_t* stack)
 
 void msgpack_unpacker_mark_key_cache(msgpack_key_cache_t *cache)
 {
-    const VALUE *entries = &cache->entries[0];
-    rb_gc_mark_locations(entries, entries + cache->length);
+    if (cache->entries) {
+        for (uint32_t i = 0; i < cache->capacity; i++) {
+            rb_gc_mark(cache->entries[i].value);
+        }
+    }
 }
 
 void msgpack_unpacker_mark(msgpack_unpacker_t* uk)
 {
     rb_gc_mark(uk->last_object);
     rb_gc_mark(uk->reading_raw);
+    rb_gc_mark(uk->key_dictionary_ref);
+    rb_gc_mark(uk->payload_view);
+    rb_gc_mark(uk->raw_keys);
     msgpack_unpacker_mark_stack(&uk->stack);
     msgpack_unpacker_mark_key_cache(&uk->key_cache);
     /* See MessagePack_Buffer_wrap */
@@ -218,8 +243,142 @@ static inline int object_complete_symbol(msgpack_unpacker_t* uk, VALUE object)
     return PRIMITIVE_OBJECT_COMPLETE;
 }
 
+static inline int object_complete_timestamp(msgpack_unpacker_t* uk, const char* data, size_t length)
+{
+    int64_t sec;
+    uint32_t nsec;
+
+    switch(length) {
+    case 4: /* timestamp32 (sec: uint32be) */
+        {
+            uint32_t u32;
+            memcpy(&u32, data, 4);
+            sec = _msgpack_be32(u32);
+            nsec = 0;
+        }
+        break;
+    case 8: /* timestamp64 (nsec: uint30be, sec: uint34be) */
+        {
+            uint64_t u64;
+            memcpy(&u64, data, 8);
+            u64 = _msgpack_be64(u64);
+            sec = u64 & 0x3ffffffffULL;
+            nsec = (uint32_t)(u64 >> 34);
+        }
+        break;
+    case 12: /* timestamp96 (nsec: uint32be, sec: int64be) */
+        {
+            uint32_t u32;
+            uint64_t u64;
+            memcpy(&u32, data, 4);
+            memcpy(&u64, data + 4, 8);
+            nsec = _msgpack_be32(u32);
+            sec = (int64_t)_msgpack_be64(u64);
+        }
+        break;
+    default:
+        return PRIMITIVE_INVALID_EXT_PAYLOAD;
+    }
+
+#if SIZEOF_TIME_T < 8
+    if((int64_t)(time_t)sec != sec) {
+        VALUE argv[3] = { LL2NUM(sec), ULONG2NUM(nsec), ID2SYM(rb_intern("nanosecond")) };
+        return object_complete(uk, rb_funcallv(rb_cTime, rb_intern("at"), 3, argv));
+    }
+#endif
+    return object_complete(uk, rb_time_nano_new((time_t)sec, (long)nsec));
+}
+
+/*
+ * Same format as MessagePack::Bigint.from_msgpack_ext: a sign byte followed by
+ * 32bit big endian chunks, least significant chunk first.
+ */
+static inline int object_complete_bigint(msgpack_unpacker_t* uk, const char* data, size_t length)
+{
+    if(RB_UNLIKELY(length == 0)) {
+        return object_complete(uk, INT2FIX(0));
+    }
+
+    int flags = INTEGER_PACK_LSWORD_FIRST | INTEGER_PACK_MSBYTE_FIRST;
+    if(data[0] != 0) {
+        flags |= INTEGER_PACK_NEGATIVE;
+    }
+
+    /* trailing bytes that don't make up a whole chunk are ignored */
+    return object_complete(uk, rb_integer_unpack(data + 1, (length - 1) / 4, 4, 0, flags));
+}
+
+static inline VALUE msgpack_unpacker_payload_view(msgpack_unpacker_t* uk)
+{
+    if(uk->payload_view == Qnil) {
+        uk->payload_view = MessagePack_PayloadView_new();
+    } else if(MessagePack_PayloadView_is_open(uk->payload_view)) {
+        /* the proc reads another payload with the same unpacker */
+        return MessagePack_PayloadView_new();
+    }
+    return uk->payload_view;
+}
+
+static int object_complete_ext_view(msgpack_unpacker_t* uk, VALUE proc, VALUE view)
+{
+    int raised;
+    VALUE obj = protected_proc_call(proc, 1, &view, &raised);
+    MessagePack_PayloadView_close(view);
+    if (raised) {
+        uk->last_object = rb_errinfo();
+        return PRIMITIVE_RECURSIVE_RAISED;
+    }
+    return object_complete(uk, obj);
+}
+
+struct protected_native_ext_call_args {
+    const msgpack_native_ext_t* ext;
+    const char* payload;
+    size_t length;
+};
+
+static VALUE protected_native_ext_call_safe(VALUE _args) {
+    struct protected_native_ext_call_args *args = (struct protected_native_ext_call_args *)_args;
+
+    return args->ext->unpack(args->payload, args->length, args->ext->data);
+}
+
+static VALUE protected_native_ext_call(VALUE native_ext, const char* payload, size_t length, int *raised) {
+    struct protected_native_ext_call_args args = {
+      .ext = MessagePack_NativeExt_get(native_ext),
+      .payload = payload,
+      .length = length,
+    };
+    return rb_protect(protected_native_ext_call_safe, (VALUE)&args, raised);
+}
+
+static int object_complete_native_ext(msgpack_unpacker_t* uk, VALUE native_ext, const char* payload, size_t length)
+{
+    int raised;
+    VALUE obj = protected_native_ext_call(native_ext, payload, length, &raised);
+    if (raised) {
+        uk->last_object = rb_errinfo();
+        return PRIMITIVE_RECURSIVE_RAISED;
+    }
+    return object_complete(uk, obj);
+}
+
 static inline int object_complete_ext(msgpack_unpacker_t* uk, int ext_type, VALUE str)
 {
+    if (uk->optimized_bigint_ext_type && ext_type == uk->bigint_ext_type) {
+        if (RB_UNLIKELY(NIL_P(str))) {
+            return object_complete_bigint(uk, NULL, 0);
+        }
+        return object_complete_bigint(uk, RSTRING_PTR(str), RSTRING_LEN(str));
+    }
+
+    if (uk->optimized_timestamp_ext_type && ext_type == uk->timestamp_ext_type) {
+        if (RB_UNLIKELY(NIL_P(str))) {
+            return PRIMITIVE_INVALID_EXT_PAYLOAD;
+        }
+        return object_complete_timestamp(uk, RSTRING_PTR(str), RSTRING_LEN(str));
+    }
+
     if (uk->optimized_symbol_ext_type && ext_type == uk->symbol_ext_type) {
         if (RB_UNLIKELY(NIL_P(str))) { // empty extension is returned as Qnil
             return object_complete_symbol(uk, ID2SYM(rb_intern3("", 0, rb_utf8_encoding())));
@@ -230,6 +389,25 @@ static inline int object_complete_ext(msgpack_unpacker_t* uk, int ext_type, VALU
     int ext_flags;
     VALUE proc = msgpack_unpacker_ext_registry_lookup(uk->ext_registry, ext_type, &ext_flags);
 
+    if(proc != Qnil && ext_flags & MSGPACK_EXT_NATIVE_FUNC) {
+        if(str == Qnil) {
+            return object_complete_native_ext(uk, proc, "", 0);
+        }
+        int ret = object_complete_native_ext(uk, proc, RSTRING_PTR(str), RSTRING_LEN(str));
+        RB_GC_GUARD(str);
+        return ret;
+    }
+
+    if(proc != Qnil && ext_flags & MSGPACK_EXT_PAYLOAD_VIEW) {
+        VALUE view = msgpack_unpacker_payload_view(uk);
+        if(str == Qnil) {
+            MessagePack_PayloadView_open_inline(view, 0);
+        } else {
+            MessagePack_PayloadView_open_string(view, str);
+        }
+        return object_complete_ext_view(uk, proc, view);
+    }
+
     if(proc != Qnil) {
         VALUE obj;
         VALUE arg = (str == Qnil ? rb_str_buf_new(0) : str);
@@ -390,6 +568,34 @@ static inline int read_raw_body_begin(msgpack_unpacker_t* uk, int raw_type)
 
             return object_complete(uk, obj);
         }
+
+        if(proc != Qnil && ext_flags & MSGPACK_EXT_NATIVE_FUNC) {
+            /* decode straight from the buffer without allocating the payload String */
+            size_t length = uk->reading_raw_remaining;
+            if(length <= msgpack_buffer_top_readable_size(UNPACKER_BUFFER_(uk))) {
+                const char* payload = length > 0 ? UNPACKER_BUFFER_(uk)->read_buffer : "";
+                int raised;
+                VALUE obj = protected_native_ext_call(proc, payload, length, &raised);
+                _msgpack_buffer_consumed(UNPACKER_BUFFER_(uk), length);
+                uk->reading_raw_remaining = 0;
+                if (raised) {
+                    uk->last_object = rb_errinfo();
+                    return PRIMITIVE_RECURSIVE_RAISED;
+                }
+                return object_complete(uk, obj);
+            }
+        }
+
+        if(proc != Qnil && ext_flags & MSGPACK_EXT_PAYLOAD_VIEW) {
+            /* copy small payloads into the view rather than a new String */
+            size_t length = uk->reading_raw_remaining;
+            if(length <= MSGPACK_PAYLOAD_VIEW_INLINE_SIZE && length <= msgpack_buffer_all_readable_size(UNPACKER_BUFFER_(uk))) {
+                VALUE view = msgpack_unpacker_payload_view(uk);
+                msgpack_buffer_read_nonblock(UNPACKER_BUFFER_(uk), MessagePack_PayloadView_open_inline(view, length), length);
+                uk->reading_raw_remaining = 0;
+                return object_complete_ext_view(uk, proc, view);
+            }
+        }
     }
 
     /* try optimized read */
@@ -399,22 +605,40 @@ static inline int read_raw_body_begin(msgpack_unpacker_t* uk, int raw_type)
         if ((uk->optimized_symbol_ext_type && uk->symbol_ext_type == raw_type)) {
             VALUE symbol = msgpack_buffer_read_top_as_symbol(UNPACKER_BUFFER_(uk), length, raw_type != RAW_TYPE_BINARY);
             ret = object_complete_symbol(uk, symbol);
+        } else if (uk->optimized_timestamp_ext_type && uk->timestamp_ext_type == raw_type) {
+            /* decode straight from the buffer without allocating the payload String */
+            ret = object_complete_timestamp(uk, UNPACKER_BUFFER_(uk)->read_buffer, length);
+            _msgpack_buffer_consumed(UNPACKER_BUFFER_(uk), length);
+        } else if (uk->optimized_bigint_ext_type && uk->bigint_ext_type == raw_type) {
+            ret = object_complete_bigint(uk, UNPACKER_BUFFER_(uk)->read_buffer, length);
+            _msgpack_buffer_consumed(UNPACKER_BUFFER_(uk), length);
         } else if (is_reading_map_key(uk) && raw_type == RAW_TYPE_STRING) {
            /* don't use zerocopy for hash keys but get a frozen string directly
             * because rb_hash_aset freezes keys and it causes copying */
-            VALUE key;
+            VALUE key = Qundef;
+            if (uk->key_dictionary) {
+                key = msgpack_key_dictionary_lookup(uk->key_dictionary, UNPACKER_BUFFER_(uk)->read_buffer, length, uk->symbolize_keys);
+                if (key != Qundef) {
+                    _msgpack_buffer_consumed(UNPACKER_BUFFER_(uk), length);
+                }
+            }
+
             if (uk->symbolize_keys) {
-                if (uk->use_key_cache) {
-                    key = msgpack_buffer_read_top_as_interned_symbol(UNPACKER_BUFFER_(uk), &uk->key_cache, length);
-                } else {
-                    key = msgpack_buffer_read_top_as_symbol(UNPACKER_BUFFER_(uk), length, true);
+                if (key == Qundef) {
+                    if (uk->use_key_cache) {
+                        key = msgpack_buffer_read_top_as_interned_symbol(UNPACKER_BUFFER_(uk), &uk->key_cache, length);
+                    } else {
+                        key = msgpack_buffer_read_top_as_symbol(UNPACKER_BUFFER_(uk), length, true);
+                    }
                 }
                 ret = object_complete_symbol(uk, key);
             } else {
-                if (uk->use_key_cache) {
-                    key = msgpack_buffer_read_top_as_interned_string(UNPACKER_BUFFER_(uk), &uk->key_cache, length);
-                } else {
-                    key = msgpack_buffer_read_top_as_string(UNPACKER_BUFFER_(uk), length, true, true);
+                if (key == Qundef) {
+                    if (uk->use_key_cache) {
+                        key = msgpack_buffer_read_top_as_interned_string(UNPACKER_BUFFER_(uk), &uk->key_cache, length);
+                    } else {
+                        key = msgpack_buffer_read_top_as_string(UNPACKER_BUFFER_(uk), length, true, true);
+                    }
                 }
 
                 ret = object_complete(uk, key);
@@ -799,8 +1023,20 @@ int msgpack_unpacker_read(msgpack_unpacker_t* uk, size_t target_stack_depth)
 {
     STACK_INIT(uk);
 
+    const bool has_raw_keys = uk->raw_keys != Qnil;
+
     while(true) {
-        int r = read_primitive(uk);
+        int r;
+        if(RB_UNLIKELY(has_raw_keys) && !msgpack_unpacker_stack_is_empty(uk)
+                && _msgpack_unpacker_stack_entry_top(uk)->type == STACK_TYPE_MAP_RAW_VALUE) {
+            VALUE raw;
+            r = msgpack_unpacker_read_raw(uk, &raw);
+            if(r == PRIMITIVE_OBJECT_COMPLETE) {
+                object_complete(uk, raw);
+            }
+        } else {
+            r = read_primitive(uk);
+        }
         if(r < 0) {
             if (r != PRIMITIVE_EOF) {
                 // We keep the stack on EOF as the parsing may be resumed.
@@ -828,8 +1064,12 @@ int msgpack_unpacker_read(msgpack_unpacker_t* uk, size_t target_stack_depth)
             case STACK_TYPE_MAP_KEY:
                 top->key = uk->last_object;
                 top->type = STACK_TYPE_MAP_VALUE;
+                if(RB_UNLIKELY(has_raw_keys) && rb_hash_lookup2(uk->raw_keys, top->key, Qfalse) != Qfalse) {
+                    top->type = STACK_TYPE_MAP_RAW_VALUE;
+                }
                 break;
             case STACK_TYPE_MAP_VALUE:
+            case STACK_TYPE_MAP_RAW_VALUE:
                 if(uk->symbolize_keys && rb_type(top->key) == T_STRING) {
                     /* here uses rb_str_intern instead of rb_intern so that Ruby VM can GC unused symbols */
                     rb_hash_aset(top->object, rb_str_intern(top->key), uk->last_object);
@@ -985,3 +1225,999 @@ int msgpack_unpacker_skip_nil(msgpack_unpacker_t* uk)
     return 0;
 }
 
+
+static inline size_t scan_be(const unsigned char* p, int n)
+{
+    size_t v = 0;
+    for(int i = 0; i < n; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/*
+ * Describes the object starting with head byte b: the size of its length or
+ * element count field, the bytes after the header not counting the length,
+ * and how many objects each counted element holds (0 when the count is a
+ * length in bytes).
+ */
+typedef struct {
+    int count_size;
+    size_t body;
+    size_t elements;
+    size_t per_count;
+} msgpack_unpacker_head_t;
+
+static inline int scan_head_byte(int b, msgpack_unpacker_head_t* head)
+{
+    head->count_size = 0;
+    head->body = 0;
+    head->elements = 0;
+    head->per_count = 0;
+
+    if(b <= 0x7f || b >= 0xe0) {
+        /* Fixnum */
+    } else if(b >= 0xa0 && b <= 0xbf) {
+        head->body = b & 0x1f;
+    } else if(b >= 0x90 && b <= 0x9f) {
+        head->elements = b & 0x0f;
+    } else if(b >= 0x80 && b <= 0x8f) {
+        head->elements = (size_t)(b & 0x0f) * 2;
+    } else {
+        switch(b) {
+        case 0xc0:  // nil
+        case 0xc2:  // false
+        case 0xc3:  // true
+            break;
+        case 0xc4:  // bin 8
+        case 0xd9:  // str 8
+            head->count_size = 1;
+            break;
+        case 0xc5:  // bin 16
+        case 0xda:  // str 16
+            head->count_size = 2;
+            break;
+        case 0xc6:  // bin 32
+        case 0xdb:  // str 32
+            head->count_size = 4;
+            break;
+        case 0xc7:  // ext 8
+            head->count_size = 1;
+            head->body = 1;
+            break;
+        case 0xc8:  // ext 16
+            head->count_size = 2;
+            head->body = 1;
+            break;
+        case 0xc9:  // ext 32
+            head->count_size = 4;
+            head->body = 1;
+            break;
+        case 0xcc:  // unsigned int  8
+        case 0xd0:  // signed int  8
+            head->body = 1;
+            break;
+        case 0xcd:  // unsigned int 16
+        case 0xd1:  // signed int 16
+            head->body = 2;
+            break;
+        case 0xca:  // float
+        case 0xce:  // unsigned int 32
+        case 0xd2:  // signed int 32
+            head->body = 4;
+            break;
+        case 0xcb:  // double
+        case 0xcf:  // unsigned int 64
+        case 0xd3:  // signed int 64
+            head->body = 8;
+            break;
+        case 0xd4:  // fixext 1
+        case 0xd5:  // fixext 2
+        case 0xd6:  // fixext 4
+        case 0xd7:  // fixext 8
+        case 0xd8:  // fixext 16
+            head->body = 1 + ((size_t)1 << (b - 0xd4));
+            break;
+        case 0xdc:  // array 16
+            head->count_size = 2;
+            head->per_count = 1;
+            break;
+        case 0xdd:  // array 32
+            head->count_size = 4;
+            head->per_count = 1;
+            break;
+        case 0xde:  // map 16
+            head->count_size = 2;
+            head->per_count = 2;
+            break;
+        case 0xdf:  // map 32
+            head->count_size = 4;
+            head->per_count = 2;
+            break;
+        default:
+            return PRIMITIVE_INVALID_BYTE;
+        }
+    }
+    return 0;
+}
+
+/* applies the length or element count field of an object to its description */
+static inline void scan_count(msgpack_unpacker_head_t* head, const char* count)
+{
+    if(head->count_size > 0) {
+        size_t n = scan_be((const unsigned char*)count, head->count_size);
+        if(head->per_count > 0) {
+            head->elements = n * head->per_count;
+        } else {
+            head->body += n;
+        }
+    }
+}
+
+int msgpack_unpacker_scan(const char* data, size_t length, msgpack_unpacker_scan_t* scan)
+{
+    msgpack_unpacker_head_t head;
+
+    while(scan->pending > 0) {
+        size_t pos = scan->offset;
+        if(pos >= length) {
+            return PRIMITIVE_EOF;
+        }
+        size_t avail = length - pos;
+
+        if(scan_head_byte((unsigned char)data[pos], &head) < 0) {
+            return PRIMITIVE_INVALID_BYTE;
+        }
+
+        size_t header = 1 + head.count_size;
+        if(avail < header) {
+            return PRIMITIVE_EOF;
+        }
+        scan_count(&head, data + pos + 1);
+        if(avail - header < head.body) {
+            return PRIMITIVE_EOF;
+        }
+
+        scan->offset = pos + header + head.body;
+        scan->pending = scan->pending - 1 + head.elements;
+    }
+
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+typedef struct {
+    const msgpack_unpacker_segment_t* segment;
+    const msgpack_unpacker_segment_t* end;
+    size_t position;
+    size_t offset;
+} msgpack_unpacker_cursor_t;
+
+static inline int cursor_read_byte(msgpack_unpacker_cursor_t* c)
+{
+    while(c->position == c->segment->length) {
+        if(++c->segment == c->end) {
+            return -1;
+        }
+        c->position = 0;
+    }
+    c->offset++;
+    return (unsigned char)c->segment->data[c->position++];
+}
+
+static inline bool cursor_skip(msgpack_unpacker_cursor_t* c, size_t n)
+{
+    while(n > c->segment->length - c->position) {
+        n -= c->segment->length - c->position;
+        c->offset += c->segment->length - c->position;
+        if(++c->segment == c->end) {
+            return false;
+        }
+        c->position = 0;
+    }
+    c->position += n;
+    c->offset += n;
+    return true;
+}
+
+/*
+ * Moves the cursor past scan->pending objects. *taken is a head byte already
+ * read before the cursor, or -1. scan is only updated past complete object
+ * heads and bodies so that the scan can be resumed from there on EOF.
+ */
+static int cursor_scan_resume(msgpack_unpacker_cursor_t* c, msgpack_unpacker_scan_t* scan, int* taken)
+{
+    msgpack_unpacker_head_t head;
+    char count[4];
+
+    while(scan->pending > 0) {
+        int b = *taken;
+        if(b < 0 && (b = cursor_read_byte(c)) < 0) {
+            return PRIMITIVE_EOF;
+        }
+        if(scan_head_byte(b, &head) < 0) {
+            return PRIMITIVE_INVALID_BYTE;
+        }
+        for(int i = 0; i < head.count_size; i++) {
+            int n = cursor_read_byte(c);
+            if(n < 0) {
+                return PRIMITIVE_EOF;
+            }
+            count[i] = (char)n;
+        }
+        scan_count(&head, count);
+        if(!cursor_skip(c, head.body)) {
+            return PRIMITIVE_EOF;
+        }
+        *taken = -1;
+        scan->offset = c->offset;
+        scan->pending = scan->pending - 1 + head.elements;
+    }
+
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+/* moves the cursor past pending objects */
+static inline int cursor_scan(msgpack_unpacker_cursor_t* c, size_t pending)
+{
+    msgpack_unpacker_scan_t scan = { c->offset, pending };
+    int taken = -1;
+    return cursor_scan_resume(c, &scan, &taken);
+}
+
+size_t msgpack_unpacker_scan_boundaries(msgpack_unpacker_boundaries_t* scan, size_t* ranges, size_t max, int* result)
+{
+    size_t found = 0;
+    *result = PRIMITIVE_EOF;
+    if(scan->segment >= scan->segment_count) {
+        return 0;
+    }
+
+    msgpack_unpacker_cursor_t c = {
+        scan->segments + scan->segment,
+        scan->segments + scan->segment_count,
+        scan->position,
+        scan->offset,
+    };
+
+    while(found < max) {
+        int r = cursor_scan(&c, 1);
+        if(r < 0) {
+            *result = r;
+            return found;
+        }
+
+        ranges[found * 2] = scan->offset;
+        ranges[found * 2 + 1] = c.offset - scan->offset;
+        found++;
+
+        scan->segment = c.segment - scan->segments;
+        scan->position = c.position;
+        scan->offset = c.offset;
+    }
+
+    *result = PRIMITIVE_OBJECT_COMPLETE;
+    return found;
+}
+
+size_t msgpack_unpacker_buffer_segments(const msgpack_buffer_t* b, msgpack_unpacker_segment_t* segments)
+{
+    size_t count = 1;
+    const msgpack_buffer_chunk_t* c = b->head;
+    if(segments) {
+        segments[0].data = b->read_buffer;
+        segments[0].length = msgpack_buffer_top_readable_size(b);
+    }
+    while(c != &b->tail) {
+        c = c->next;
+        if(segments) {
+            segments[count].data = c->first;
+            segments[count].length = c->last - c->first;
+        }
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Finds where the pending objects end in the buffered data without consuming
+ * it, resuming from scan->offset. Returns PRIMITIVE_EOF when more data has to
+ * be buffered first.
+ */
+static int buffer_scan(const msgpack_buffer_t* b, msgpack_unpacker_scan_t* scan, int* taken)
+{
+    VALUE segments_v;
+    size_t count = msgpack_unpacker_buffer_segments(b, NULL);
+    msgpack_unpacker_segment_t* segments = ALLOCV_N(msgpack_unpacker_segment_t, segments_v, count);
+    msgpack_unpacker_buffer_segments(b, segments);
+
+    int r = PRIMITIVE_EOF;
+    msgpack_unpacker_cursor_t c = { segments, segments + count, 0, 0 };
+    if(cursor_skip(&c, scan->offset)) {
+        r = cursor_scan_resume(&c, scan, taken);
+    }
+
+    ALLOCV_END(segments_v);
+    return r;
+}
+
+/*
+ * Makes sure the whole next object is buffered, reading from the IO as needed.
+ * Nothing is consumed, so reading can be retried once more data is fed on
+ * EOF. *length is the size of the object, without the head byte if taken.
+ */
+static int buffer_next_object(msgpack_unpacker_t* uk, size_t* length)
+{
+    msgpack_buffer_t* buffer = UNPACKER_BUFFER_(uk);
+    msgpack_unpacker_scan_t scan = { 0, 1 };
+    int taken = uk->head_byte == HEAD_BYTE_REQUIRED ? -1 : (int)uk->head_byte;
+
+    while(true) {
+        int r = buffer_scan(buffer, &scan, &taken);
+        if(r == PRIMITIVE_OBJECT_COMPLETE) {
+            *length = scan.offset;
+            return r;
+        }
+        if(r != PRIMITIVE_EOF || !msgpack_buffer_has_io(buffer)) {
+            return r;
+        }
+        _msgpack_buffer_feed_from_io(buffer);
+    }
+}
+
+/* number of objects in a container whose element count follows the head byte */
+static inline size_t container_objects(int b, const char* count)
+{
+    if(b >= 0x80 && b <= 0x8f) {
+        return (size_t)(b & 0x0f) * 2;
+    } else if(b >= 0x90 && b <= 0x9f) {
+        return b & 0x0f;
+    }
+    size_t n = scan_be((const unsigned char*)count, (b == 0xdc || b == 0xde) ? 2 : 4);
+    return (b == 0xde || b == 0xdf) ? n * 2 : n;
+}
+
+int msgpack_unpacker_read_lazy_body(msgpack_unpacker_t* uk, VALUE* body, uint32_t* count, bool* is_map)
+{
+    int b = get_head_byte(uk);
+    if(b < 0) {
+        return b;
+    }
+
+    int count_size;
+    if(b >= 0x80 && b <= 0x9f) {
+        count_size = 0;
+    } else if(b == 0xdc || b == 0xde) {
+        count_size = 2;
+    } else if(b == 0xdd || b == 0xdf) {
+        count_size = 4;
+    } else {
+        /* leave the head byte to msgpack_unpacker_read */
+        return PRIMITIVE_UNEXPECTED_TYPE;
+    }
+
+    msgpack_buffer_t* buffer = UNPACKER_BUFFER_(uk);
+    size_t objects = 0;
+    size_t top = msgpack_buffer_top_readable_size(buffer);
+
+    if(top >= (size_t)count_size) {
+        /* the whole container is usually in the head chunk already */
+        objects = container_objects(b, buffer->read_buffer);
+        msgpack_unpacker_scan_t scan = { count_size, objects };
+        int r = msgpack_unpacker_scan(buffer->read_buffer, top, &scan);
+        if(r == PRIMITIVE_INVALID_BYTE) {
+            return r;
+        }
+        if(r == PRIMITIVE_OBJECT_COMPLETE) {
+            _msgpack_buffer_consumed(buffer, count_size);
+            size_t length = scan.offset - count_size;
+            if(buffer->head->mapped_string != NO_MAPPED_STRING) {
+                *body = _msgpack_buffer_refer_head_mapped_string(buffer, length);
+            } else {
+                *body = rb_str_new(buffer->read_buffer, length);
+            }
+            _msgpack_buffer_consumed(buffer, length);
+            goto complete;
+        }
+    }
+
+    /* or spread over the next chunks */
+    size_t length = 0;
+    int r = buffer_next_object(uk, &length);
+    if(r < 0) {
+        return r;
+    }
+
+    char count_bytes[4];
+    msgpack_buffer_read_nonblock(buffer, count_bytes, count_size);
+    objects = container_objects(b, count_bytes);
+    *body = rb_str_buf_new(length - count_size);
+    msgpack_buffer_read_to_string_nonblock(buffer, *body, length - count_size);
+
+complete:
+    reset_head_byte(uk);
+    *is_map = (b >= 0x80 && b <= 0x8f) || b == 0xde || b == 0xdf;
+    *count = (uint32_t)(*is_map ? objects / 2 : objects);
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+int msgpack_unpacker_read_raw(msgpack_unpacker_t* uk, VALUE* raw)
+{
+    msgpack_buffer_t* buffer = UNPACKER_BUFFER_(uk);
+
+    if(uk->head_byte == HEAD_BYTE_REQUIRED) {
+        /* the whole object is usually in the head chunk already */
+        msgpack_unpacker_scan_t scan = { 0, 1 };
+        int r = msgpack_unpacker_scan(buffer->read_buffer, msgpack_buffer_top_readable_size(buffer), &scan);
+        if(r == PRIMITIVE_INVALID_BYTE) {
+            return r;
+        }
+        if(r == PRIMITIVE_OBJECT_COMPLETE) {
+            if(buffer->head->mapped_string != NO_MAPPED_STRING && scan.offset >= buffer->read_reference_threshold) {
+                *raw = _msgpack_buffer_refer_head_mapped_string(buffer, scan.offset);
+            } else {
+                *raw = rb_str_new(buffer->read_buffer, scan.offset);
+            }
+            _msgpack_buffer_consumed(buffer, scan.offset);
+            return PRIMITIVE_OBJECT_COMPLETE;
+        }
+    }
+
+    /* or spread over the next chunks */
+    size_t length = 0;
+    int r = buffer_next_object(uk, &length);
+    if(r < 0) {
+        return r;
+    }
+
+    *raw = rb_str_buf_new(1 + length);
+    if(uk->head_byte != HEAD_BYTE_REQUIRED) {
+        /* the head byte was taken by a read that ran out of data */
+        char head = (char)uk->head_byte;
+        rb_str_buf_cat(*raw, &head, 1);
+        reset_head_byte(uk);
+    }
+    msgpack_buffer_read_to_string_nonblock(buffer, *raw, length);
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+static const size_t typed_array_width[] = { 1, 2, 4, 8, 1, 2, 4, 8, 4, 8 };
+
+#define TYPED_STORE(ctype, value) do { \
+        ctype v = (ctype)(value); \
+        memcpy(out, &v, sizeof(ctype)); \
+    } while(0)
+
+#define TYPED_STORE_INT(ctype, min, max) do { \
+        if(is_float || (is_signed ? (i < (min) || i > (max)) : u > (uint64_t)(max))) { \
+            return is_float ? PRIMITIVE_UNEXPECTED_TYPE : PRIMITIVE_OUT_OF_RANGE; \
+        } \
+        TYPED_STORE(ctype, is_signed ? i : (int64_t)u); \
+    } while(0)
+
+#define TYPED_STORE_UINT(ctype, max) do { \
+        if(is_float || (is_signed ? (i < 0 || (uint64_t)i > (max)) : u > (max))) { \
+            return is_float ? PRIMITIVE_UNEXPECTED_TYPE : PRIMITIVE_OUT_OF_RANGE; \
+        } \
+        TYPED_STORE(ctype, is_signed ? (uint64_t)i : u); \
+    } while(0)
+
+/*
+ * Converts count numbers from *data to native-endian values at out. On error,
+ * *data and *index point to the offending element.
+ */
+static int read_typed_elements(const char** data, const char* end, size_t* index, size_t count,
+        enum msgpack_typed_array_type_t type, char* out)
+{
+    const size_t width = typed_array_width[type];
+    const char* p = *data;
+    size_t n = *index;
+    int r = PRIMITIVE_OBJECT_COMPLETE;
+
+    for(; n < count; n++, out += width) {
+        /* arrays of doubles are the common case */
+        if(type == MSGPACK_TYPED_ARRAY_FLOAT64) {
+            while(n < count && end - p >= 9 && (unsigned char)*p == 0xcb) {
+                union msgpack_buffer_cast_block_t cb;
+                memcpy(&cb.u64, p + 1, 8);
+                cb.u64 = _msgpack_be_double(cb.u64);
+                memcpy(out, &cb.d, sizeof(double));
+                p += 9;
+                n++;
+                out += width;
+            }
+            if(n == count) {
+                break;
+            }
+        }
+
+        if(p >= end) {
+            r = PRIMITIVE_EOF;
+            break;
+        }
+
+        int b = (unsigned char)*p;
+        size_t size = 1;
+        bool is_float = false;
+        bool is_signed = false;
+        int64_t i = 0;
+        uint64_t u = 0;
+        double d = 0;
+
+        if(b <= 0x7f) {
+            u = b;
+        } else if(b >= 0xe0) {
+            is_signed = true;
+            i = (int8_t)b;
+        } else {
+            switch(b) {
+            case 0xca:  // float
+            case 0xce:  // unsigned int 32
+            case 0xd2:  // signed int 32
+                size = 5;
+                break;
+            case 0xcb:  // double
+            case 0xcf:  // unsigned int 64
+            case 0xd3:  // signed int 64
+                size = 9;
+                break;
+            case 0xcc:  // unsigned int  8
+            case 0xd0:  // signed int  8
+                size = 2;
+                break;
+            case 0xcd:  // unsigned int 16
+            case 0xd1:  // signed int 16
+                size = 3;
+                break;
+            default:
+                r = PRIMITIVE_UNEXPECTED_TYPE;
+                goto out;
+            }
+            if((size_t)(end - p) < size) {
+                r = PRIMITIVE_EOF;
+                break;
+            }
+
+            union msgpack_buffer_cast_block_t cb;
+            memcpy(cb.buffer, p + 1, size - 1);
+            switch(b) {
+            case 0xca:
+                cb.u32 = _msgpack_be_float(cb.u32);
+                is_float = true;
+                d = cb.f;
+                break;
+            case 0xcb:
+                cb.u64 = _msgpack_be_double(cb.u64);
+                is_float = true;
+                d = cb.d;
+                break;
+            case 0xcc:
+                u = cb.u8;
+                break;
+            case 0xcd:
+                u = _msgpack_be16(cb.u16);
+                break;
+            case 0xce:
+                u = _msgpack_be32(cb.u32);
+                break;
+            case 0xcf:
+                u = _msgpack_be64(cb.u64);
+                break;
+            case 0xd0:
+                is_signed = true;
+                i = cb.i8;
+                break;
+            case 0xd1:
+                is_signed = true;
+                i = (int16_t)_msgpack_be16(cb.u16);
+                break;
+            case 0xd2:
+                is_signed = true;
+                i = (int32_t)_msgpack_be32(cb.u32);
+                break;
+            case 0xd3:
+                is_signed = true;
+                i = (int64_t)_msgpack_be64(cb.u64);
+                break;
+            }
+        }
+
+        switch(type) {
+        case MSGPACK_TYPED_ARRAY_FLOAT64:
+            TYPED_STORE(double, is_float ? d : is_signed ? (double)i : (double)u);
+            break;
+        case MSGPACK_TYPED_ARRAY_FLOAT32:
+            TYPED_STORE(float, is_float ? d : is_signed ? (double)i : (double)u);
+            break;
+        case MSGPACK_TYPED_ARRAY_INT8:
+            TYPED_STORE_INT(int8_t, INT8_MIN, INT8_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_INT16:
+            TYPED_STORE_INT(int16_t, INT16_MIN, INT16_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_INT32:
+            TYPED_STORE_INT(int32_t, INT32_MIN, INT32_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_INT64:
+            TYPED_STORE_INT(int64_t, INT64_MIN, INT64_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_UINT8:
+            TYPED_STORE_UINT(uint8_t, UINT8_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_UINT16:
+            TYPED_STORE_UINT(uint16_t, UINT16_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_UINT32:
+            TYPED_STORE_UINT(uint32_t, UINT32_MAX);
+            break;
+        case MSGPACK_TYPED_ARRAY_UINT64:
+            TYPED_STORE_UINT(uint64_t, UINT64_MAX);
+            break;
+        }
+
+        p += size;
+    }
+
+out:
+    *data = p;
+    *index = n;
+    return r;
+}
+
+/*
+ * Converts count numbers at the cursor like read_typed_elements, one segment
+ * at a time. Elements straddling two segments are copied to a small buffer.
+ */
+static int cursor_read_typed_elements(msgpack_unpacker_cursor_t* c, size_t* index, size_t count,
+        enum msgpack_typed_array_type_t type, char* out)
+{
+    const size_t width = typed_array_width[type];
+
+    while(*index < count) {
+        const char* start = c->segment->data + c->position;
+        const char* p = start;
+        int r = read_typed_elements(&p, c->segment->data + c->segment->length, index, count, type, out + *index * width);
+        c->position += p - start;
+        c->offset += p - start;
+        if(r != PRIMITIVE_EOF) {
+            return r;
+        }
+
+        if(c->position == c->segment->length) {
+            if(c->segment + 1 == c->end) {
+                return PRIMITIVE_EOF;
+            }
+            c->segment++;
+            c->position = 0;
+            continue;
+        }
+
+        char element[9];
+        size_t length = 0;
+        msgpack_unpacker_cursor_t peek = *c;
+        while(length < sizeof(element)) {
+            int b = cursor_read_byte(&peek);
+            if(b < 0) {
+                break;
+            }
+            element[length++] = (char)b;
+        }
+        p = element;
+        r = read_typed_elements(&p, element + length, index, *index + 1, type, out + *index * width);
+        if(r != PRIMITIVE_OBJECT_COMPLETE) {
+            return r;
+        }
+        cursor_skip(c, p - element);
+    }
+
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+int msgpack_unpacker_read_typed_array(msgpack_unpacker_t* uk, enum msgpack_typed_array_type_t type, VALUE* result)
+{
+    int b = get_head_byte(uk);
+    if(b < 0) {
+        return b;
+    }
+
+    int count_size;
+    if(b >= 0x90 && b <= 0x9f) {
+        count_size = 0;
+    } else if(b == 0xdc) {
+        count_size = 2;
+    } else if(b == 0xdd) {
+        count_size = 4;
+    } else {
+        return PRIMITIVE_UNEXPECTED_TYPE;
+    }
+
+    const size_t width = typed_array_width[type];
+    msgpack_buffer_t* buffer = UNPACKER_BUFFER_(uk);
+    size_t readable = msgpack_buffer_all_readable_size(buffer);
+
+    if(readable >= (size_t)count_size) {
+        /* convert the array where it is if the buffer holds all of it */
+        VALUE segments_v;
+        size_t segment_count = msgpack_unpacker_buffer_segments(buffer, NULL);
+        msgpack_unpacker_segment_t* segments = ALLOCV_N(msgpack_unpacker_segment_t, segments_v, segment_count);
+        msgpack_unpacker_buffer_segments(buffer, segments);
+        msgpack_unpacker_cursor_t c = { segments, segments + segment_count, 0, 0 };
+
+        char count_field[4];
+        for(int i = 0; i < count_size; i++) {
+            count_field[i] = (char)cursor_read_byte(&c);
+        }
+        size_t count = container_objects(b, count_field);
+
+        int r = PRIMITIVE_EOF;
+        VALUE string = Qnil;
+        if(count <= readable - count_size) {
+            string = rb_str_new(NULL, count * width);
+            size_t index = 0;
+            r = cursor_read_typed_elements(&c, &index, count, type, RSTRING_PTR(string));
+            if(r != PRIMITIVE_OBJECT_COMPLETE && r != PRIMITIVE_EOF) {
+                /* skip the rest of the array unless it is incomplete or malformed */
+                int s = cursor_scan(&c, count - index);
+                if(s != PRIMITIVE_OBJECT_COMPLETE) {
+                    r = s;
+                }
+            }
+        }
+        ALLOCV_END(segments_v);
+
+        if(r != PRIMITIVE_EOF) {
+            if(r != PRIMITIVE_INVALID_BYTE) {
+                msgpack_buffer_skip_nonblock(buffer, c.offset);
+                reset_head_byte(uk);
+            }
+            if(r == PRIMITIVE_OBJECT_COMPLETE) {
+                *result = string;
+            }
+            return r;
+        }
+    }
+
+    /* the rest of the array has to be read from the IO */
+    VALUE body;
+    uint32_t count;
+    bool is_map;
+    int r = msgpack_unpacker_read_lazy_body(uk, &body, &count, &is_map);
+    if(r < 0) {
+        return r;
+    }
+
+    VALUE string = rb_str_new(NULL, (size_t)count * width);
+    const char* p = RSTRING_PTR(body);
+    size_t index = 0;
+    r = read_typed_elements(&p, RSTRING_END(body), &index, count, type, RSTRING_PTR(string));
+    RB_GC_GUARD(body);
+    if(r < 0) {
+        return r;
+    }
+    *result = string;
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+/* skips objects without decoding them, nor calling extension type procs */
+static int skip_objects(msgpack_unpacker_t* uk, size_t pending)
+{
+    msgpack_buffer_t* b = UNPACKER_BUFFER_(uk);
+    msgpack_unpacker_head_t head;
+
+    while(pending > 0) {
+        if(uk->head_byte == HEAD_BYTE_REQUIRED) {
+            /* objects fully in the head chunk don't need to be copied */
+            msgpack_unpacker_scan_t scan = { 0, pending };
+            int r = msgpack_unpacker_scan(b->read_buffer, msgpack_buffer_top_readable_size(b), &scan);
+            if(r == PRIMITIVE_INVALID_BYTE) {
+                return r;
+            }
+            if(scan.offset > 0) {
+                _msgpack_buffer_consumed(b, scan.offset);
+            }
+            pending = scan.pending;
+            if(pending == 0) {
+                break;
+            }
+        }
+
+        /* the next object spans chunks, or has to be read from the IO */
+        int h = get_head_byte(uk);
+        if(h < 0) {
+            return h;
+        }
+        reset_head_byte(uk);
+        if(scan_head_byte(h, &head) < 0) {
+            return PRIMITIVE_INVALID_BYTE;
+        }
+        if(head.count_size > 0) {
+            READ_CAST_BLOCK_OR_RETURN_EOF(cb, uk, head.count_size);
+            scan_count(&head, cb.buffer);
+        }
+        size_t body = head.body;
+        while(body > 0) {
+            size_t n = msgpack_buffer_skip(b, body);
+            if(n == 0) {
+                return PRIMITIVE_EOF;
+            }
+            body -= n;
+        }
+        pending = pending - 1 + head.elements;
+    }
+
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
+
+/*
+ * Reads a map key and compares it with key as the Hash returned by read
+ * would: str and bin keys are compared in place with the name of String
+ * keys, or of Symbol keys with symbolize_keys. Other keys are decoded.
+ * Returns 1 if they match, 0 otherwise.
+ */
+static int dig_match_key(msgpack_unpacker_t* uk, VALUE key)
+{
+    int b = get_head_byte(uk);
+    if(b < 0) {
+        return b;
+    }
+
+    int count_size;
+    if(b >= 0xa0 && b <= 0xbf) {
+        count_size = 0;
+    } else if(b == 0xd9 || b == 0xc4) {
+        count_size = 1;
+    } else if(b == 0xda || b == 0xc5) {
+        count_size = 2;
+    } else if(b == 0xdb || b == 0xc6) {
+        count_size = 4;
+    } else {
+        int r = msgpack_unpacker_read(uk, 0);
+        if(r < 0) {
+            return r;
+        }
+        VALUE decoded = uk->last_object;
+        if(uk->symbolize_keys && RB_TYPE_P(decoded, T_STRING)) {
+            decoded = rb_str_intern(decoded);
+        }
+        return rb_eql(key, decoded) ? 1 : 0;
+    }
+
+    reset_head_byte(uk);
+    size_t length = b & 0x1f;
+    if(count_size > 0) {
+        READ_CAST_BLOCK_OR_RETURN_EOF(cb, uk, count_size);
+        length = scan_be((const unsigned char*)cb.buffer, count_size);
+    }
+
+    msgpack_buffer_t* buffer = UNPACKER_BUFFER_(uk);
+    if(!msgpack_buffer_ensure_readable(buffer, length)) {
+        return PRIMITIVE_EOF;
+    }
+
+    VALUE name = Qnil;
+    if(uk->symbolize_keys && RB_TYPE_P(key, T_SYMBOL)) {
+        name = rb_sym2str(key);
+    } else if(!uk->symbolize_keys && RB_TYPE_P(key, T_STRING)) {
+        name = key;
+    }
+    /* as with String#eql?, non-ASCII names only match keys of their encoding */
+    int encindex = b >= 0xc4 && b <= 0xc6 ? msgpack_rb_encindex_ascii8bit : msgpack_rb_encindex_utf8;
+    if(!NIL_P(name) && ENCODING_GET(name) != encindex && !rb_enc_str_asciionly_p(name)) {
+        name = Qnil;
+    }
+    bool match = !NIL_P(name) && (size_t)RSTRING_LEN(name) == length;
+    const char* p = match ? RSTRING_PTR(name) : NULL;
+
+    while(length > 0) {
+        size_t n = msgpack_buffer_top_readable_size(buffer);
+        if(n > length) {
+            n = length;
+        }
+        if(match && memcmp(buffer->read_buffer, p, n) != 0) {
+            match = false;
+        }
+        _msgpack_buffer_consumed(buffer, n);
+        p += n;
+        length -= n;
+    }
+
+    return match ? 1 : 0;
+}
+
+/*
+ * Consumes the next object and sets result to the value found by following
+ * path in it, or to nil.
+ */
+static int dig_value(msgpack_unpacker_t* uk, int argc, const VALUE* path, int depth, VALUE* result)
+{
+    *result = Qnil;
+
+    if(argc == 0) {
+        int r = msgpack_unpacker_read(uk, 0);
+        if(r < 0) {
+            return r;
+        }
+        *result = uk->last_object;
+        return PRIMITIVE_OBJECT_COMPLETE;
+    }
+
+    if(depth >= MSGPACK_UNPACKER_STACK_CAPACITY) {
+        return PRIMITIVE_STACK_TOO_DEEP;
+    }
+
+    VALUE key = path[0];
+    int b = get_head_byte(uk);
+    if(b < 0) {
+        return b;
+    }
+
+    if((b >= 0x80 && b <= 0x8f) || b == 0xde || b == 0xdf) {
+        uint32_t count;
+        int r = msgpack_unpacker_read_map_header(uk, &count);
+        if(r < 0) {
+            return r;
+        }
+        /* the keys after a match are compared too, as the last duplicate
+         * key wins in the Hash returned by read */
+        for(; count > 0; count--) {
+            r = dig_match_key(uk, key);
+            if(r < 0) {
+                return r;
+            }
+            if(r) {
+                r = dig_value(uk, argc - 1, path + 1, depth + 1, result);
+            } else {
+                r = skip_objects(uk, 1);
+            }
+            if(r < 0) {
+                return r;
+            }
+        }
+        return PRIMITIVE_OBJECT_COMPLETE;
+    }
+
+    if(((b >= 0x90 && b <= 0x9f) || b == 0xdc || b == 0xdd) && RB_INTEGER_TYPE_P(key)) {
+        uint32_t count;
+        int r = msgpack_unpacker_read_array_header(uk, &count);
+        if(r < 0) {
+            return r;
+        }
+        long index = FIXNUM_P(key) ? FIX2LONG(key) : LONG_MAX;
+        if(index < 0) {
+            index += count;
+        }
+        if(index < 0 || index >= (long)count) {
+            return skip_objects(uk, count);
+        }
+        r = skip_objects(uk, index);
+        if(r < 0) {
+            return r;
+        }
+        r = dig_value(uk, argc - 1, path + 1, depth + 1, result);
+        if(r < 0) {
+            return r;
+        }
+        return skip_objects(uk, count - index - 1);
+    }
+
+    /* not a container, or an array with a key other than an index */
+    return skip_objects(uk, 1);
+}
+
+int msgpack_unpacker_dig(msgpack_unpacker_t* uk, int argc, const VALUE* path)
+{
+    /* the object is consumed as the path is followed, it has to be complete */
+    size_t length = 0;
+    int r = buffer_next_object(uk, &length);
+    if(r < 0) {
+        return r;
+    }
+
+    VALUE result;
+    r = dig_value(uk, argc, path, 0, &result);
+    if(r < 0) {
+        return r;
+    }
+
+    uk->last_object = result;
+    return PRIMITIVE_OBJECT_COMPLETE;
+}
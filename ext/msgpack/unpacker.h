@@ -31,6 +31,7 @@ enum stack_type_t {
     STACK_TYPE_ARRAY,
     STACK_TYPE_MAP_KEY,
     STACK_TYPE_MAP_VALUE,
+    STACK_TYPE_MAP_RAW_VALUE,  /* the value of a raw key, read without decoding */
     STACK_TYPE_RECURSIVE,
 };
 
@@ -45,6 +46,7 @@ struct msgpack_unpacker_stack_t {
     size_t depth;
     size_t capacity;
     msgpack_unpacker_stack_entry_t *data;
+    msgpack_rmem_t *rmem;
 };
 
 struct msgpack_unpacker_t {
@@ -60,19 +62,30 @@ struct msgpack_unpacker_t {
 
     VALUE buffer_ref;
 
+    VALUE payload_view;  /* reused for the ext types with payload: :view, or Qnil */
+
+    VALUE raw_keys;  /* frozen Hash of the map keys whose values are read raw, or Qnil */
+
     msgpack_unpacker_ext_registry_t *ext_registry;
 
+    const msgpack_key_dictionary_t *key_dictionary;
+    VALUE key_dictionary_ref;
+
     int reading_raw_type;
     unsigned int head_byte;
 
     /* options */
     int symbol_ext_type;
+    int timestamp_ext_type;
+    int bigint_ext_type;
 
     bool use_key_cache: 1;
     bool symbolize_keys: 1;
     bool freeze: 1;
     bool allow_unknown_ext: 1;
     bool optimized_symbol_ext_type: 1;
+    bool optimized_timestamp_ext_type: 1;
+    bool optimized_bigint_ext_type: 1;
 };
 
 #define UNPACKER_BUFFER_(uk) (&(uk)->buffer)
@@ -91,6 +104,9 @@ void msgpack_unpacker_static_init(void);
 
 void msgpack_unpacker_static_destroy(void);
 
+/* the pool of the stacks, or NULL outside the main Ractor */
+msgpack_rmem_t* msgpack_unpacker_stack_rmem_pool(void);
+
 void _msgpack_unpacker_init(msgpack_unpacker_t*);
 
 void _msgpack_unpacker_destroy(msgpack_unpacker_t* uk);
@@ -104,9 +120,10 @@ static inline void msgpack_unpacker_set_symbolized_keys(msgpack_unpacker_t* uk,
     uk->symbolize_keys = enable;
 }
 
-static inline void msgpack_unpacker_set_key_cache(msgpack_unpacker_t* uk, bool enable)
+static inline void msgpack_unpacker_set_key_cache(msgpack_unpacker_t* uk, size_t capacity)
 {
-    uk->use_key_cache = enable;
+    msgpack_key_cache_init(&uk->key_cache, capacity);
+    uk->use_key_cache = uk->key_cache.capacity > 0;
 }
 
 static inline void msgpack_unpacker_set_freeze(msgpack_unpacker_t* uk, bool enable)
@@ -129,6 +146,8 @@ static inline void msgpack_unpacker_set_allow_unknown_ext(msgpack_unpacker_t* uk
 #define PRIMITIVE_UNEXPECTED_TYPE -4
 #define PRIMITIVE_UNEXPECTED_EXT_TYPE -5
 #define PRIMITIVE_RECURSIVE_RAISED -6
+#define PRIMITIVE_INVALID_EXT_PAYLOAD -7
+#define PRIMITIVE_OUT_OF_RANGE -8
 
 int msgpack_unpacker_read(msgpack_unpacker_t* uk, size_t target_stack_depth);
 
@@ -148,5 +167,82 @@ int msgpack_unpacker_read_array_header(msgpack_unpacker_t* uk, uint32_t* result_
 
 int msgpack_unpacker_read_map_header(msgpack_unpacker_t* uk, uint32_t* result_size);
 
+typedef struct {
+    size_t offset;  /* bytes scanned so far */
+    size_t pending; /* objects left to complete */
+} msgpack_unpacker_scan_t;
+
+/*
+ * Finds where the pending objects end in data without decoding them. Returns
+ * PRIMITIVE_EOF if data ends first, the scan can then be resumed on a longer
+ * copy of the same data.
+ */
+int msgpack_unpacker_scan(const char* data, size_t length, msgpack_unpacker_scan_t* scan);
+
+typedef struct {
+    const char* data;
+    size_t length;
+} msgpack_unpacker_segment_t;
+
+typedef struct {
+    const msgpack_unpacker_segment_t* segments; /* consecutive pieces of the data */
+    size_t segment_count;
+    size_t segment;  /* segment holding the next object */
+    size_t position; /* position of the next object in that segment */
+    size_t offset;   /* offset of the next object in the data */
+} msgpack_unpacker_boundaries_t;
+
+/*
+ * Stores the offset and length of up to max top-level objects into ranges and
+ * returns how many were found. It touches no Ruby object, so it can run
+ * without the GVL. *result is set to PRIMITIVE_OBJECT_COMPLETE if ranges is
+ * full and the scan can be resumed, to PRIMITIVE_EOF if the data ends (maybe
+ * in the middle of an object) and to PRIMITIVE_INVALID_BYTE on malformed data.
+ */
+size_t msgpack_unpacker_scan_boundaries(msgpack_unpacker_boundaries_t* scan, size_t* ranges, size_t max, int* result);
+
+/* stores the readable data of a buffer to segments, if given, and returns their count */
+size_t msgpack_unpacker_buffer_segments(const msgpack_buffer_t* b, msgpack_unpacker_segment_t* segments);
+
+/*
+ * Reads the next Array or Map as the String of its elements without decoding
+ * them. Returns PRIMITIVE_UNEXPECTED_TYPE for other objects.
+ */
+int msgpack_unpacker_read_lazy_body(msgpack_unpacker_t* uk, VALUE* body, uint32_t* count, bool* is_map);
+
+/*
+ * Reads the next object as the String of its encoded bytes without decoding
+ * it, referring to the fed String when the object lies in it.
+ */
+int msgpack_unpacker_read_raw(msgpack_unpacker_t* uk, VALUE* raw);
+
+enum msgpack_typed_array_type_t {
+    MSGPACK_TYPED_ARRAY_INT8,
+    MSGPACK_TYPED_ARRAY_INT16,
+    MSGPACK_TYPED_ARRAY_INT32,
+    MSGPACK_TYPED_ARRAY_INT64,
+    MSGPACK_TYPED_ARRAY_UINT8,
+    MSGPACK_TYPED_ARRAY_UINT16,
+    MSGPACK_TYPED_ARRAY_UINT32,
+    MSGPACK_TYPED_ARRAY_UINT64,
+    MSGPACK_TYPED_ARRAY_FLOAT32,
+    MSGPACK_TYPED_ARRAY_FLOAT64,
+};
+
+/*
+ * Reads the next Array, whose elements must all be numbers, into a String of
+ * native-endian values of the given type. Returns PRIMITIVE_UNEXPECTED_TYPE
+ * (leaving the object unread) if it isn't an Array. If an element isn't a
+ * number of the type, PRIMITIVE_UNEXPECTED_TYPE or PRIMITIVE_OUT_OF_RANGE is
+ * returned after the whole Array is skipped.
+ */
+int msgpack_unpacker_read_typed_array(msgpack_unpacker_t* uk, enum msgpack_typed_array_type_t type, VALUE* result);
+
+/*
+ * Reads the next object and sets the value at path in it as the last object,
+ * or nil if there is none. Only that value is decoded.
+ */
+int msgpack_unpacker_dig(msgpack_unpacker_t* uk, int argc, const VALUE* path);
+
 #endif
 
@@ -20,6 +20,8 @@
 #include "unpacker_class.h"
 #include "buffer_class.h"
 #include "factory_class.h"
+#include "lazy_class.h"
+#include <ruby/thread.h>
 
 VALUE cMessagePack_Unpacker;
 
@@ -37,6 +39,12 @@ static VALUE sym_symbolize_keys;
 static VALUE sym_key_cache;
 static VALUE sym_freeze;
 static VALUE sym_allow_unknown_ext;
+static VALUE sym_raw_keys;
+
+static const char* const typed_array_types[] = {
+    "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32", "uint64", "float32", "float64",
+};
+static ID s_typed_array_types[sizeof(typed_array_types) / sizeof(typed_array_types[0])];
 
 static void Unpacker_free(void *ptr)
 {
@@ -68,7 +76,11 @@ static size_t Unpacker_memsize(const void *ptr)
     }
 
     if (uk->stack.data) {
-        total_size += (uk->stack.depth + 1) * sizeof(msgpack_unpacker_stack_t);
+        total_size += uk->stack.rmem ? uk->stack.rmem->page_size : uk->stack.capacity * sizeof(msgpack_unpacker_stack_entry_t);
+    }
+
+    if (uk->key_cache.entries) {
+        total_size += uk->key_cache.capacity * sizeof(msgpack_key_cache_entry_t);
     }
 
     return total_size + msgpack_buffer_memsize(&uk->buffer);
@@ -93,6 +105,24 @@ VALUE MessagePack_Unpacker_alloc(VALUE klass)
     return self;
 }
 
+/* the Hash looked up by the map keys, which are Strings or Symbols with symbolize_keys */
+static VALUE Unpacker_raw_keys_hash(VALUE keys)
+{
+    Check_Type(keys, T_ARRAY);
+    VALUE hash = rb_hash_new();
+    for(long i = 0; i < RARRAY_LEN(keys); i++) {
+        VALUE key = rb_ary_entry(keys, i);
+        if(SYMBOL_P(key)) {
+            key = rb_sym2str(key);
+        }
+        rb_hash_aset(hash, key, Qtrue);
+        if(RB_TYPE_P(key, T_STRING)) {
+            rb_hash_aset(hash, rb_str_intern(key), Qtrue);
+        }
+    }
+    return rb_obj_freeze(hash);
+}
+
 VALUE MessagePack_Unpacker_initialize(int argc, VALUE* argv, VALUE self)
 {
     VALUE io = Qnil;
@@ -130,7 +160,15 @@ VALUE MessagePack_Unpacker_initialize(int argc, VALUE* argv, VALUE self)
         VALUE v;
 
         v = rb_hash_aref(options, sym_key_cache);
-        msgpack_unpacker_set_key_cache(uk, RTEST(v));
+        if(RB_INTEGER_TYPE_P(v)) {
+            long capacity = NUM2LONG(v);
+            if(capacity < 0 || capacity > MSGPACK_KEY_CACHE_MAX_CAPACITY) {
+                rb_raise(rb_eArgError, "key_cache capacity must be between 0 and %d, got %ld", MSGPACK_KEY_CACHE_MAX_CAPACITY, capacity);
+            }
+            msgpack_unpacker_set_key_cache(uk, (size_t)capacity);
+        } else {
+            msgpack_unpacker_set_key_cache(uk, RTEST(v) ? MSGPACK_KEY_CACHE_DEFAULT_CAPACITY : 0);
+        }
 
         v = rb_hash_aref(options, sym_symbolize_keys);
         msgpack_unpacker_set_symbolized_keys(uk, RTEST(v));
@@ -140,6 +178,11 @@ VALUE MessagePack_Unpacker_initialize(int argc, VALUE* argv, VALUE self)
 
         v = rb_hash_aref(options, sym_allow_unknown_ext);
         msgpack_unpacker_set_allow_unknown_ext(uk, RTEST(v));
+
+        v = rb_hash_aref(options, sym_raw_keys);
+        if(!NIL_P(v)) {
+            uk->raw_keys = Unpacker_raw_keys_hash(v);
+        }
     }
 
     return self;
@@ -163,7 +206,7 @@ static VALUE Unpacker_allow_unknown_ext_p(VALUE self)
     return uk->allow_unknown_ext ? Qtrue : Qfalse;
 }
 
-NORETURN(static void raise_unpacker_error(msgpack_unpacker_t *uk, int r))
+NORETURN(void MessagePack_Unpacker_raise_error(msgpack_unpacker_t *uk, int r))
 {
     uk->stack.depth = 0;
     switch(r) {
@@ -185,11 +228,31 @@ NORETURN(static void raise_unpacker_error(msgpack_unpacker_t *uk, int r))
     case PRIMITIVE_RECURSIVE_RAISED:
         rb_exc_raise(msgpack_unpacker_get_last_object(uk));
         break;
+    case PRIMITIVE_INVALID_EXT_PAYLOAD:
+        rb_raise(eMalformedFormatError, "invalid extension payload");
+        break;
+    case PRIMITIVE_OUT_OF_RANGE:
+        rb_raise(rb_eRangeError, "integer out of range");
+        break;
     default:
         rb_raise(eUnpackError, "logically unknown error %d", r);
     }
 }
 
+static VALUE Unpacker_key_cache_stats(VALUE self)
+{
+    msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
+    const msgpack_key_cache_t *cache = &uk->key_cache;
+
+    VALUE stats = rb_hash_new();
+    rb_hash_aset(stats, ID2SYM(rb_intern("capacity")), UINT2NUM(cache->capacity));
+    rb_hash_aset(stats, ID2SYM(rb_intern("size")), UINT2NUM(cache->length));
+    rb_hash_aset(stats, ID2SYM(rb_intern("hits")), SIZET2NUM(cache->hits));
+    rb_hash_aset(stats, ID2SYM(rb_intern("misses")), SIZET2NUM(cache->misses));
+    rb_hash_aset(stats, ID2SYM(rb_intern("evictions")), SIZET2NUM(cache->evictions));
+    return stats;
+}
+
 static VALUE Unpacker_buffer(VALUE self)
 {
     msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
@@ -205,7 +268,90 @@ static VALUE Unpacker_read(VALUE self)
 
     int r = msgpack_unpacker_read(uk, 0);
     if(r < 0) {
-        raise_unpacker_error(uk, r);
+        MessagePack_Unpacker_raise_error(uk, r);
+    }
+
+    return msgpack_unpacker_get_last_object(uk);
+}
+
+static VALUE Unpacker_read_lazy(VALUE self)
+{
+    msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
+
+    /* continue an object partially read before as usual */
+    if(uk->stack.depth == 0 && uk->reading_raw_remaining == 0) {
+        VALUE body;
+        uint32_t count;
+        bool is_map;
+        int r = msgpack_unpacker_read_lazy_body(uk, &body, &count, &is_map);
+        if(r == PRIMITIVE_OBJECT_COMPLETE) {
+            return MessagePack_Lazy_new(self, body, count, is_map);
+        }
+        if(r != PRIMITIVE_UNEXPECTED_TYPE) {
+            MessagePack_Unpacker_raise_error(uk, r);
+        }
+    }
+
+    return Unpacker_read(self);
+}
+
+static VALUE Unpacker_read_raw(VALUE self)
+{
+    msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
+
+    if(uk->stack.depth > 0 || uk->reading_raw_remaining > 0) {
+        /* an object was partially read before */
+        MessagePack_Unpacker_raise_error(uk, PRIMITIVE_UNEXPECTED_TYPE);
+    }
+
+    VALUE raw;
+    int r = msgpack_unpacker_read_raw(uk, &raw);
+    if(r < 0) {
+        MessagePack_Unpacker_raise_error(uk, r);
+    }
+    if(uk->freeze) {
+        rb_obj_freeze(raw);
+    }
+    return raw;
+}
+
+static VALUE Unpacker_read_typed_array(VALUE self, VALUE type)
+{
+    msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
+
+    ID id = SYMBOL_P(type) ? SYM2ID(type) : 0;
+    size_t i = 0;
+    while(s_typed_array_types[i] != id) {
+        if(++i == sizeof(s_typed_array_types) / sizeof(s_typed_array_types[0])) {
+            rb_raise(rb_eArgError, "unknown typed array type: %+"PRIsVALUE, type);
+        }
+    }
+
+    if(uk->stack.depth > 0 || uk->reading_raw_remaining > 0) {
+        /* an object was partially read before */
+        MessagePack_Unpacker_raise_error(uk, PRIMITIVE_UNEXPECTED_TYPE);
+    }
+
+    VALUE result;
+    int r = msgpack_unpacker_read_typed_array(uk, (enum msgpack_typed_array_type_t)i, &result);
+    if(r < 0) {
+        MessagePack_Unpacker_raise_error(uk, r);
+    }
+    return result;
+}
+
+static VALUE Unpacker_dig(int argc, VALUE* argv, VALUE self)
+{
+    msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
+
+    if(uk->stack.depth > 0 || uk->reading_raw_remaining > 0) {
+        /* an object was partially read before */
+        MessagePack_Unpacker_raise_error(uk, PRIMITIVE_UNEXPECTED_TYPE);
+    }
+
+    int r = msgpack_unpacker_dig(uk, argc, argv);
+    if(r < 0) {
+        MessagePack_Unpacker_raise_error(uk, r);
     }
 
     return msgpack_unpacker_get_last_object(uk);
@@ -217,7 +363,7 @@ static VALUE Unpacker_skip(VALUE self)
 
     int r = msgpack_unpacker_skip(uk, 0);
     if(r < 0) {
-        raise_unpacker_error(uk, r);
+        MessagePack_Unpacker_raise_error(uk, r);
     }
 
     return Qnil;
@@ -229,7 +375,7 @@ static VALUE Unpacker_skip_nil(VALUE self)
 
     int r = msgpack_unpacker_skip_nil(uk);
     if(r < 0) {
-        raise_unpacker_error(uk, r);
+        MessagePack_Unpacker_raise_error(uk, r);
     }
 
     if(r) {
@@ -245,7 +391,7 @@ static VALUE Unpacker_read_array_header(VALUE self)
     uint32_t size;
     int r = msgpack_unpacker_read_array_header(uk, &size);
     if(r < 0) {
-        raise_unpacker_error(uk, r);
+        MessagePack_Unpacker_raise_error(uk, r);
     }
 
     return ULONG2NUM(size); // long at least 32 bits
@@ -258,7 +404,7 @@ static VALUE Unpacker_read_map_header(VALUE self)
     uint32_t size;
     int r = msgpack_unpacker_read_map_header(uk, &size);
     if(r < 0) {
-        raise_unpacker_error(uk, r);
+        MessagePack_Unpacker_raise_error(uk, r);
     }
 
     return ULONG2NUM(size); // long at least 32 bits
@@ -285,7 +431,7 @@ static VALUE Unpacker_each_impl(VALUE self)
             if(r == PRIMITIVE_EOF) {
                 return Qnil;
             }
-            raise_unpacker_error(uk, r);
+            MessagePack_Unpacker_raise_error(uk, r);
         }
         VALUE v = msgpack_unpacker_get_last_object(uk);
         rb_yield(v);
@@ -342,17 +488,7 @@ static VALUE Unpacker_reset(VALUE self)
 static VALUE Unpacker_registered_types_internal(VALUE self)
 {
     msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
-
-    VALUE mapping = rb_hash_new();
-    if (uk->ext_registry) {
-        for(int i=0; i < 256; i++) {
-            if(uk->ext_registry->array[i] != Qnil) {
-                rb_hash_aset(mapping, INT2FIX(i - 128), uk->ext_registry->array[i]);
-            }
-        }
-    }
-
-    return mapping;
+    return msgpack_unpacker_ext_registry_to_hash(uk->ext_registry);
 }
 
 static VALUE Unpacker_register_type_internal(VALUE self, VALUE rb_ext_type, VALUE ext_module, VALUE proc)
@@ -369,6 +505,16 @@ static VALUE Unpacker_register_type_internal(VALUE self, VALUE rb_ext_type, VALU
     msgpack_unpacker_t *uk = MessagePack_Unpacker_get(self);
     msgpack_unpacker_ext_registry_put(self, &uk->ext_registry, ext_module, ext_type, 0, proc);
 
+    if (uk->optimized_timestamp_ext_type && ext_type == uk->timestamp_ext_type) {
+        /* the registered proc takes precedence over the factory's native timestamp support */
+        uk->optimized_timestamp_ext_type = false;
+    }
+
+    if (uk->optimized_bigint_ext_type && ext_type == uk->bigint_ext_type) {
+        /* the registered proc takes precedence over the factory's native bigint support */
+        uk->optimized_bigint_ext_type = false;
+    }
+
     return Qnil;
 }
 
@@ -378,7 +524,7 @@ static VALUE Unpacker_full_unpack(VALUE self)
 
     int r = msgpack_unpacker_read(uk, 0);
     if(r < 0) {
-        raise_unpacker_error(uk, r);
+        MessagePack_Unpacker_raise_error(uk, r);
     }
 
     /* raise if extra bytes follow */
@@ -390,6 +536,63 @@ static VALUE Unpacker_full_unpack(VALUE self)
     return msgpack_unpacker_get_last_object(uk);
 }
 
+#define SCAN_BOUNDARIES_BATCH 1024
+
+struct scan_boundaries_args {
+    msgpack_unpacker_boundaries_t* scan;
+    size_t* ranges;
+    size_t found;
+    int result;
+};
+
+static void* scan_boundaries_func(void* ptr)
+{
+    struct scan_boundaries_args* args = ptr;
+    args->found = msgpack_unpacker_scan_boundaries(args->scan, args->ranges, SCAN_BOUNDARIES_BATCH, &args->result);
+    return NULL;
+}
+
+VALUE MessagePack_scan_boundaries(const msgpack_unpacker_segment_t* segments, size_t count, bool nogvl)
+{
+    VALUE boundaries = rb_ary_new();
+    size_t ranges[SCAN_BOUNDARIES_BATCH * 2];
+    msgpack_unpacker_boundaries_t scan = { segments, count, 0, 0, 0 };
+    struct scan_boundaries_args args = { &scan, ranges, 0, PRIMITIVE_OBJECT_COMPLETE };
+
+    while(args.result == PRIMITIVE_OBJECT_COMPLETE) {
+        if(nogvl) {
+            rb_thread_call_without_gvl(scan_boundaries_func, &args, NULL, NULL);
+        } else {
+            scan_boundaries_func(&args);
+        }
+
+        for(size_t i = 0; i < args.found; i++) {
+            rb_ary_push(boundaries, rb_assoc_new(SIZET2NUM(ranges[i * 2]), SIZET2NUM(ranges[i * 2 + 1])));
+        }
+    }
+
+    if(args.result == PRIMITIVE_INVALID_BYTE) {
+        rb_raise(eMalformedFormatError, "invalid byte in the object at offset %zu", scan.offset);
+    }
+
+    return boundaries;
+}
+
+static VALUE String_scan_boundaries(VALUE string)
+{
+    msgpack_unpacker_segment_t segment = { RSTRING_PTR(string), RSTRING_LEN(string) };
+    return MessagePack_scan_boundaries(&segment, 1, segment.length >= MSGPACK_BUFFER_NOGVL_THRESHOLD_MINIMUM);
+}
+
+static VALUE MessagePack_module_scan_boundaries(VALUE self, VALUE string)
+{
+    StringValue(string);
+
+    /* the string can't be modified while it is scanned without the GVL */
+    rb_str_locktmp(string);
+    return rb_ensure(String_scan_boundaries, string, rb_str_unlocktmp, string);
+}
+
 VALUE MessagePack_Unpacker_new(int argc, VALUE* argv)
 {
     VALUE self = MessagePack_Unpacker_alloc(cMessagePack_Unpacker);
@@ -420,6 +623,11 @@ void MessagePack_Unpacker_module_init(VALUE mMessagePack)
     sym_key_cache = ID2SYM(rb_intern("key_cache"));
     sym_freeze = ID2SYM(rb_intern("freeze"));
     sym_allow_unknown_ext = ID2SYM(rb_intern("allow_unknown_ext"));
+    sym_raw_keys = ID2SYM(rb_intern("raw_keys"));
+
+    for(size_t i = 0; i < sizeof(s_typed_array_types) / sizeof(s_typed_array_types[0]); i++) {
+        s_typed_array_types[i] = rb_intern(typed_array_types[i]);
+    }
 
     rb_define_alloc_func(cMessagePack_Unpacker, MessagePack_Unpacker_alloc);
 
@@ -427,9 +635,14 @@ void MessagePack_Unpacker_module_init(VALUE mMessagePack)
     rb_define_method(cMessagePack_Unpacker, "symbolize_keys?", Unpacker_symbolized_keys_p, 0);
     rb_define_method(cMessagePack_Unpacker, "freeze?", Unpacker_freeze_p, 0);
     rb_define_method(cMessagePack_Unpacker, "allow_unknown_ext?", Unpacker_allow_unknown_ext_p, 0);
+    rb_define_method(cMessagePack_Unpacker, "key_cache_stats", Unpacker_key_cache_stats, 0);
     rb_define_method(cMessagePack_Unpacker, "buffer", Unpacker_buffer, 0);
     rb_define_method(cMessagePack_Unpacker, "read", Unpacker_read, 0);
     rb_define_alias(cMessagePack_Unpacker, "unpack", "read");
+    rb_define_method(cMessagePack_Unpacker, "read_lazy", Unpacker_read_lazy, 0);
+    rb_define_method(cMessagePack_Unpacker, "read_raw", Unpacker_read_raw, 0);
+    rb_define_method(cMessagePack_Unpacker, "dig", Unpacker_dig, -1);
+    rb_define_method(cMessagePack_Unpacker, "read_typed_array", Unpacker_read_typed_array, 1);
     rb_define_method(cMessagePack_Unpacker, "skip", Unpacker_skip, 0);
     rb_define_method(cMessagePack_Unpacker, "skip_nil", Unpacker_skip_nil, 0);
     rb_define_method(cMessagePack_Unpacker, "read_array_header", Unpacker_read_array_header, 0);
@@ -444,4 +657,6 @@ void MessagePack_Unpacker_module_init(VALUE mMessagePack)
     rb_define_private_method(cMessagePack_Unpacker, "register_type_internal", Unpacker_register_type_internal, 3);
 
     rb_define_method(cMessagePack_Unpacker, "full_unpack", Unpacker_full_unpack, 0);
+
+    rb_define_module_function(mMessagePack, "scan_boundaries", MessagePack_module_scan_boundaries, 1);
 }
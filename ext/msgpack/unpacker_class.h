@@ -39,5 +39,10 @@ VALUE MessagePack_Unpacker_alloc(VALUE klass);
 
 VALUE MessagePack_Unpacker_initialize(int argc, VALUE* argv, VALUE self);
 
+NORETURN(void MessagePack_Unpacker_raise_error(msgpack_unpacker_t *uk, int r));
+
+/* nogvl releases the GVL while scanning, the segments must not be modified meanwhile */
+VALUE MessagePack_scan_boundaries(const msgpack_unpacker_segment_t* segments, size_t count, bool nogvl);
+
 #endif
 
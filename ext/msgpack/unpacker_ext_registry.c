@@ -22,8 +22,9 @@ void msgpack_unpacker_ext_registry_mark(msgpack_unpacker_ext_registry_t* ukrg)
 {
     if (ukrg) {
         for(int i=0; i < 256; i++) {
-            if (ukrg->array[i] != Qnil) {
-                rb_gc_mark(ukrg->array[i]);
+            if (ukrg->entries[i].registered) {
+                rb_gc_mark(ukrg->entries[i].ext_module);
+                rb_gc_mark(ukrg->entries[i].proc);
             }
         }
     }
@@ -36,7 +37,7 @@ msgpack_unpacker_ext_registry_t* msgpack_unpacker_ext_registry_cow(msgpack_unpac
         if (src->borrow_count) {
             dst = ALLOC(msgpack_unpacker_ext_registry_t);
             dst->borrow_count = 0;
-            MEMCPY(dst->array, src->array, VALUE, 256);
+            MEMCPY(dst->entries, src->entries, msgpack_unpacker_ext_entry_t, 256);
             msgpack_unpacker_ext_registry_release(src);
             return dst;
         } else {
@@ -46,7 +47,10 @@ msgpack_unpacker_ext_registry_t* msgpack_unpacker_ext_registry_cow(msgpack_unpac
         dst = ALLOC(msgpack_unpacker_ext_registry_t);
         dst->borrow_count = 0;
         for(int i=0; i < 256; i++) {
-            dst->array[i] = Qnil;
+            dst->entries[i].ext_module = Qnil;
+            dst->entries[i].proc = Qnil;
+            dst->entries[i].flags = 0;
+            dst->entries[i].registered = false;
         }
         return dst;
     }
@@ -55,9 +59,7 @@ msgpack_unpacker_ext_registry_t* msgpack_unpacker_ext_registry_cow(msgpack_unpac
 void msgpack_unpacker_ext_registry_release(msgpack_unpacker_ext_registry_t* ukrg)
 {
     if (ukrg) {
-        if (ukrg->borrow_count) {
-            ukrg->borrow_count--;
-        } else {
+        if (msgpack_atomic_fetch_sub(ukrg->borrow_count, 1) == 0) {
             xfree(ukrg);
         }
     }
@@ -68,7 +70,24 @@ void msgpack_unpacker_ext_registry_put(VALUE owner, msgpack_unpacker_ext_registr
 {
     msgpack_unpacker_ext_registry_t* ext_registry = msgpack_unpacker_ext_registry_cow(*ukrg);
 
-    VALUE entry = rb_ary_new3(3, ext_module, proc, INT2FIX(flags));
-    RB_OBJ_WRITE(owner, &ext_registry->array[ext_type + 128], entry);
+    msgpack_unpacker_ext_entry_t* entry = &ext_registry->entries[ext_type + 128];
+    RB_OBJ_WRITE(owner, &entry->ext_module, ext_module);
+    RB_OBJ_WRITE(owner, &entry->proc, proc);
+    entry->flags = flags;
+    entry->registered = true;
     *ukrg = ext_registry;
 }
+
+VALUE msgpack_unpacker_ext_registry_to_hash(msgpack_unpacker_ext_registry_t* ukrg)
+{
+    VALUE mapping = rb_hash_new();
+    if (ukrg) {
+        for(int i=0; i < 256; i++) {
+            const msgpack_unpacker_ext_entry_t* entry = &ukrg->entries[i];
+            if (entry->registered) {
+                rb_hash_aset(mapping, INT2FIX(i - 128), rb_ary_new3(3, entry->ext_module, entry->proc, INT2FIX(entry->flags)));
+            }
+        }
+    }
+    return mapping;
+}
@@ -22,13 +22,27 @@
 #include "ruby.h"
 
 #define MSGPACK_EXT_RECURSIVE 0b0001
+#define MSGPACK_EXT_PAYLOAD_VIEW 0b0010
+#define MSGPACK_EXT_NATIVE_FUNC 0b0100
 
 struct msgpack_unpacker_ext_registry_t;
 typedef struct msgpack_unpacker_ext_registry_t msgpack_unpacker_ext_registry_t;
 
+struct msgpack_unpacker_ext_entry_t;
+typedef struct msgpack_unpacker_ext_entry_t msgpack_unpacker_ext_entry_t;
+
+struct msgpack_unpacker_ext_entry_t {
+    VALUE ext_module;
+    VALUE proc;
+    int flags;
+    bool registered;
+};
+
+/* borrow_count is updated atomically as the registry of a shareable
+ * Factory is borrowed by unpackers of several Ractors. */
 struct msgpack_unpacker_ext_registry_t {
     unsigned int borrow_count;
-    VALUE array[256];
+    msgpack_unpacker_ext_entry_t entries[256];
 };
 
 void msgpack_unpacker_ext_registry_release(msgpack_unpacker_ext_registry_t* ukrg);
@@ -36,7 +50,7 @@ void msgpack_unpacker_ext_registry_release(msgpack_unpacker_ext_registry_t* ukrg
 static inline void msgpack_unpacker_ext_registry_borrow(msgpack_unpacker_ext_registry_t* src, msgpack_unpacker_ext_registry_t** dst)
 {
     if (src) {
-        src->borrow_count++;
+        msgpack_atomic_inc(src->borrow_count);
         *dst = src;
     }
 }
@@ -46,15 +60,16 @@ void msgpack_unpacker_ext_registry_mark(msgpack_unpacker_ext_registry_t* ukrg);
 void msgpack_unpacker_ext_registry_put(VALUE owner, msgpack_unpacker_ext_registry_t** ukrg,
         VALUE ext_module, int ext_type, int flags, VALUE proc);
 
+/* Hash of the registered types to [ext_module, proc, flags] */
+VALUE msgpack_unpacker_ext_registry_to_hash(msgpack_unpacker_ext_registry_t* ukrg);
+
 static inline VALUE msgpack_unpacker_ext_registry_lookup(msgpack_unpacker_ext_registry_t* ukrg,
         int ext_type, int* ext_flags_result)
 {
     if (ukrg) {
-        VALUE entry = ukrg->array[ext_type + 128];
-        if (entry != Qnil) {
-            *ext_flags_result = FIX2INT(rb_ary_entry(entry, 2));
-            return rb_ary_entry(entry, 1);
-        }
+        const msgpack_unpacker_ext_entry_t* entry = &ukrg->entries[ext_type + 128];
+        *ext_flags_result = entry->flags;
+        return entry->proc;
     }
     return Qnil;
 }
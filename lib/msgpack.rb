@@ -5,6 +5,7 @@ if defined?(RUBY_ENGINE) && RUBY_ENGINE == "jruby" # This is same with `/java/ =
   JRuby::Util.load_ext("org.msgpack.jruby.MessagePackLibrary")
 else
   require "msgpack/msgpack"
+  require "msgpack/lazy"
 end
 
 require "msgpack/buffer"
@@ -36,6 +37,18 @@ module MessagePack
   module_function :load
   module_function :unpack
 
+  def dig(src, *path)
+    if src.is_a? String
+      unpacker = DefaultFactory.unpacker
+      unpacker.feed_reference src
+    else
+      unpacker = DefaultFactory.unpacker src
+    end
+
+    unpacker.dig(*path)
+  end
+  module_function :dig
+
   def pack(v, io = nil, options = nil)
     packer = DefaultFactory.packer(io, options)
     packer.write v
@@ -45,4 +58,9 @@ module MessagePack
 
   module_function :pack
   module_function :dump
+
+  def packed_size(v, options = nil)
+    DefaultFactory.packer(options).packed_size(v)
+  end
+  module_function :packed_size
 end
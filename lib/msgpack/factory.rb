@@ -2,13 +2,38 @@ module MessagePack
   class Factory
     # see ext for other methods
 
+    # registered as they are rather than converted to a Proc (NativeExt is CRuby only)
+    PROC_CLASSES = [Proc, (MessagePack::NativeExt if defined?(MessagePack::NativeExt))].compact.freeze
+    private_constant :PROC_CLASSES
+
     def register_type(type, klass, options = { packer: :to_msgpack_ext, unpacker: :from_msgpack_ext })
       raise FrozenError, "can't modify frozen MessagePack::Factory" if frozen?
 
       if options
         options = options.dup
+        if options[:native] && klass == ::Time
+          # The native implementation only kicks in for the Factory, these procs
+          # are used for anything it doesn't handle (e.g. subclasses of Time).
+          options[:packer] = MessagePack::Time::Packer unless options.key?(:packer)
+          options[:unpacker] = MessagePack::Time::Unpacker unless options.key?(:unpacker)
+        elsif options[:native] && klass == ::Integer
+          require "msgpack/bigint"
+          options[:packer] = MessagePack::Bigint.method(:to_msgpack_ext) unless options.key?(:packer)
+          options[:unpacker] = MessagePack::Bigint.method(:from_msgpack_ext) unless options.key?(:unpacker)
+          options[:oversized_integer_extension] = true
+        elsif klass == ::Integer && !options.key?(:native) && defined?(MessagePack::Bigint)
+          # The Bigint procs have a byte-identical native implementation
+          native_packer = options[:packer] == MessagePack::Bigint.method(:to_msgpack_ext)
+          native_unpacker = options[:unpacker] == MessagePack::Bigint.method(:from_msgpack_ext)
+          if native_packer && native_unpacker
+            options[:native] = true
+          elsif native_packer || native_unpacker
+            options[:native] = native_packer ? :packer : :unpacker
+          end
+        end
+
         case packer = options[:packer]
-        when nil, Proc
+        when nil, *PROC_CLASSES
           # all good
         when String, Symbol
           options[:packer] = packer.to_sym.to_proc
@@ -21,7 +46,7 @@ module MessagePack
         end
 
         case unpacker = options[:unpacker]
-        when nil, Proc
+        when nil, *PROC_CLASSES
           # all good
         when String, Symbol
           options[:unpacker] = klass.method(unpacker).to_proc
@@ -37,6 +62,23 @@ module MessagePack
       register_type_internal(type, klass, options)
     end
 
+    def compile_schema(keys_or_class)
+      if keys_or_class.is_a?(::Class) && (keys_or_class < ::Struct || (defined?(::Data) && keys_or_class < ::Data))
+        compile_schema_internal(keys_or_class, keys_or_class.members)
+      else
+        compile_schema_internal(nil, keys_or_class)
+      end
+    end
+
+    def learn_key_dictionary(payloads)
+      keys = key_dictionary ? key_dictionary.keys : []
+      unpacker = unpacker(allow_unknown_ext: true)
+      payloads.each do |payload|
+        unpacker.feed_each(payload) { |object| collect_keys(object, keys) }
+      end
+      self.key_dictionary = keys
+    end
+
     # [ {type: id, class: Class(or nil), packer: arg, unpacker: arg}, ... ]
     def registered_types(selector=:both)
       packer, unpacker = registered_types_internal
@@ -117,6 +159,96 @@ module MessagePack
     end
     alias :pack :dump
 
+    def packed_size(v, *rest)
+      packer(*rest).packed_size(v)
+    end
+
+    def unpack_all_parallel(data, workers: nil, **options)
+      unless workers
+        require "etc"
+        workers = ::Etc.nprocessors
+      end
+
+      if workers > 1 && defined?(::Ractor.make_shareable)
+        ranges = MessagePack.scan_boundaries(data)
+        workers = ranges.size if workers > ranges.size
+      end
+      unless workers > 1 && ranges
+        return unpack_all_range(data, 0, data.bytesize, options)
+      end
+
+      last_offset, last_length = ranges.last
+      if last_offset + last_length < data.bytesize
+        raise EOFError, "end of buffer reached"
+      end
+
+      factory = shareable_factory
+      unless factory
+        # procs that aren't isolated can't be called from other Ractors
+        return unpack_all_range(data, 0, data.bytesize, options)
+      end
+      # copied rather than frozen in place, as they belong to the caller
+      data = ::Ractor.make_shareable(data, copy: true)
+      options = ::Ractor.make_shareable(options, copy: true)
+
+      ractors = Array.new(workers) do |i|
+        first, last = ranges[ranges.size * i / workers], ranges[ranges.size * (i + 1) / workers - 1]
+        offset, length = first[0], last[0] + last[1] - first[0]
+        ::Ractor.new(factory, data, offset, length, options) do |factory, data, offset, length, options|
+          factory.send(:unpack_all_range, data, offset, length, options)
+        end
+      end
+
+      ractors.flat_map do |ractor|
+        begin
+          ractor.take
+        rescue ::Ractor::RemoteError => error
+          raise error.cause, cause: nil
+        end
+      end
+    end
+
+    # A shareable copy of the factory, or nil if its procs can't be made shareable.
+    # The copy is kept until types are registered or the key dictionary changes.
+    def shareable_factory
+      return self if ::Ractor.shareable?(self)
+
+      state = [registered_types_internal, key_dictionary]
+      cached_state, cached = @shareable_factory
+      return cached if cached_state == state
+
+      begin
+        copy = ::Ractor.make_shareable(dup.freeze)
+      rescue ::Ractor::IsolationError
+        copy = nil
+      end
+      @shareable_factory = [state, copy] unless frozen?
+      copy
+    end
+    private :shareable_factory
+
+    def unpack_all_range(data, offset, length, options)
+      unpacker = unpacker(options.empty? ? nil : options)
+      unpacker.feed_reference(data.byteslice(offset, length))
+      objects = []
+      objects << unpacker.read until unpacker.buffer.empty?
+      objects
+    end
+    private :unpack_all_range
+
+    def collect_keys(object, keys)
+      case object
+      when ::Hash
+        object.each_pair do |key, value|
+          keys << key if key.is_a?(::String)
+          collect_keys(value, keys)
+        end
+      when ::Array
+        object.each { |value| collect_keys(value, keys) }
+      end
+    end
+    private :collect_keys
+
     def pool(size = 1, **options)
       Pool.new(
         frozen? ? self : dup.freeze,
@@ -199,6 +331,12 @@ module MessagePack
         end
       end
 
+      def packed_size(object)
+        @packers.with do |packer|
+          packer.packed_size(object)
+        end
+      end
+
       def unpacker(&block)
         @unpackers.with(&block)
       end
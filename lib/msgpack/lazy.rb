@@ -0,0 +1,47 @@
+module MessagePack
+  class LazyArray
+    # see ext for other methods
+    include Enumerable
+
+    def dig(index, *rest)
+      value = self[index]
+      rest.empty? || value.nil? ? value : value.dig(*rest)
+    end
+
+    def inspect
+      "#<#{self.class} size=#{size}>"
+    end
+  end
+
+  class LazyMap
+    # see ext for other methods
+    include Enumerable
+
+    alias_method :member?, :key?
+
+    def fetch(key, *default)
+      if key?(key)
+        self[key]
+      elsif block_given?
+        yield key
+      elsif !default.empty?
+        default.first
+      else
+        raise KeyError, "key not found: #{key.inspect}"
+      end
+    end
+
+    def values
+      map { |_key, value| value }
+    end
+
+    def dig(key, *rest)
+      value = self[key]
+      rest.empty? || value.nil? ? value : value.dig(*rest)
+    end
+
+    def inspect
+      "#<#{self.class} size=#{size}>"
+    end
+  end
+end
@@ -0,0 +1,87 @@
+require 'spec_helper'
+
+describe 'register_type with Integer and native: true' do
+  let(:native_factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x01, Integer, native: true)
+    factory
+  end
+
+  let(:proc_factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(
+      0x01,
+      Integer,
+      packer: MessagePack::Bigint.method(:to_msgpack_ext),
+      unpacker: MessagePack::Bigint.method(:from_msgpack_ext),
+      oversized_integer_extension: true,
+    )
+    factory
+  end
+
+  let(:integers) do
+    [
+      2**64,
+      -(2**63) - 1,
+      2**95,
+      2**96 - 1,
+      -(2**96),
+      120938120391283122132313,
+      -21903120391203912391023920332103,
+      210290021321301203912933021323,
+      7**1000,
+      -(3**20000),
+    ]
+  end
+
+  it 'packs the same bytes as MessagePack::Bigint' do
+    integers.each do |int|
+      expect(native_factory.dump(int)).to be == proc_factory.dump(int)
+    end
+  end
+
+  it 'round trips oversized integers' do
+    integers.each do |int|
+      expect(native_factory.load(native_factory.dump(int))).to be == int
+      expect(native_factory.load(proc_factory.dump(int))).to be == int
+      expect(proc_factory.load(native_factory.dump(int))).to be == int
+    end
+  end
+
+  it 'still packs integers fitting in 64 bits as regular integers' do
+    [0, 2**64 - 1, -(2**63) + 1].each do |int|
+      expect(native_factory.dump(int)).to be == MessagePack.pack(int)
+    end
+  end
+
+  it 'unpacks payloads split across feeds' do
+    packed = native_factory.dump([7**1000, { "a" => -(2**100) }])
+    unpacker = native_factory.unpacker
+    packed.each_char { |c| unpacker.feed(c) }
+    expect(unpacker.read).to be == [7**1000, { "a" => -(2**100) }]
+  end
+
+  it 'decodes payloads the same way as MessagePack::Bigint' do
+    ["".b, "\x00".b, "\x01".b, "\x00\x00\x00\x01\x00\x00".b, "\x02\x00\x00\x00\x05".b].each do |payload|
+      packed = MessagePack::ExtensionValue.new(0x01, payload).to_msgpack
+      expect(native_factory.load(packed)).to be == proc_factory.load(packed)
+    end
+  end
+
+  it 'uses the native implementation when registered with the MessagePack::Bigint methods' do
+    called = []
+    trace = TracePoint.new(:call) { |tp| called << tp.method_id if tp.defined_class == MessagePack::Bigint.singleton_class }
+    trace.enable do
+      integers.each do |int|
+        expect(proc_factory.load(proc_factory.dump(int))).to be == int
+      end
+    end
+    expect(called).to be == []
+  end
+
+  it 'can be overridden by a later registration' do
+    native_factory.register_type(0x01, Integer, packer: :to_s, unpacker: method(:Integer), oversized_integer_extension: true)
+    expect(native_factory.load(native_factory.dump(2**70))).to be == 2**70
+    expect(native_factory.dump(2**70)).to be == MessagePack::ExtensionValue.new(0x01, (2**70).to_s).to_msgpack
+  end
+end
@@ -252,4 +252,168 @@ describe Buffer do
       b.clear
     }
   end
+  describe 'io_zero_copy' do
+    # records the Strings returned by readpartial when the buffer feeds itself,
+    # large raw bodies are read directly into the result String instead
+    let :recording_io do
+      reads = []
+      io.define_singleton_method(:readpartial) do |*args|
+        s = super(*args)
+        reads << s if args.size == 1
+        s
+      end
+      io.define_singleton_method(:reads) { reads }
+      io
+    end
+
+    it 'refers to the Strings read from the IO' do
+      objects = Array.new(30) { r.bytes(3000) } + [r.bytes(100_000), "x" * 10, { "a" => r.bytes(1000) }]
+      set_source objects.map { |o| MessagePack.pack(o) }.join
+
+      unpacker = Unpacker.new(recording_io, io_zero_copy: true, io_buffer_size: 16 * 1024)
+      objects.each { |o| unpacker.read.should == o }
+      lambda { unpacker.read }.should raise_error(EOFError)
+
+      recording_io.reads.size.should > 1
+      recording_io.reads.uniq(&:object_id).size.should == recording_io.reads.size
+      recording_io.reads.each { |s| s.should_not be_frozen }
+    end
+
+    it 'leaves the Strings returned by the IO untouched' do
+      payload = r.bytes(100_000)
+      utf8_io = Object.new
+      returned = []
+      data = MessagePack.pack(payload) + MessagePack.pack(payload)
+      utf8_io.define_singleton_method(:readpartial) do |n, outbuf = nil|
+        raise EOFError if data.empty?
+        s = data.slice!(0, n).force_encoding(Encoding::UTF_8)
+        return outbuf.replace(s) if outbuf
+        returned << s
+        s
+      end
+
+      unpacker = Unpacker.new(utf8_io, io_zero_copy: true, io_buffer_size: 64 * 1024)
+      unpacker.read.should == payload
+      returned.each do |s|
+        s.should_not be_frozen
+        s.encoding.should == Encoding::UTF_8
+        s.replace("x" * s.bytesize)
+      end
+      unpacker.read.should == payload
+    end
+
+    it 'copies short reads' do
+      set_source MessagePack.pack([1, 2, 3])
+      unpacker = Unpacker.new(recording_io, io_zero_copy: true)
+      unpacker.read.should == [1, 2, 3]
+      recording_io.reads.each { |s| s.should_not be_frozen }
+    end
+
+    it 'random read' do
+      r = Random.new(random_seed)
+
+      50.times {
+        fragments = []
+
+        r.rand(4).times do
+          n = r.rand(1024*1400)
+          s = r.bytes(n)
+          fragments << s
+        end
+
+        io = StringIO.new(fragments.map { |s| MessagePack.pack(s) }.join)
+        unpacker = Unpacker.new(io, io_zero_copy: true, io_buffer_size: r.rand(1024*64) + 1)
+        fragments.each { |s| unpacker.read.should == s }
+      }
+    end
+  end
+
+  describe 'write_to with several chunks' do
+    # strings longer than write_reference_threshold become chunks of their own
+    let :chunks do
+      Array.new(5) { |i| ["x" * 10, r.bytes(600 * 1024 + i)] }.flatten
+    end
+
+    let :chunked_buffer do
+      b = Buffer.new
+      chunks.each { |s| b << s }
+      b
+    end
+
+    it 'writes all chunks to a binary File' do
+      require 'tempfile'
+      Tempfile.create('msgpack', binmode: true) do |f|
+        chunked_buffer.write_to(f).should == chunks.join.bytesize
+        chunked_buffer.size.should == 0
+        f.rewind
+        f.read.should == chunks.join
+      end
+    end
+
+    it 'writes all chunks to a text mode File' do
+      require 'tempfile'
+      Tempfile.create('msgpack') do |f|
+        chunked_buffer.write_to(f)
+        f.rewind
+        f.binmode
+        f.read.should == chunks.join
+      end
+    end
+
+    it 'writes all chunks to a non-blocking pipe' do
+      rd, wr = IO.pipe
+      rd.binmode
+      wr.binmode
+      reader = Thread.new { rd.read }
+      chunked_buffer.write_to(wr)
+      wr.close
+      reader.value.should == chunks.join
+      rd.close
+    end
+
+    it 'raises ThreadError when the chunks are freed while writev is blocked' do
+      require 'io/nonblock'
+      rd, wr = IO.pipe
+      rd.binmode
+      wr.binmode
+      wr.nonblock = false
+      buffer = chunked_buffer
+      writer = Thread.new { buffer.write_to(wr) }
+      Thread.pass until writer.status == 'sleep'
+      lambda { buffer.clear }.should raise_error(ThreadError)
+      rd.read(chunks.join.bytesize).should == chunks.join
+      writer.value.should == chunks.join.bytesize
+      wr.close
+      rd.close
+    end
+
+    it 'passes all chunks to a single variadic write call' do
+      calls = []
+      io = StringIO.new(''.b)
+      io.define_singleton_method(:write) do |*args|
+        calls << args.size
+        super(*args)
+      end
+      chunked_buffer.write_to(io)
+      calls.should == [chunks.size]
+      io.string.should == chunks.join
+    end
+
+    it 'calls a single argument write once per chunk' do
+      out = ''.b
+      writer = Object.new
+      writer.define_singleton_method(:write) { |s| out << s; s.bytesize }
+      chunked_buffer.write_to(writer)
+      out.should == chunks.join
+    end
+
+    it 'calls write once per chunk when it takes optional arguments' do
+      calls = []
+      writer = Object.new
+      writer.define_singleton_method(:write) { |s, opts = nil| calls << [s, opts]; s.bytesize }
+      chunked_buffer.write_to(writer)
+      calls.map(&:last).uniq.should == [nil]
+      calls.map(&:first).join.should == chunks.join
+    end
+  end
 end
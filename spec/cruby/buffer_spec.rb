@@ -587,7 +587,11 @@ describe Buffer do
     buffer.read(10)
     expect(ObjectSpace.memsize_of(buffer)).to be == memsize
     buffer.read_all
-    expect(ObjectSpace.memsize_of(buffer)).to be == empty_size
+    expect(ObjectSpace.memsize_of(buffer)).to be > empty_size # chunks kept for reuse
+    10.times do
+      buffer << "a" * 500
+    end
+    expect(ObjectSpace.memsize_of(buffer)).to be == memsize
   end
 
   it "doesn't allow #dup or #clone" do
@@ -620,4 +624,39 @@ describe Buffer do
 
     expect(b1.read_all).to eq(('C' * 128).b)
   end
+
+  it "keeps track of its size across many referenced chunks" do
+    b = MessagePack::Buffer.new(nil, write_reference_threshold: 256)
+    size = 0
+    1000.times do |i|
+      b.write('x' * (300 + i))
+      b.write('y' * (i % 7))
+      size += 300 + i + i % 7
+    end
+    expect(b.size).to eq size
+    b.skip(10_000)
+    expect(b.size).to eq size - 10_000
+    expect(b.read(500).size).to eq 500
+    expect(b.size).to eq size - 10_500
+    expect(b.read_all.size).to eq size - 10_500
+    expect(b.size).to eq 0
+    b.write('z' * 300)
+    expect(b.size).to eq 300
+  end
+
+  it "keeps referenced strings alive while recursive extensions are packed" do
+    wrapper = Struct.new(:value)
+    factory = MessagePack::Factory.new
+    factory.register_type(0x01, wrapper, packer: ->(w, packer) { packer.write(w.value) }, unpacker: ->(u) { wrapper.new(u.read) }, recursive: true)
+    document = Array.new(3) { |i| [('s' * 1000 + i.to_s).b, wrapper.new([('w' * 1000 + i.to_s).b, wrapper.new(i)])] }
+
+    packer = factory.packer(write_reference_threshold: 256)
+    begin
+      stress, GC.stress = GC.stress, true
+      packer.write(document)
+    ensure
+      GC.stress = stress
+    end
+    expect(factory.load(packer.to_s)).to eq document
+  end
 end
@@ -0,0 +1,138 @@
+require 'spec_helper'
+require 'stringio'
+
+describe 'Unpacker#dig' do
+  let(:document) do
+    {
+      "id" => 42,
+      "payload" => {
+        "items" => Array.new(10) { |i| { "sku" => "item-#{i}", "qty" => i } },
+        "meta" => { "tenant_id" => "t-42", "long_key_" * 40 => "long", 7 => "seven", nil => "nil" },
+      },
+      "list" => [1.5, [nil, true], "last"],
+    }
+  end
+  let(:data) { MessagePack.pack(document) }
+
+  it 'returns the value at the path' do
+    expect(MessagePack.dig(data, "id")).to eq 42
+    expect(MessagePack.dig(data, "payload", "meta", "tenant_id")).to eq "t-42"
+    expect(MessagePack.dig(data, "payload", "items", 3, "sku")).to eq "item-3"
+    expect(MessagePack.dig(data, "payload", "items", -1, "qty")).to eq 9
+    expect(MessagePack.dig(data, "list", 1)).to eq [nil, true]
+    expect(MessagePack.dig(data, "payload", "meta")).to eq document["payload"]["meta"]
+    expect(MessagePack.dig(data)).to eq document
+  end
+
+  it 'matches Integer and nil keys' do
+    expect(MessagePack.dig(data, "payload", "meta", 7)).to eq "seven"
+    expect(MessagePack.dig(data, "payload", "meta", nil)).to eq "nil"
+    expect(MessagePack.dig(data, "payload", "meta", "long_key_" * 40)).to eq "long"
+  end
+
+  it 'matches bin keys' do
+    data = MessagePack.pack({ "key".b => 1, "other".b => 2 })
+    expect(MessagePack.dig(data, "other")).to eq 2
+  end
+
+  it 'matches Symbol keys only with symbolize_keys' do
+    expect(MessagePack.dig(data, :payload)).to eq nil
+    unpacker = MessagePack::Unpacker.new(symbolize_keys: true)
+    unpacker.feed(data * 2)
+    expect(unpacker.dig(:payload, :meta, :tenant_id)).to eq "t-42"
+    expect(unpacker.dig("payload")).to eq nil
+  end
+
+  it 'matches non-ASCII keys of the same encoding only' do
+    data = MessagePack.pack({ "caf\u00e9" => 1, "caf\u00e9".b => 2 })
+    expect(MessagePack.dig(data, "caf\u00e9")).to eq 1
+    expect(MessagePack.dig(data, "caf\u00e9".b)).to eq 2
+    expect(MessagePack.dig(data, "caf\u00e9".encode("ISO-8859-1"))).to eq nil
+  end
+
+  it 'returns the value of the last duplicate key' do
+    data = [0x83].pack('C') + MessagePack.pack("a") + MessagePack.pack({ "b" => 1 }) +
+      MessagePack.pack("c") + MessagePack.pack(2) + MessagePack.pack("a") + MessagePack.pack({ "b" => 3 })
+    expect(MessagePack.unpack(data)).to eq({ "a" => { "b" => 3 }, "c" => 2 })
+    expect(MessagePack.dig(data, "a", "b")).to eq 3
+    expect(MessagePack.dig(data, "a")).to eq({ "b" => 3 })
+
+    data = [0x82].pack('C') + MessagePack.pack("a") + MessagePack.pack({ "b" => 1 }) +
+      MessagePack.pack("a") + MessagePack.pack({ "c" => 2 })
+    expect(MessagePack.dig(data, "a", "b")).to eq nil
+  end
+
+  it 'returns nil when the path is missing' do
+    expect(MessagePack.dig(data, "missing")).to eq nil
+    expect(MessagePack.dig(data, "payload", "items", 10)).to eq nil
+    expect(MessagePack.dig(data, "payload", "items", -11)).to eq nil
+    expect(MessagePack.dig(data, "payload", "items", "sku")).to eq nil
+    expect(MessagePack.dig(data, "id", "value")).to eq nil
+    expect(MessagePack.dig(data, "list", 2**64)).to eq nil
+  end
+
+  it 'consumes the whole object' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(data + data + data + MessagePack.pack("next"))
+    expect(unpacker.dig("payload", "meta", "tenant_id")).to eq "t-42"
+    expect(unpacker.dig("missing")).to eq nil
+    expect(unpacker.dig("id", "value")).to eq nil
+    expect(unpacker.read).to eq "next"
+  end
+
+  it 'reads objects spread over several chunks' do
+    unpacker = MessagePack::Unpacker.new
+    (data * 2).bytes.each_slice(7) { |bytes| unpacker.feed(bytes.pack('C*')) }
+    expect(unpacker.dig("payload", "meta", "long_key_" * 40)).to eq "long"
+    expect(unpacker.dig("list", 2)).to eq "last"
+  end
+
+  it 'reads from an IO' do
+    io = StringIO.new(data * 2)
+    unpacker = MessagePack::Unpacker.new(io, io_buffer_size: 1024)
+    expect(unpacker.dig("payload", "items", 9, "sku")).to eq "item-9"
+    expect(MessagePack.dig(StringIO.new(data), "list", 0)).to eq 1.5
+  end
+
+  it 'can be retried once more data is fed' do
+    data = MessagePack.pack({ "a" => 1, "b" => 2 })
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(data.byteslice(0, 4))
+    expect { unpacker.dig("b") }.to raise_error(EOFError)
+    unpacker.feed(data.byteslice(4..-1))
+    expect(unpacker.dig("b")).to eq 2
+
+    unpacker.feed(self.data.byteslice(0, 100))
+    expect { unpacker.dig("payload", "items", 3, "sku") }.to raise_error(EOFError)
+    self.data.byteslice(100..-1).bytes.each_slice(50) do |bytes|
+      unpacker.feed(bytes.pack('C*'))
+    end
+    expect(unpacker.dig("payload", "items", 3, "sku")).to eq "item-3"
+  end
+
+  it 'raises on an object partially read before' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(MessagePack.pack("x" * 100).byteslice(0, 20))
+    expect { unpacker.read }.to raise_error(EOFError)
+    expect { unpacker.dig("id") }.to raise_error(MessagePack::UnexpectedTypeError)
+  end
+
+  it 'raises EOFError on truncated data' do
+    expect { MessagePack.dig(data.byteslice(0, data.bytesize - 1), "list", 2) }.to raise_error(EOFError)
+  end
+
+  it 'only decodes the value at the path' do
+    factory = MessagePack::Factory.new
+    decoded = []
+    klass = Struct.new(:name)
+    factory.register_type(0x01, klass,
+      packer: ->(obj) { obj.name },
+      unpacker: ->(data) { decoded << data; klass.new(data) })
+    data = factory.dump({ "a" => klass.new("a"), "b" => [klass.new("b1"), klass.new("b2")], "c" => klass.new("c") })
+
+    unpacker = factory.unpacker
+    unpacker.feed(data)
+    expect(unpacker.dig("b", 1)).to eq klass.new("b2")
+    expect(decoded).to eq ["b2"]
+  end
+end
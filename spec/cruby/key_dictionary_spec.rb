@@ -0,0 +1,77 @@
+require 'spec_helper'
+
+describe MessagePack::KeyDictionary do
+  let(:dictionary) { MessagePack::KeyDictionary.new(["id", :name, "id"]) }
+  let(:factory) { MessagePack::Factory.new }
+  let(:data) { MessagePack.pack([{ "id" => 1, "name" => "a", "other" => 2 }, { "id" => 3 }]) }
+
+  it 'holds unique interned keys' do
+    expect(dictionary).to be_frozen
+    expect(dictionary.size).to eq 2
+    expect(dictionary.keys.sort).to eq ["id", "name"]
+    expect(dictionary.keys.all?(&:frozen?)).to eq true
+    expect(dictionary.include?("name")).to eq true
+    expect(dictionary.include?(:id)).to eq true
+    expect(dictionary.include?("other")).to eq false
+  end
+
+  it 'rejects keys other than String and Symbol' do
+    expect { MessagePack::KeyDictionary.new([1]) }.to raise_error(TypeError)
+  end
+
+  it 'can not be reinitialized' do
+    expect { dictionary.send(:initialize, ["other"]) }.to raise_error(FrozenError)
+  end
+
+  it 'is shared by the unpackers of a factory' do
+    factory.key_dictionary = dictionary
+    expect(factory.key_dictionary).to equal dictionary
+
+    first = factory.load(data)
+    second = factory.unpacker.feed(data).read
+    expect(first).to eq MessagePack.unpack(data)
+    expect(first[0].keys[0]).to equal second[1].keys[0]
+    expect(first[0].keys[0]).to equal dictionary.keys.find { |k| k == "id" }
+  end
+
+  it 'is used with symbolize_keys and key_cache' do
+    factory.key_dictionary = dictionary
+    expect(factory.load(data, symbolize_keys: true)).to eq MessagePack.unpack(data, symbolize_keys: true)
+
+    unpacker = factory.unpacker(key_cache: true)
+    unpacker.feed(data).read
+    # only the key missing from the dictionary goes through the key cache
+    expect(unpacker.key_cache_stats[:misses]).to eq 1
+  end
+
+  it 'can be assigned from a list of keys' do
+    factory.key_dictionary = %w(id name)
+    expect(factory.key_dictionary).to be_a MessagePack::KeyDictionary
+    expect(factory.key_dictionary.size).to eq 2
+
+    factory.key_dictionary = nil
+    expect(factory.key_dictionary).to be_nil
+    expect(factory.load(data)).to eq MessagePack.unpack(data)
+  end
+
+  it 'can be learned from sample payloads' do
+    factory.key_dictionary = ["first"]
+    samples = [data, MessagePack.pack({ 1 => { "nested" => [{ "deep" => 1 }] } })]
+    factory.learn_key_dictionary(samples)
+    expect(factory.key_dictionary.keys.sort).to eq %w(deep first id name nested other)
+  end
+
+  it 'is kept by dup and pools but can not be changed on a frozen factory' do
+    factory.key_dictionary = dictionary
+    expect(factory.dup.key_dictionary).to equal dictionary
+    expect(factory.pool(1).load(data)).to eq MessagePack.unpack(data)
+
+    factory.freeze
+    expect { factory.key_dictionary = nil }.to raise_error(FrozenError)
+  end
+
+  it 'is shareable between Ractors' do
+    skip "Ractor is not available" unless defined?(Ractor.make_shareable)
+    expect(Ractor.shareable?(dictionary)).to eq true
+  end
+end
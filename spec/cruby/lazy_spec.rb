@@ -0,0 +1,167 @@
+require 'spec_helper'
+require 'stringio'
+
+describe 'Unpacker#read_lazy' do
+  let(:document) do
+    {
+      "id" => 42,
+      "name" => "lazy",
+      "items" => Array.new(20) { |i| { "sku" => "item-#{i}", "qty" => i, "tags" => ["a", i.to_s] } },
+      "meta" => { "version" => 1, "nested" => [[1, 2], { "deep" => "x" * 300 }] },
+      "big" => "y" * 70_000,
+      "empty" => {},
+      "none" => [],
+    }
+  end
+  let(:data) { MessagePack.pack(document) }
+
+  def read_lazy(data, *args)
+    unpacker = MessagePack::Unpacker.new(*args)
+    unpacker.feed(data)
+    unpacker.read_lazy
+  end
+
+  it 'returns a LazyMap decoding fields on access' do
+    map = read_lazy(data)
+    expect(map).to be_a MessagePack::LazyMap
+    expect(map.size).to eq 7
+    expect(map["id"]).to eq 42
+    expect(map["name"]).to eq "lazy"
+    expect(map["big"]).to eq "y" * 70_000
+    expect(map["missing"]).to eq nil
+    expect(map.key?("meta")).to eq true
+    expect(map.include?("missing")).to eq false
+    expect(map.keys).to eq document.keys
+  end
+
+  it 'returns nested containers lazily' do
+    map = read_lazy(data)
+    items = map["items"]
+    expect(items).to be_a MessagePack::LazyArray
+    expect(items.size).to eq 20
+    expect(items[3]).to be_a MessagePack::LazyMap
+    expect(items[3]["sku"]).to eq "item-3"
+    expect(items[-1]["qty"]).to eq 19
+    expect(items[20]).to eq nil
+    expect(items[-21]).to eq nil
+    expect(map["items"]).to equal items
+    expect(map.dig("meta", "nested", 1, "deep")).to eq "x" * 300
+    expect(map.dig("meta", "missing", 1)).to eq nil
+    expect(map["empty"].to_h).to eq({})
+    expect(map["none"].to_a).to eq []
+  end
+
+  it 'converts to the eagerly unpacked objects' do
+    map = read_lazy(data)
+    expect(map.to_h).to eq document
+    expect(map["items"].to_a).to eq document["items"]
+    expect(map.each.to_a.map(&:first)).to eq document.keys
+    expect(map.values.size).to eq 7
+    expect(map["items"].map { |item| item["qty"] }).to eq (0...20).to_a
+  end
+
+  it 'supports fetch' do
+    map = read_lazy(data)
+    expect(map.fetch("id")).to eq 42
+    expect(map.fetch("missing", 1)).to eq 1
+    expect(map.fetch("missing") { |k| k * 2 }).to eq "missingmissing"
+    expect { map.fetch("missing") }.to raise_error(KeyError)
+  end
+
+  it 'reads larger containers' do
+    array = Array.new(70_000) { |i| i }
+    map = Hash[Array.new(300) { |i| ["k#{i}", [i]] }]
+    lazy_array = read_lazy(MessagePack.pack(array))
+    expect(lazy_array.size).to eq 70_000
+    expect(lazy_array[65_536]).to eq 65_536
+    expect(lazy_array.to_a).to eq array
+
+    lazy_map = read_lazy(MessagePack.pack(map))
+    expect(lazy_map["k299"][0]).to eq 299
+    expect(lazy_map.to_h).to eq map
+  end
+
+  it 'keeps the last value of duplicated keys' do
+    data = [0x82, 0xa1, 0x61, 0x01, 0xa1, 0x61, 0x02].pack('C*')
+    map = read_lazy(data)
+    expect(map["a"]).to eq 2
+    expect(map.each.to_a).to eq [["a", 2]]
+    expect(map.to_h).to eq MessagePack.unpack(data)
+  end
+
+  it 'returns other objects as read' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(MessagePack.pack("string") + MessagePack.pack(1) + MessagePack.pack([1]))
+    expect(unpacker.read_lazy).to eq "string"
+    expect(unpacker.read_lazy).to eq 1
+    expect(unpacker.read_lazy.to_a).to eq [1]
+    expect { unpacker.read_lazy }.to raise_error(EOFError)
+  end
+
+  it 'reads consecutive containers fed in pieces' do
+    unpacker = MessagePack::Unpacker.new
+    stream = data * 3
+    stream.bytes.each_slice(1000) { |bytes| unpacker.feed(bytes.pack('C*')) }
+    3.times { expect(unpacker.read_lazy.to_h).to eq document }
+  end
+
+  it 'can be retried once more data is fed' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(data.byteslice(0, 100))
+    expect { unpacker.read_lazy }.to raise_error(EOFError)
+    unpacker.feed(data.byteslice(100..-1))
+    expect(unpacker.read_lazy.to_h).to eq document
+  end
+
+  it 'reads from an IO' do
+    unpacker = MessagePack::Unpacker.new(StringIO.new(data * 2 + MessagePack.pack(7)), io_buffer_size: 1024)
+    expect(unpacker.read_lazy["meta"]["version"]).to eq 1
+    expect(unpacker.read_lazy.to_h).to eq document
+    expect(unpacker.read_lazy).to eq 7
+  end
+
+  it 'keeps the data read from an IO when it reaches its end' do
+    io = growing_io(data.byteslice(0, 5000))
+    unpacker = MessagePack::Unpacker.new(io, io_buffer_size: 1024)
+    expect { unpacker.read_lazy }.to raise_error(EOFError)
+    io << data.byteslice(5000..-1)
+    expect(unpacker.read_lazy.to_h).to eq document
+  end
+
+  it 'raises on malformed data' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed([0x92, 0x01, 0xc1].pack('C*'))
+    expect { unpacker.read_lazy }.to raise_error(MessagePack::MalformedFormatError)
+  end
+
+  it 'decodes with the options of the unpacker' do
+    map = read_lazy(data, symbolize_keys: true, freeze: true)
+    expect(map.keys).to eq document.keys.map(&:to_sym)
+    expect(map[:name]).to be_frozen
+    expect(map[:meta][:nested][1].to_h).to eq({ deep: "x" * 300 })
+  end
+
+  it 'decodes extension types registered to the factory' do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x01, Symbol)
+    data = factory.dump({ "sym" => :value, "list" => [:a, :b] })
+    unpacker = factory.unpacker
+    unpacker.feed(data)
+    map = unpacker.read_lazy
+    expect(map["sym"]).to eq :value
+    expect(map["list"][1]).to eq :b
+  end
+
+  it 'can be used from extension type procs' do
+    factory = MessagePack::Factory.new
+    outer = nil
+    factory.register_type(0x01, Object,
+      packer: ->(_) { "" },
+      unpacker: ->(_) { outer["id"] })
+    data = factory.dump({ "id" => 7, "other" => [Object.new, Object.new] })
+    unpacker = factory.unpacker
+    unpacker.feed(data)
+    outer = unpacker.read_lazy
+    expect(outer["other"].to_a).to eq [7, 7]
+  end
+end
@@ -0,0 +1,75 @@
+require 'spec_helper'
+require 'objspace'
+
+describe 'MessagePack.memory_stats' do
+  def buffer_pages_in_use
+    MessagePack.memory_stats[:buffer].sum { |pool| pool[:pages_in_use] }
+  end
+
+  it 'reports the pools of each size class' do
+    stats = MessagePack.memory_stats
+    expect(stats[:buffer].map { |pool| pool[:page_size] }).to eq [4096, 16384, 65536, 262144]
+    expect(stats[:unpacker_stack].map { |pool| pool[:page_size] }).to eq [4096]
+    (stats[:buffer] + stats[:unpacker_stack]).each do |pool|
+      expect(pool.keys).to eq [:page_size, :chunks, :pages, :pages_in_use, :bytes]
+      expect(pool[:pages_in_use]).to be <= pool[:pages]
+      expect(pool[:bytes]).to eq pool[:pages] * pool[:page_size]
+    end
+  end
+
+  it 'reports the pages in use by buffers' do
+    string = ("x" * 20_000).b
+    GC.disable # other buffers may be freed meanwhile
+    begin
+      in_use = buffer_pages_in_use
+      packer = MessagePack::Packer.new
+      packer.write(string)
+      expect(buffer_pages_in_use).to eq in_use + 2 # the header and a part of the body in a 4KB page, the rest in a 16KB page
+      packer.reset
+      expect(buffer_pages_in_use).to eq in_use
+    ensure
+      GC.enable
+    end
+  end
+
+  it 'accounts the chunks kept for reuse by a buffer' do
+    buffer = MessagePack::Buffer.new(write_reference_threshold: 256)
+    empty_size = ObjectSpace.memsize_of(buffer)
+    100.times { buffer << ("x" * 300) }
+    buffer.clear
+    expect(ObjectSpace.memsize_of(buffer)).to be > empty_size
+  end
+end
+
+describe 'MessagePack.trim_memory' do
+  it 'frees the chunks without pages in use' do
+    packers = Array.new(40) { MessagePack::Packer.new.write(("x" * 200_000).b) }
+    packers.each(&:reset)
+
+    # the 40 pages of 256KB take 10 chunks, and the pools keep 2 of them after use
+    expect(MessagePack.trim_memory).to be >= 2 * 262144 * 4
+    (MessagePack.memory_stats[:buffer] + MessagePack.memory_stats[:unpacker_stack]).each do |pool|
+      expect(pool[:chunks]).to be <= pool[:pages_in_use]
+    end
+    expect(MessagePack.trim_memory).to eq 0
+  end
+
+  it 'keeps the pools usable' do
+    MessagePack.trim_memory
+    object = { "small" => "x" * 100, "large" => ("y" * 100_000).b, "nested" => [[[1]]] }
+    expect(MessagePack.unpack(MessagePack.pack(object))).to eq object
+    expect(MessagePack.memory_stats[:buffer].sum { |pool| pool[:chunks] }).to be > 0
+  end
+
+  it 'does nothing outside the main Ractor' do
+    skip "Ractor is not available" unless defined?(Ractor.make_shareable)
+    experimental, Warning[:experimental] = Warning[:experimental], false
+    begin
+      stats, freed = Ractor.new { [MessagePack.memory_stats, MessagePack.trim_memory] }.take
+    ensure
+      Warning[:experimental] = experimental
+    end
+    expect(stats).to eq({ buffer: [], unpacker_stack: [] })
+    expect(freed).to eq 0
+  end
+end
@@ -0,0 +1,58 @@
+require 'spec_helper'
+require 'objspace'
+
+describe 'Memory accounting' do
+  let(:binary) { ("x" * 20_000).b }
+
+  it 'reports the pages and the malloc()ed memory of buffer chunks' do
+    buffer = MessagePack::Buffer.new
+    empty_size = ObjectSpace.memsize_of(buffer)
+
+    buffer << binary
+    expect(ObjectSpace.memsize_of(buffer)).to eq empty_size + 65536
+
+    buffer.clear
+    buffer << ("y" * 300_000)
+    expect(ObjectSpace.memsize_of(buffer)).to be >= empty_size + 300_000
+  end
+
+  it 'reports the buffer of packers' do
+    packer = MessagePack::Packer.new
+    empty_size = ObjectSpace.memsize_of(packer)
+    packer.write(binary)
+    # the header and the first 4KB of the string in a 4KB page, the rest in a 16KB page
+    memsize = ObjectSpace.memsize_of(packer) - empty_size
+    expect(memsize).to be >= 4096 + 16384
+    expect(memsize).to be < 4096 + 16384 + 128 # and a chunk struct
+    packer.reset
+    expect(ObjectSpace.memsize_of(packer)).to be < empty_size + 128
+  end
+
+  it 'reports the stack of unpackers' do
+    unpacker = MessagePack::Unpacker.new
+    empty_size = ObjectSpace.memsize_of(unpacker)
+    unpacker.feed([0x92, 0x01].pack('C*'))
+    unpacker.each {}
+    # the partially read Array keeps the stack
+    expect(ObjectSpace.memsize_of(unpacker)).to eq empty_size + 4096
+  end
+
+  it 'reports the pages in use to the GC' do
+    skip "GC.stat(:malloc_increase_bytes) is not available" unless GC.stat.key?(:malloc_increase_bytes)
+
+    packer = MessagePack::Packer.new
+    packer.write(binary).reset # allocates the chunk structs
+    GC.disable
+    begin
+      before = GC.stat(:malloc_increase_bytes)
+      packer.write(binary)
+      written = GC.stat(:malloc_increase_bytes)
+      packer.reset
+      after = GC.stat(:malloc_increase_bytes)
+    ensure
+      GC.enable
+    end
+    expect(written - before).to be_within(256).of(4096 + 16384)
+    expect(written - after).to be_within(256).of(4096 + 16384)
+  end
+end
@@ -0,0 +1,9 @@
+# Builds an extension using the MessagePack::NativeExt C API for
+# spec/cruby/native_ext_spec.rb.
+require 'mkmf'
+
+have_func("rb_ext_resolve_symbol", "ruby.h") # Ruby 3.3+
+have_func("rb_ext_ractor_safe", "ruby.h") # Ruby 3.0+
+$INCFLAGS << " -I#{File.expand_path('../../../ext/msgpack', __dir__)}"
+
+create_makefile("msgpack_native_ext_test")
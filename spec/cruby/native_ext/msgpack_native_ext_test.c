@@ -0,0 +1,73 @@
+#include "ruby.h"
+#include "native_ext.h"
+
+#include <string.h>
+
+static VALUE cBlob;
+static VALUE cLiar;
+
+/* Blob: a Struct whose data is the payload, raising on "raise" */
+static size_t blob_pack(VALUE object, char* dest, size_t capacity, void* data)
+{
+    VALUE str = rb_struct_aref(object, INT2FIX(0));
+    StringValue(str);
+    size_t length = RSTRING_LEN(str);
+    if(length == 5 && memcmp(RSTRING_PTR(str), "raise", 5) == 0) {
+        rb_raise(rb_eArgError, "can't pack %s", (const char*)data);
+    }
+    if(length <= capacity) {
+        memcpy(dest, RSTRING_PTR(str), length);
+    }
+    return length;
+}
+
+static VALUE blob_unpack(const char* payload, size_t length, void* data)
+{
+    if(length == 5 && memcmp(payload, "raise", 5) == 0) {
+        rb_raise(rb_eArgError, "can't unpack %s", (const char*)data);
+    }
+    return rb_struct_new(cBlob, rb_str_new(payload, length));
+}
+
+static const msgpack_native_ext_t blob_ext = {
+    MSGPACK_NATIVE_EXT_ABI_VERSION, "Blob", blob_pack, blob_unpack, (void*)"a blob"
+};
+
+/* Liar: asks for more room every time */
+static size_t liar_pack(VALUE object, char* dest, size_t capacity, void* data)
+{
+    return capacity + 1;
+}
+
+static const msgpack_native_ext_t liar_ext = {
+    MSGPACK_NATIVE_EXT_ABI_VERSION, "Liar", liar_pack, NULL, NULL
+};
+
+static const msgpack_native_ext_t unpack_only_ext = {
+    MSGPACK_NATIVE_EXT_ABI_VERSION, "UnpackOnly", NULL, blob_unpack, (void*)"an unpack only blob"
+};
+
+static const msgpack_native_ext_t future_ext = {
+    MSGPACK_NATIVE_EXT_ABI_VERSION + 1, "Future", blob_pack, blob_unpack, NULL
+};
+
+static VALUE future_native_ext(VALUE self)
+{
+    return msgpack_native_ext_new(&future_ext);
+}
+
+void Init_msgpack_native_ext_test(void)
+{
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    rb_ext_ractor_safe(true);
+#endif
+
+    VALUE mTest = rb_define_module("MessagePackNativeExtTest");
+    cBlob = rb_struct_define_under(mTest, "Blob", "data", NULL);
+    cLiar = rb_struct_define_under(mTest, "Liar", "data", NULL);
+
+    rb_define_const(mTest, "BLOB", msgpack_native_ext_new(&blob_ext));
+    rb_define_const(mTest, "LIAR", msgpack_native_ext_new(&liar_ext));
+    rb_define_const(mTest, "UNPACK_ONLY", msgpack_native_ext_new(&unpack_only_ext));
+    rb_define_module_function(mTest, "future_native_ext", future_native_ext, 0);
+}
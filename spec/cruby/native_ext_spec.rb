@@ -0,0 +1,106 @@
+require 'spec_helper'
+require 'rbconfig'
+require 'tmpdir'
+
+describe MessagePack::NativeExt do
+  before(:all) do
+    unless defined?(MessagePackNativeExtTest)
+      source = File.expand_path('native_ext', __dir__)
+      @build_dir = Dir.mktmpdir('msgpack_native_ext')
+      built = system(RbConfig.ruby, File.join(source, 'extconf.rb'), chdir: @build_dir, out: File::NULL, err: File::NULL) &&
+              system('make', "srcdir=#{source}", chdir: @build_dir, out: File::NULL, err: File::NULL)
+      require File.join(@build_dir, "msgpack_native_ext_test.#{RbConfig::CONFIG['DLEXT']}") if built
+    end
+  end
+
+  after(:all) do
+    FileUtils.rm_rf(@build_dir) if @build_dir
+  end
+
+  before do
+    skip "can't build the test extension" unless defined?(MessagePackNativeExtTest)
+  end
+
+  let(:blob) { MessagePackNativeExtTest::Blob }
+  let(:factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x01, blob, packer: MessagePackNativeExtTest::BLOB, unpacker: MessagePackNativeExtTest::BLOB)
+    factory
+  end
+
+  def ext(type, data)
+    MessagePack.pack(MessagePack::ExtensionValue.new(type, data))
+  end
+
+  it 'describes the C functions it wraps' do
+    expect(MessagePackNativeExtTest::BLOB.name).to eq "Blob"
+    expect(MessagePackNativeExtTest::BLOB).to be_frozen
+    expect(MessagePackNativeExtTest::UNPACK_ONLY.packer?).to eq false
+    expect(MessagePackNativeExtTest::UNPACK_ONLY.unpacker?).to eq true
+    expect(MessagePackNativeExtTest::BLOB.inspect).to eq '#<MessagePack::NativeExt "Blob">'
+    expect { MessagePack::NativeExt.new }.to raise_error(TypeError)
+  end
+
+  it 'packs and unpacks payloads of any size' do
+    [0, 1, 16, 255, 256, 257, 70_000].each do |size|
+      data = "b".b * size
+      expect(factory.dump(blob.new(data))).to eq ext(1, data)
+      expect(factory.load(ext(1, data))).to eq blob.new(data)
+      expect(factory.load(factory.dump([blob.new(data), blob.new("x")]))).to eq [blob.new(data), blob.new("x")]
+    end
+  end
+
+  it 'unpacks payloads fed in pieces' do
+    objects = Array.new(50) { |i| blob.new("p" * i) }
+    unpacker = factory.unpacker
+    result = []
+    factory.dump(objects).bytes.each_slice(7) { |bytes| unpacker.feed_each(bytes.pack('C*')) { |object| result << object } }
+    expect(result).to eq [objects]
+  end
+
+  it 'measures the size of native payloads' do
+    expect(factory.packed_size(blob.new("x" * 300))).to eq ext(1, "x" * 300).bytesize
+  end
+
+  it 'propagates the errors of the C functions' do
+    expect { factory.dump(blob.new("raise")) }.to raise_error(ArgumentError, "can't pack a blob")
+    expect { factory.load(ext(1, "raise")) }.to raise_error(ArgumentError, "can't unpack a blob")
+  end
+
+  it 'raises when the packer keeps asking for more room' do
+    factory.register_type(0x02, MessagePackNativeExtTest::Liar, packer: MessagePackNativeExtTest::LIAR, unpacker: nil)
+    expect { factory.dump(MessagePackNativeExtTest::Liar.new) }.to raise_error(RuntimeError, /Liar asked for 257 bytes/)
+  end
+
+  it 'validates the registration' do
+    expect { factory.register_type(0x02, Class.new, packer: MessagePackNativeExtTest::UNPACK_ONLY, unpacker: nil) }.to raise_error(ArgumentError, /no pack function/)
+    expect { factory.register_type(0x02, Class.new, packer: nil, unpacker: MessagePackNativeExtTest::LIAR) }.to raise_error(ArgumentError, /no unpack function/)
+    expect { factory.register_type(0x02, Class.new, packer: MessagePackNativeExtTest::BLOB, unpacker: nil, recursive: true) }.to raise_error(ArgumentError)
+    expect { factory.register_type(0x02, Class.new, packer: nil, unpacker: MessagePackNativeExtTest::BLOB, payload: :view) }.to raise_error(ArgumentError)
+    expect { MessagePackNativeExtTest.future_native_ext }.to raise_error(ArgumentError, /ABI version/)
+  end
+
+  it 'mixes with Ruby procs' do
+    factory.register_type(0x02, Symbol, packer: :to_s.to_proc, unpacker: MessagePackNativeExtTest::BLOB)
+    expect(factory.load(factory.dump(:sym))).to eq blob.new("sym")
+    expect(factory.registered_types.first).to eq(type: 0x01, class: blob, packer: MessagePackNativeExtTest::BLOB, unpacker: MessagePackNativeExtTest::BLOB)
+  end
+
+  it 'is shareable between Ractors' do
+    skip "Ractor isn't available" unless defined?(Ractor)
+    experimental, Warning[:experimental] = Warning[:experimental], false
+    objects = Array.new(100) { |i| blob.new("r" * i) }
+    data = objects.map { |object| factory.dump(object) }.join
+    expect(factory.unpack_all_parallel(data, workers: 2)).to eq objects
+  ensure
+    Warning[:experimental] = experimental if defined?(Ractor)
+  end
+
+  it 'allocates no String for the payloads' do
+    data = factory.dump(Array.new(100) { |i| blob.new("") })
+    factory.load(data)
+    allocated = GC.stat(:total_allocated_objects)
+    factory.load(data)
+    expect(GC.stat(:total_allocated_objects) - allocated).to be < 220
+  end
+end
@@ -0,0 +1,62 @@
+require 'spec_helper'
+
+describe 'Packer numeric Arrays' do
+  let(:packer) { MessagePack::Packer.new }
+  let(:integers) do
+    [0, 1, -1, 31, -32, -33, 127, 128, 255, 256, -128, -129, 65535, 65536, -32768, -32769,
+     2**31 - 1, 2**31, -2**31, -2**31 - 1, 2**32 - 1, 2**32, 2**62 - 1, -2**62, 2**64 - 1, -2**63]
+  end
+  let(:floats) { [0.0, -0.0, 1.5, -2.25, 1e300, Float::INFINITY, 1.0 / 3] }
+
+  def pack_each(array, &block)
+    packer = MessagePack::Packer.new
+    packer.write_array_header(array.size)
+    array.each { |e| block ? block.call(packer, e) : packer.write(e) }
+    packer.to_s
+  end
+
+  it 'packs large Arrays of Integers and Floats as elementwise' do
+    array = Array.new(20_000) { |i| i.even? ? integers[i % integers.size] : floats[i % floats.size] }
+    expect(MessagePack.pack(array)).to eq pack_each(array)
+    expect(MessagePack.unpack(MessagePack.pack(array))).to eq array
+  end
+
+  it 'packs Arrays mixing numbers with other objects' do
+    array = Array.new(3_000) { |i| [1, 2.5, "s", nil, [3, 4.5], { "k" => -7 }, 2**70 % 2**64][i % 7] }
+    expect(MessagePack.pack(array)).to eq pack_each(array)
+  end
+
+  it 'writes every element as a double with #write_float_array' do
+    array = [1, 2.5, -3, 2**70, Rational(1, 4)] + floats
+    packer.write_float_array(array)
+    expect(packer.to_s).to eq pack_each(array) { |pk, e| pk.write_float(e.to_f) }
+    expect { MessagePack::Packer.new.write_float_array([1.0, "x"]) }.to raise_error(TypeError)
+    expect { MessagePack::Packer.new.write_float_array(1.0) }.to raise_error(TypeError)
+  end
+
+  it 'writes Integers with #write_int_array' do
+    array = integers * 100
+    packer.write_int_array(array)
+    expect(packer.to_s).to eq pack_each(array)
+    expect { MessagePack::Packer.new.write_int_array([1, 1.5]) }.to raise_error(TypeError, /found Float/)
+    expect { MessagePack::Packer.new.write_int_array([1, nil]) }.to raise_error(TypeError, /found NilClass/)
+  end
+
+  it 'reads the array again after flushing to an IO' do
+    array = Array.new(100_000) { |i| i * 0.5 }
+    out = "".b
+    io = Object.new
+    io.define_singleton_method(:write) do |*chunks|
+      array.clear
+      chunks.each { |chunk| out << chunk }
+      chunks.sum(&:bytesize)
+    end
+
+    packer = MessagePack::Packer.new(io)
+    packer.write(array).flush
+    result = MessagePack.unpack(out)
+    expect(result.size).to eq 100_000
+    expect(result.first).to eq 0.0
+    expect(result.last).to eq nil
+  end
+end
@@ -0,0 +1,103 @@
+require 'spec_helper'
+
+describe 'MessagePack.packed_size' do
+  let(:objects) do
+    [
+      nil, true, false, 0, -1, 127, 128, -32, -33, 255, 256, 65536, -2**31 - 1, 2**40, -2**40, 2**64 - 1, -2**63,
+      1.5, "", "a" * 31, "a" * 32, "a" * 255, "a" * 256, "a" * 70_000, "bin".b * 100, "\xE9".force_encoding("ISO-8859-1"),
+      :symbol, Array.new(20) { |i| i * 1.5 }, Array.new(70_000) { 0 }, { "k" => { 1 => [nil, "v"] } },
+      Hash[(1..20).map { |i| [i.to_s, i] }], MessagePack::ExtensionValue.new(5, "x" * 300),
+    ]
+  end
+
+  it 'returns the size of the packed object' do
+    objects.each do |object|
+      expect(MessagePack.packed_size(object)).to eq MessagePack.pack(object).bytesize
+    end
+    expect(MessagePack.packed_size(objects)).to eq MessagePack.pack(objects).bytesize
+  end
+
+  it 'follows the options of the packer' do
+    objects.each do |object|
+      expect(MessagePack.packed_size(object, compatibility_mode: true)).to eq MessagePack.pack(object, compatibility_mode: true).bytesize
+    end
+  end
+
+  it 'measures extension types and to_msgpack' do
+    point = Class.new do
+      def to_msgpack(packer)
+        packer.write_array_header(2).write(1).write("two")
+      end
+    end
+    tree = Struct.new(:value, :children)
+    reversed = Class.new(String)
+    factory = MessagePack::Factory.new
+    factory.register_type(0x00, Symbol)
+    factory.register_type(0x01, tree, packer: ->(t, pk) { pk.write(t.to_a) }, unpacker: ->(u) { tree.new(*u.read) }, recursive: true)
+    factory.register_type(0x02, reversed, packer: :reverse)
+    factory.register_type(-1, Time, native: true)
+    factory.register_type(0x03, Integer, native: true, oversized_integer_extension: true)
+
+    document = [
+      :symbol, tree.new(1, [tree.new(2, [])]), point.new, Time.at(1), Time.at(1, 5, :nsec), Time.at(-1),
+      2**100, -2**100, reversed.new("string"), { nested: [point.new, 2**70] },
+    ]
+    document.each do |object|
+      expect(factory.packed_size(object)).to eq factory.dump(object).bytesize
+    end
+    expect(factory.packed_size(document)).to eq factory.dump(document).bytesize
+    expect(factory.pool(1).packed_size(document)).to eq factory.dump(document).bytesize
+  end
+
+  it 'does not write to the packer' do
+    packer = MessagePack::Packer.new
+    packer.write(1)
+    expect(packer.packed_size([2, "three"])).to eq 8
+    expect(packer.to_s).to eq "\x01"
+  end
+
+  describe 'exact_size option' do
+    it 'packs into a String of the exact size' do
+      objects.each do |object|
+        expect(MessagePack.pack(object, exact_size: true)).to eq MessagePack.pack(object)
+      end
+      packed = MessagePack.pack(objects, exact_size: true)
+      expect(packed).to eq MessagePack.pack(objects)
+      expect(packed.encoding).to eq Encoding::BINARY
+    end
+
+    it 'keeps long strings copied only once' do
+      document = Array.new(3) { |i| { "id" => i, "blob" => ("x" * 1_000_000).b } }
+      packer = MessagePack::Packer.new(exact_size: true)
+      packer.write(document)
+      expect(packer.to_a.size).to eq 1
+      expect(packer.full_pack).to eq MessagePack.pack(document)
+      expect(packer.write(document).to_s).to eq MessagePack.pack(document)
+    end
+
+    it 'runs extension type packers and to_msgpack once' do
+      calls = Hash.new(0)
+      point = Class.new do
+        define_method(:to_msgpack) do |packer|
+          calls[:to_msgpack] += 1
+          packer.write_array_header(2).write(1).write("two")
+        end
+      end
+      tree = Struct.new(:value, :children)
+      factory = MessagePack::Factory.new
+      factory.register_type(0x00, Symbol, packer: ->(s) { calls[:symbol] += 1; s.to_s })
+      factory.register_type(0x01, tree, packer: ->(t, pk) { calls[:tree] += 1; pk.write(t.to_a) }, unpacker: ->(u) { tree.new(*u.read) }, recursive: true)
+
+      document = [:symbol, { "k" => [point.new, tree.new(1, [tree.new(2, [:leaf])])] }, "x" * 100, 2**40]
+      packed = factory.packer(exact_size: true).write(document).to_s
+      expect(calls).to eq(to_msgpack: 1, symbol: 2, tree: 2)
+      expect(packed).to eq factory.dump(document)
+    end
+
+    it 'packs objects written after the first one' do
+      packer = MessagePack::Packer.new(exact_size: true)
+      packer.write([1, 2]).write("three")
+      expect(packer.to_s).to eq MessagePack.pack([1, 2]) + MessagePack.pack("three")
+    end
+  end
+end
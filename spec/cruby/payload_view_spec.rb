@@ -0,0 +1,93 @@
+require 'spec_helper'
+
+describe MessagePack::PayloadView do
+  let(:uuid) { Struct.new(:hi, :lo) }
+  let(:factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x01, uuid, packer: ->(u) { [u.hi, u.lo].pack('Q>Q>') },
+                          unpacker: ->(view) { uuid.new(view.u64be(0), view.u64be(8)) }, payload: :view)
+    factory
+  end
+
+  def ext(type, data)
+    MessagePack.pack(MessagePack::ExtensionValue.new(type, data))
+  end
+
+  def load_view(data, &block)
+    factory = MessagePack::Factory.new
+    factory.register_type(0x02, Class.new, packer: nil, unpacker: block, payload: :view)
+    factory.load(ext(2, data))
+  end
+
+  it 'reads big-endian numbers' do
+    data = [0xfe].pack('C') + [-2].pack('c') + [0xfffe, -2].pack('S>s>') + [0xfffffffe, -2].pack('L>l>') +
+           [2**64 - 2, -2].pack('Q>q>') + [1.5].pack('g') + [-2.25].pack('G')
+    values = load_view(data) do |view|
+      [view.u8(0), view.i8(1), view.u16be(2), view.i16be(4), view.u32be(6), view.i32be(10),
+       view.u64be(14), view.i64be(22), view.f32be(30), view.f64be(34), view.bytesize]
+    end
+    expect(values).to eq [0xfe, -2, 0xfffe, -2, 0xfffffffe, -2, 2**64 - 2, -2, 1.5, -2.25, 42]
+  end
+
+  it 'copies bytes out of the payload' do
+    expect(load_view("abcdef") { |view| [view.to_s, view.byteslice(2, 3), view.byteslice(6, 0)] }).to eq ["abcdef", "cde", ""]
+    expect(load_view("abcdef") { |view| view.to_s.encoding }).to eq Encoding::BINARY
+    expect(load_view("") { |view| [view.bytesize, view.to_s] }).to eq [0, ""]
+  end
+
+  it 'reads payloads fed in pieces and large payloads' do
+    data = Array.new(200) { |i| [i * 1000, i].pack('Q>Q>') }
+    packed = data.map { |d| ext(1, d) }.join
+    unpacker = factory.unpacker
+    result = []
+    packed.bytes.each_slice(7) { |bytes| unpacker.feed_each(bytes.pack('C*')) { |object| result << object } }
+    expect(result).to eq Array.new(200) { |i| uuid.new(i * 1000, i) }
+
+    large = (0...1000).map { |i| i % 256 }.pack('C*')
+    expect(load_view(large) { |view| [view.bytesize, view.u8(999), view.to_s] }).to eq [1000, 999 % 256, large]
+  end
+
+  it 'raises on out of range offsets' do
+    expect { load_view("abcd") { |view| view.u32be(1) } }.to raise_error(IndexError)
+    expect { load_view("abcd") { |view| view.u8(-1) } }.to raise_error(IndexError)
+    expect { load_view("abcd") { |view| view.byteslice(3, 2) } }.to raise_error(IndexError)
+    expect(load_view("abcd") { |view| view.u32be(0) }).to eq 0x61626364
+  end
+
+  it 'is only readable during the call of the proc' do
+    kept = load_view("abcd") { |view| view }
+    expect { kept.bytesize }.to raise_error(RuntimeError, /only readable in the unpacker proc/)
+    expect { kept.u8(0) }.to raise_error(RuntimeError)
+  end
+
+  it 'reuses one view per unpacker' do
+    views = []
+    factory = MessagePack::Factory.new
+    factory.register_type(0x02, Class.new, packer: nil, unpacker: ->(view) { views << view.object_id; view.u8(0) }, payload: :view)
+    expect(factory.load(MessagePack.pack(Array.new(10) { |i| MessagePack::ExtensionValue.new(2, i.chr) }))).to eq (0...10).to_a
+    expect(views.uniq.size).to eq 1
+  end
+
+  it 'allocates no String for small payloads' do
+    data = MessagePack.pack(Array.new(100) { |i| MessagePack::ExtensionValue.new(1, [i, i].pack('Q>Q>')) })
+    unpacker = factory.unpacker
+    unpacker.feed(data)
+    unpacker.read
+    unpacker.feed(data)
+
+    allocated = GC.stat(:total_allocated_objects)
+    result = unpacker.read
+    expect(GC.stat(:total_allocated_objects) - allocated).to be < 110
+    expect(result.last).to eq uuid.new(99, 99)
+  end
+
+  it 'propagates the errors of the proc' do
+    expect { load_view("abcd") { |view| raise ArgumentError, "bad payload" } }.to raise_error(ArgumentError, "bad payload")
+  end
+
+  it 'validates the payload option' do
+    expect { factory.register_type(0x03, Class.new, packer: nil, unpacker: ->(v) { v }, payload: :bogus) }.to raise_error(ArgumentError)
+    expect { factory.register_type(0x03, Class.new, packer: nil, unpacker: ->(u) { u.read }, payload: :view, recursive: true) }.to raise_error(ArgumentError)
+    expect { factory.register_type(0x03, Class.new, packer: nil, unpacker: ->(s) { s }, payload: :string) }.not_to raise_error
+  end
+end
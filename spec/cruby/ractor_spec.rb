@@ -0,0 +1,100 @@
+require 'spec_helper'
+
+describe 'Ractor support' do
+  before do
+    skip "Ractor is not available" unless defined?(Ractor.make_shareable)
+    @experimental, Warning[:experimental] = Warning[:experimental], false
+  end
+
+  after do
+    Warning[:experimental] = @experimental unless @experimental.nil?
+  end
+
+  let(:factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x00, Symbol)
+    factory.register_type(-1, Time, native: true)
+    factory
+  end
+  let(:document) do
+    {
+      "symbol" => :value,
+      "time" => Time.at(1_700_000_000, 123_456, :nsec),
+      "long" => "x" * 10_000,
+      "nested" => Array.new(50) { |i| { "i" => i, "list" => [i, [i]] } },
+    }
+  end
+
+  it 'makes a Factory shareable' do
+    Ractor.make_shareable(factory)
+    expect(Ractor.shareable?(factory)).to eq true
+    expect(factory).to be_frozen
+    expect { factory.register_type(0x01, Integer) }.to raise_error(FrozenError)
+  end
+
+  it 'packs and unpacks in several Ractors with a shareable Factory' do
+    Ractor.make_shareable(factory)
+    data = Ractor.make_shareable(factory.dump(document))
+
+    ractors = Array.new(4) do
+      Ractor.new(factory, data) do |factory, data|
+        results = Array.new(20) { factory.load(factory.dump(factory.load(data))) }
+        results.uniq.size == 1 ? factory.dump(results.first) : nil
+      end
+    end
+
+    ractors.each do |ractor|
+      expect(factory.load(ractor.take)).to eq document
+    end
+  end
+
+  it 'uses packers and unpackers created in other Ractors' do
+    Ractor.make_shareable(factory)
+    data = Ractor.make_shareable(factory.dump(document) * 3)
+
+    ractor = Ractor.new(factory, data) do |factory, data|
+      unpacker = factory.unpacker
+      data.bytes.each_slice(100) { |bytes| unpacker.feed(bytes.pack('C*')) }
+      packer = factory.packer
+      unpacker.each { |object| packer.write(object) }
+      packer.to_s
+    end
+
+    expect(ractor.take).to eq data
+  end
+
+  it 'returns the pages freed by a GC run from another Ractor to the pools' do
+    pages_in_use = -> { MessagePack.memory_stats[:buffer].sum { |pool| pool[:pages_in_use] } }
+    ractor = Ractor.new { Ractor.receive; GC.start; true }
+    GC.start
+    before = pages_in_use.call
+
+    GC.disable
+    buffers = Array.new(100) { MessagePack::Buffer.new.tap { |b| b << "x" * 3000 } }
+    expect(pages_in_use.call).to eq before + 100
+    buffers = nil
+    GC.enable
+
+    ractor.send(buffers)
+    ractor.take
+    MessagePack::Buffer.new << "y"
+    expect(pages_in_use.call).to be <= before + 1
+  end
+
+  it 'uses its own lookup cache for subclasses in each Ractor' do
+    klass = Class.new(Struct.new(:value)) do
+      def to_msgpack_ext
+        value.to_s
+      end
+    end
+    subclass = Class.new(klass)
+    factory.register_type(0x01, klass, packer: :to_msgpack_ext, unpacker: nil)
+    Ractor.make_shareable(factory)
+
+    ractor = Ractor.new(factory, subclass) do |factory, subclass|
+      factory.dump(subclass.new(1))
+    end
+
+    expect(ractor.take).to eq factory.dump(subclass.new(1))
+  end
+end
@@ -0,0 +1,121 @@
+require 'spec_helper'
+require 'objspace'
+require 'stringio'
+
+describe 'Unpacker#read_raw' do
+  let(:objects) do
+    [
+      1, -1, 2**64 - 1, 1.5, nil, true, "str", "x" * 300, "y".b * 70_000,
+      [], {}, [1, [2, [3]]], { "a" => { "b" => [nil, "c"] } },
+      MessagePack::ExtensionValue.new(1, "ext"),
+    ]
+  end
+  let(:packed) { objects.map { |object| MessagePack.pack(object) } }
+
+  it 'returns the encoded bytes of the next object' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(packed.join)
+    raws = packed.map { unpacker.read_raw }
+    expect(raws).to eq packed
+    expect(raws.map(&:encoding).uniq).to eq [Encoding::BINARY]
+    expect { unpacker.read_raw }.to raise_error(EOFError)
+  end
+
+  it 'reads objects spread over several chunks' do
+    unpacker = MessagePack::Unpacker.new
+    raws = []
+    packed.join.bytes.each_slice(7) do |bytes|
+      unpacker.feed(bytes.pack('C*'))
+      loop do
+        raws << unpacker.read_raw
+      rescue EOFError
+        break
+      end
+    end
+    expect(raws).to eq packed
+  end
+
+  it 'reads from an IO' do
+    unpacker = MessagePack::Unpacker.new(StringIO.new(packed.join), io_buffer_size: 1024)
+    expect(packed.map { unpacker.read_raw }).to eq packed
+  end
+
+  it 'keeps the data read from an IO when it reaches its end' do
+    data = MessagePack.pack(objects)
+    io = growing_io(data.byteslice(0, 5000))
+    unpacker = MessagePack::Unpacker.new(io, io_buffer_size: 1024)
+    expect { unpacker.read_raw }.to raise_error(EOFError)
+    io << data.byteslice(5000..-1)
+    expect(unpacker.read_raw).to eq data
+  end
+
+  it 'takes back a head byte read before running out of data' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed([0xcd, 0x01].pack('C*'))
+    expect { unpacker.read }.to raise_error(EOFError)
+    unpacker.feed([0x02, 0x03].pack('C*'))
+    expect(unpacker.read_raw).to eq [0xcd, 0x01, 0x02].pack('C*')
+    expect(unpacker.read).to eq 3
+  end
+
+  it 'refers to the fed String' do
+    data = MessagePack.pack(["z" * 100_000]).freeze
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed_reference(data)
+    raw = unpacker.read_raw
+    expect(raw).to eq data
+    expect(ObjectSpace.memsize_of(raw)).to be < 1000
+  end
+
+  it 'raises on malformed data' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed([0x92, 0x01, 0xc1].pack('C*'))
+    expect { unpacker.read_raw }.to raise_error(MessagePack::MalformedFormatError)
+  end
+end
+
+describe 'Unpacker raw_keys option' do
+  let(:body) { { "items" => [1, "two", { "three" => 3.0 }], "blob" => "b" * 5000 } }
+  let(:envelope) { { "id" => 42, "body" => body, "nested" => { "body" => [1, 2] }, "tail" => "end" } }
+  let(:data) { MessagePack.pack(envelope) }
+
+  def expected(envelope)
+    envelope.merge("body" => MessagePack.pack(envelope["body"]), "nested" => { "body" => MessagePack.pack([1, 2]) })
+  end
+
+  it 'reads the values of the raw keys as their encoded bytes' do
+    expect(MessagePack.unpack(data, raw_keys: ["body"])).to eq expected(envelope)
+    expect(MessagePack.unpack(data, raw_keys: [:body, "tail"])).to eq expected(envelope).merge("tail" => MessagePack.pack("end"))
+    expect(MessagePack.unpack(data, raw_keys: [])).to eq envelope
+  end
+
+  it 'reads maps fed in pieces' do
+    unpacker = MessagePack::Unpacker.new(raw_keys: ["body"])
+    result = []
+    (data * 3).bytes.each_slice(5) { |bytes| unpacker.feed_each(bytes.pack('C*')) { |object| result << object } }
+    expect(result).to eq [expected(envelope)] * 3
+  end
+
+  it 'applies with other options' do
+    result = MessagePack.unpack(data, raw_keys: ["body"], symbolize_keys: true, freeze: true)
+    expect(result[:body]).to eq MessagePack.pack(body)
+    expect(result[:body]).to be_frozen
+    expect(result[:id]).to eq 42
+
+    factory = MessagePack::Factory.new
+    expect(factory.unpacker(raw_keys: ["body"]).feed(data).read).to eq expected(envelope)
+  end
+
+  it 'applies to lazily read maps' do
+    unpacker = MessagePack::Unpacker.new(raw_keys: ["body"])
+    unpacker.feed(data)
+    lazy = unpacker.read_lazy
+    expect(lazy["body"]).to eq MessagePack.pack(body)
+    expect(lazy["nested"]["body"]).to eq MessagePack.pack([1, 2])
+    expect(lazy.to_h).to eq expected(envelope)
+  end
+
+  it 'expects an Array' do
+    expect { MessagePack::Unpacker.new(raw_keys: "body") }.to raise_error(TypeError)
+  end
+end
@@ -0,0 +1,80 @@
+require 'spec_helper'
+
+describe 'Recursive extension types' do
+  let(:raw) { Struct.new(:data) }
+  let(:node) { Struct.new(:value, :child) }
+  let(:failing) { Struct.new(:size) }
+  let(:factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x01, raw, packer: ->(r, packer) { packer.buffer << r.data }, unpacker: nil, recursive: true)
+    factory.register_type(0x02, node, packer: ->(n, packer) { packer.write_array_header(2).write(n.value).write(n.child) },
+                          unpacker: ->(u) { node.new(*u.read) }, recursive: true)
+    factory.register_type(0x03, failing, packer: ->(f, packer) { packer.write("x" * f.size); raise ArgumentError, "failing" },
+                          unpacker: nil, recursive: true)
+    factory
+  end
+  let(:sizes) { [0, 1, 2, 3, 4, 8, 15, 16, 17, 255, 256, 4090, 65535, 65536, 70_000, 600_000] }
+
+  def ext(type, data)
+    MessagePack.pack(MessagePack::ExtensionValue.new(type, data))
+  end
+
+  it 'writes the smallest header for the payload' do
+    sizes.each do |size|
+      data = "p".b * size
+      expect(factory.dump(raw.new(data))).to eq ext(1, data)
+      [1, 4088, 4093, 16_000].each do |prefix|
+        expect(factory.dump(["s" * prefix, raw.new(data), 3])).to eq "\x93".b + MessagePack.pack("s" * prefix) + ext(1, data) + "\x03".b
+      end
+    end
+  end
+
+  it 'writes nested extensions' do
+    tree = (1..40).inject(nil) { |child, i| node.new("v" * (i * 100), child) }
+    packed = factory.dump(tree)
+    expect(factory.load(packed)).to eq tree
+
+    innermost = "\x92".b + MessagePack.pack("v" * 100) + "\xC0".b
+    expect(packed.end_with?(ext(2, innermost))).to eq true
+  end
+
+  it 'discards the partial payload when the packer raises' do
+    sizes.each do |size|
+      packer = factory.packer
+      packer.write("a" * 5000)
+      expect { packer.write(node.new(1, node.new("b" * 70_000, failing.new(size)))) }.to raise_error(ArgumentError, "failing")
+      packer.write(2)
+      expect(packer.to_s).to eq MessagePack.pack("a" * 5000) + MessagePack.pack(2)
+    end
+  end
+
+  it 'writes through the buffer of a packer with an IO' do
+    io = StringIO.new
+    packer = factory.packer(io)
+    packer.write(["x" * 70_000, node.new(1, raw.new("r" * 70_000))]).flush
+    expect(io.string.b).to eq factory.dump(["x" * 70_000, node.new(1, raw.new("r" * 70_000))])
+  end
+
+  it 'writes into exactly sized buffers' do
+    tree = node.new(1, node.new("v" * 300, raw.new("r")))
+    expect(factory.packer(exact_size: true).write(tree).to_s).to eq factory.dump(tree)
+  end
+
+  it 'raises when the packer is read while packing the payload' do
+    reader = Struct.new(:value)
+    factory.register_type(0x04, reader, packer: ->(r, packer) { packer.write(r.value); packer.buffer.read_all }, unpacker: nil, recursive: true)
+    expect { factory.dump(reader.new(1)) }.to raise_error(RuntimeError, /read while packing a recursive extension/)
+  end
+
+  it 'allocates no String for the payloads' do
+    tree = (1..50).inject(nil) { |child, i| node.new(i, child) }
+    packer = factory.packer
+    packer.write(tree)
+    packer.reset
+
+    allocated = GC.stat(:total_allocated_objects)
+    packer.write(tree)
+    expect(GC.stat(:total_allocated_objects) - allocated).to be < 10
+    expect(factory.load(packer.to_s)).to eq tree
+  end
+end
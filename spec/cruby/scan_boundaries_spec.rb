@@ -0,0 +1,57 @@
+require 'spec_helper'
+
+describe 'MessagePack.scan_boundaries' do
+  let(:objects) do
+    [
+      1, -1, 2**64 - 1, 1.5, nil, true, "str", "x" * 300, "y".b * 70_000,
+      [], {}, [1, [2, [3]]], { "a" => { "b" => [nil, "c"] } },
+      Array.new(20) { |i| { "i" => i } },
+      MessagePack::ExtensionValue.new(1, "ext"),
+      MessagePack::ExtensionValue.new(2, "e" * 16),
+    ]
+  end
+  let(:packed) { objects.map { |object| MessagePack.pack(object) } }
+  let(:data) { packed.join }
+
+  def unpack_ranges(data, ranges)
+    ranges.map { |offset, length| MessagePack.unpack(data.byteslice(offset, length), allow_unknown_ext: true) }
+  end
+
+  it 'returns the offset and length of each top-level object' do
+    ranges = MessagePack.scan_boundaries(data)
+    expect(ranges.map(&:last)).to eq packed.map(&:bytesize)
+    expect(ranges.first.first).to eq 0
+    expect(unpack_ranges(data, ranges)).to eq objects
+  end
+
+  it 'ignores a trailing incomplete object' do
+    expect(MessagePack.scan_boundaries("")).to eq []
+    expect(MessagePack.scan_boundaries(data.byteslice(0, data.bytesize - 1)).size).to eq objects.size - 1
+    expect(MessagePack.scan_boundaries([0x92, 0x01].pack('C*'))).to eq []
+    expect(MessagePack.scan_boundaries([0x01, 0xcd, 0x01].pack('C*'))).to eq [[0, 1]]
+  end
+
+  it 'raises on malformed data' do
+    expect { MessagePack.scan_boundaries([0x01, 0x92, 0x01, 0xc1].pack('C*')) }.to raise_error(MessagePack::MalformedFormatError, /offset 1/)
+  end
+
+  it 'scans many objects' do
+    data = MessagePack.pack({ "k" => [1, 2] }) * 5_000
+    ranges = MessagePack.scan_boundaries(data)
+    expect(ranges.size).to eq 5_000
+    expect(ranges.last).to eq [data.bytesize - 6, 6]
+  end
+
+  it 'scans the readable data of a Buffer' do
+    buffer = MessagePack::Buffer.new
+    data.bytes.each_slice(5) { |bytes| buffer << bytes.pack('C*') }
+    buffer << MessagePack.pack("z" * 600_000)
+    buffer << [0xcd, 0x01].pack('C*')
+    buffer.skip(packed.first.bytesize)
+
+    ranges = buffer.scan_boundaries
+    expect(ranges.size).to eq objects.size
+    expect(unpack_ranges(buffer.to_s, ranges)).to eq objects.drop(1) + ["z" * 600_000]
+    expect(buffer.size).to eq data.bytesize - packed.first.bytesize + 600_005 + 2
+  end
+end
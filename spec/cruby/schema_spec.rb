@@ -0,0 +1,86 @@
+require 'spec_helper'
+
+describe MessagePack::Schema do
+  let(:factory) { MessagePack::Factory.new }
+
+  let(:record) do
+    { "host" => "example.com", "status" => 200, "path" => "/", "tags" => ["a", "b"], "time" => 1.5 }
+  end
+
+  let(:schema) { factory.compile_schema(record.keys) }
+
+  def write_with_schema(schema, obj)
+    factory.packer.write_with_schema(schema, obj).to_s
+  end
+
+  it 'packs Hash records the same as Packer#write' do
+    expect(write_with_schema(schema, record)).to eq factory.dump(record)
+  end
+
+  it 'is frozen and exposes its keys' do
+    expect(schema).to be_frozen
+    expect(schema.keys).to eq record.keys
+    expect(schema.size).to eq 5
+    expect(schema.target).to eq Hash
+  end
+
+  it 'writes missing keys as nil and ignores other keys' do
+    obj = record.merge("extra" => 1)
+    obj.delete("status")
+    expect(MessagePack.unpack(write_with_schema(schema, obj))).to eq record.merge("status" => nil)
+  end
+
+  it 'packs keys in the schema order' do
+    reversed = record.to_a.reverse.to_h
+    expect(write_with_schema(schema, reversed)).to eq factory.dump(record)
+    expect(write_with_schema(schema, record.transform_keys(&:dup))).to eq factory.dump(record)
+  end
+
+  it 'handles empty and large schemas' do
+    expect(write_with_schema(factory.compile_schema([]), {})).to eq "\x80".b
+
+    keys = (1..70_000).map { |i| "key#{i}" }
+    hash = keys.each_with_index.to_h
+    expect(write_with_schema(factory.compile_schema(keys), hash)).to eq factory.dump(hash)
+  end
+
+  it 'encodes keys with the registered types of the factory' do
+    factory.register_type(0x00, Symbol)
+    hash = { a: 1, b: :c }
+    packed = write_with_schema(factory.compile_schema(hash.keys), hash)
+    expect(packed).to eq factory.dump(hash)
+    expect(factory.load(packed)).to eq hash
+  end
+
+  it 'supports Struct classes' do
+    klass = Struct.new(:id, :name)
+    schema = factory.compile_schema(klass)
+    expect(schema.keys).to eq [:id, :name]
+    expect(schema.target).to eq klass
+    expect(write_with_schema(schema, klass.new(1, "foo"))).to eq factory.dump(id: 1, name: "foo")
+  end
+
+  it 'supports Data classes' do
+    skip "Data is not available" unless defined?(::Data.define)
+    klass = Data.define(:id, :name)
+    schema = factory.compile_schema(klass)
+    expect(write_with_schema(schema, klass.new(id: 1, name: "foo"))).to eq factory.dump(id: 1, name: "foo")
+  end
+
+  it 'can be used within a stream of objects' do
+    packer = factory.packer
+    packer.write_array_header(2)
+    packer.write_with_schema(schema, record)
+    packer.write_with_schema(schema, record)
+    expect(MessagePack.unpack(packer.to_s)).to eq [record, record]
+  end
+
+  it 'raises TypeError for mismatching objects' do
+    expect { write_with_schema(schema, []) }.to raise_error(TypeError)
+    expect { write_with_schema(factory.compile_schema(Struct.new(:a)), Struct.new(:a).new(1)) }.to raise_error(TypeError)
+  end
+
+  it 'can not be instantiated directly' do
+    expect { MessagePack::Schema.new }.to raise_error(TypeError)
+  end
+end
@@ -0,0 +1,84 @@
+# frozen_string_literal: true
+
+require 'spec_helper'
+
+describe 'register_type with Time and native: true' do
+  let(:factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(MessagePack::Timestamp::TYPE, Time, native: true)
+    factory
+  end
+
+  let(:ruby_factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(
+      MessagePack::Timestamp::TYPE,
+      Time,
+      packer: MessagePack::Time::Packer,
+      unpacker: MessagePack::Time::Unpacker
+    )
+    factory
+  end
+
+  let(:times) do
+    [
+      Time.at(0),
+      Time.at(1, 1, :nanosecond),
+      Time.at(0xffffffff),
+      Time.at(0x100000000),
+      Time.at((1 << 34) - 1, 999_999_999, :nanosecond),
+      Time.at(1 << 34),
+      Time.at(-1),
+      Time.at(-1, 999_999_999, :nanosecond),
+      Time.at(1_560_733_323, 123_456_789, :nanosecond),
+    ]
+  end
+
+  it 'produces the same payloads as MessagePack::Time::Packer' do
+    times.each do |time|
+      expect(factory.pack(time)).to eq(ruby_factory.pack(time))
+    end
+  end
+
+  it 'round trips Time instances' do
+    times.each do |time|
+      unpacked = factory.unpack(ruby_factory.pack(time))
+      expect(unpacked).to be_instance_of(Time)
+      expect(unpacked).to eq(time)
+    end
+  end
+
+  it 'unpacks timestamps split across several feeds' do
+    packed = factory.pack([times, { 'at' => times.last }])
+    unpacker = factory.unpacker
+    packed.each_char { |byte| unpacker.feed(byte) }
+    expect(unpacker.read).to eq([times, { 'at' => times.last }])
+  end
+
+  it 'freezes unpacked Time instances with freeze: true' do
+    expect(factory.unpacker(freeze: true).feed(factory.pack(times.first)).read).to be_frozen
+  end
+
+  it 'falls back to MessagePack::Time::Packer for subclasses of Time' do
+    subclass = Class.new(Time)
+    time = subclass.at(1, 1, :nanosecond)
+    expect(factory.pack(time)).to eq(ruby_factory.pack(time))
+  end
+
+  it 'raises MalformedFormatError for invalid payload sizes' do
+    expect do
+      factory.unpack([0xd5, -1, 0, 0].pack("CcCC"))
+    end.to raise_error(MessagePack::MalformedFormatError)
+  end
+
+  it 'is only allowed for Time' do
+    expect do
+      MessagePack::Factory.new.register_type(MessagePack::Timestamp::TYPE, String, native: true)
+    end.to raise_error(ArgumentError)
+  end
+
+  it 'is overridden by a later registration' do
+    factory.register_type(MessagePack::Timestamp::TYPE, MessagePack::Timestamp)
+    expect(factory.unpack(ruby_factory.pack(Time.at(1)))).to eq(MessagePack::Timestamp.new(1, 0))
+  end
+end
@@ -0,0 +1,68 @@
+require 'spec_helper'
+require 'stringio'
+
+describe 'Unpacker#read_typed_array' do
+  let(:floats) { Array.new(10_000) { |i| i * 0.25 - 100 } }
+  let(:ints) { [0, 1, -1, 127, -32, -33, 255, 256, -129, 65535, 2**31 - 1, -2**31, 2**32, -2**40] }
+
+  def read(object, type)
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(MessagePack.pack(object))
+    unpacker.read_typed_array(type)
+  end
+
+  it 'returns the elements as native-endian binary' do
+    expect(read(floats, :float64)).to eq floats.pack('d*')
+    expect(read(floats, :float32)).to eq floats.pack('f*')
+    expect(read(ints, :int64)).to eq ints.pack('q*')
+    expect(read(ints, :float64)).to eq ints.map(&:to_f).pack('d*')
+    expect(read([0, 1, 255, 2**64 - 1], :uint64)).to eq [0, 1, 255, 2**64 - 1].pack('Q*')
+    expect(read([-128, 127], :int8)).to eq [-128, 127].pack('c*')
+    expect(read([0, 65535], :uint16)).to eq [0, 65535].pack('S*')
+    expect(read([], :int32)).to eq ""
+    expect(read(floats, :float64).encoding).to eq Encoding::BINARY
+  end
+
+  it 'raises if an element does not fit the type and skips the array' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(MessagePack.pack([1, 300, [2]]) + MessagePack.pack([1, 1.5]) + MessagePack.pack([1, "x"]) + MessagePack.pack(7))
+    expect { unpacker.read_typed_array(:int8) }.to raise_error(RangeError)
+    expect { unpacker.read_typed_array(:int32) }.to raise_error(MessagePack::UnexpectedTypeError)
+    expect { unpacker.read_typed_array(:float64) }.to raise_error(MessagePack::UnexpectedTypeError)
+    expect(unpacker.read).to eq 7
+    expect { read([-1], :uint32) }.to raise_error(RangeError)
+  end
+
+  it 'leaves other objects to be read' do
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(MessagePack.pack({ "a" => 1 }))
+    expect { unpacker.read_typed_array(:int8) }.to raise_error(MessagePack::UnexpectedTypeError)
+    expect(unpacker.read).to eq({ "a" => 1 })
+  end
+
+  it 'raises ArgumentError on an unknown type' do
+    expect { read([1], :int128) }.to raise_error(ArgumentError)
+  end
+
+  it 'reads arrays split across chunks' do
+    data = MessagePack.pack(floats)
+    unpacker = MessagePack::Unpacker.new
+    data.bytes.each_slice(100) { |bytes| unpacker.feed(bytes.pack('C*')) }
+    expect(unpacker.read_typed_array(:float64)).to eq floats.pack('d*')
+  end
+
+  it 'can be retried after EOFError' do
+    data = MessagePack.pack(floats)
+    unpacker = MessagePack::Unpacker.new
+    unpacker.feed(data.byteslice(0, 5_000))
+    expect { unpacker.read_typed_array(:float64) }.to raise_error(EOFError)
+    unpacker.feed(data.byteslice(5_000..-1))
+    expect(unpacker.read_typed_array(:float64)).to eq floats.pack('d*')
+  end
+
+  it 'reads from an IO' do
+    unpacker = MessagePack::Unpacker.new(StringIO.new(MessagePack.pack(floats) * 3), io_buffer_size: 4096)
+    3.times { expect(unpacker.read_typed_array(:float64)).to eq floats.pack('d*') }
+    expect { unpacker.read_typed_array(:float64) }.to raise_error(EOFError)
+  end
+end
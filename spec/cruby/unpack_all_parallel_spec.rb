@@ -0,0 +1,93 @@
+require 'spec_helper'
+
+describe 'Factory#unpack_all_parallel' do
+  before do
+    @experimental, Warning[:experimental] = Warning[:experimental], false if defined?(Ractor)
+  end
+
+  after do
+    Warning[:experimental] = @experimental if defined?(Ractor)
+  end
+
+  let(:factory) do
+    factory = MessagePack::Factory.new
+    factory.register_type(0x00, Symbol)
+    factory
+  end
+  let(:objects) { Array.new(500) { |i| { "id" => i, "type" => :event, "payload" => "x" * (i % 50) } } }
+  let(:data) { objects.map { |object| factory.dump(object) }.join }
+
+  it 'returns the objects in order' do
+    [1, 2, 3, 8].each do |workers|
+      expect(factory.unpack_all_parallel(data, workers: workers)).to eq objects
+    end
+    expect(factory.unpack_all_parallel(data)).to eq objects
+  end
+
+  it 'returns an empty array for empty data' do
+    expect(factory.unpack_all_parallel("", workers: 2)).to eq []
+  end
+
+  it 'handles more workers than objects' do
+    data = factory.dump(1) + factory.dump(:two)
+    expect(factory.unpack_all_parallel(data, workers: 16)).to eq [1, :two]
+  end
+
+  it 'passes options to the unpackers' do
+    result = factory.unpack_all_parallel(data, workers: 2, symbolize_keys: true, freeze: true)
+    expect(result.last).to eq({ id: 499, type: :event, payload: "x" * 49 })
+    expect(result.last).to be_frozen
+  end
+
+  it 'freezes neither the factory nor the data' do
+    factory.unpack_all_parallel(data, workers: 2)
+    expect(factory).not_to be_frozen
+    expect(data).not_to be_frozen
+    expect { factory.register_type(0x01, Symbol) }.not_to raise_error
+  end
+
+  it 'does not freeze the options' do
+    raw_keys = ["payload"]
+    result = factory.unpack_all_parallel(data, workers: 2, raw_keys: raw_keys)
+    expect(result.last["payload"]).to eq MessagePack.pack("x" * 49)
+    expect(raw_keys).not_to be_frozen
+    expect(raw_keys.first).not_to be_frozen
+  end
+
+  it 'reuses the shareable copy of the factory until it changes' do
+    skip "Ractor is not available" unless defined?(Ractor.make_shareable)
+    factory.unpack_all_parallel(data, workers: 2)
+    copy = factory.send(:shareable_factory)
+    expect(Ractor.shareable?(copy)).to eq true
+    expect(factory.send(:shareable_factory)).to equal copy
+
+    factory.key_dictionary = ["id", "type", "payload"]
+    expect(factory.send(:shareable_factory)).not_to equal copy
+    expect(factory.send(:shareable_factory).key_dictionary).to equal factory.key_dictionary
+    expect(factory.unpack_all_parallel(data, workers: 2)).to eq objects
+  end
+
+  it 'unpacks sequentially when the procs are not shareable' do
+    calls = 0
+    klass = Struct.new(:value)
+    factory.register_type(0x01, klass,
+      packer: ->(object) { object.value.to_s },
+      unpacker: ->(payload) { calls += 1; klass.new(payload.to_i) })
+    data = Array.new(10) { |i| factory.dump(klass.new(i)) }.join
+    expect(factory.unpack_all_parallel(data, workers: 2)).to eq Array.new(10) { |i| klass.new(i) }
+    expect(calls).to eq 10
+    expect(factory.unpack_all_parallel(data, workers: 2).size).to eq 10
+  end
+
+  it 'raises EOFError on an incomplete object' do
+    [1, 2].each do |workers|
+      expect { factory.unpack_all_parallel(data.byteslice(0, data.bytesize - 1), workers: workers) }.to raise_error(EOFError)
+    end
+  end
+
+  it 'raises the errors of the workers' do
+    expect { factory.unpack_all_parallel(data + [0xc1].pack('C'), workers: 2) }.to raise_error(MessagePack::MalformedFormatError)
+    data = MessagePack::Factory.new.dump(MessagePack::ExtensionValue.new(0x02, "")) * 4
+    expect { factory.unpack_all_parallel(data, workers: 2) }.to raise_error(MessagePack::UnknownExtTypeError)
+  end
+end
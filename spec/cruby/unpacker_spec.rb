@@ -66,5 +66,153 @@ describe Unpacker do
       unpacker.skip
     }.should raise_error(MessagePack::MalformedFormatError)
   end
-end
 
+  describe 'key_cache' do
+    let(:keys) { (1..300).map { |i| "key_#{i}".force_encoding(Encoding::UTF_8) } }
+    let(:data) { MessagePack.pack(keys.each_slice(10).map { |slice| slice.to_h { |k| [k, 1] } }) }
+
+    it 'returns the same frozen keys as without the cache' do
+      [true, 16, 4096].each do |key_cache|
+        unpacker = Unpacker.new(key_cache: key_cache)
+        2.times do
+          unpacker.feed(data)
+          result = unpacker.read
+          result.should == MessagePack.unpack(data)
+          result.flat_map(&:keys).each { |k| k.should be_frozen }
+        end
+      end
+    end
+
+    it 'returns symbols when symbolize_keys is set' do
+      unpacker = Unpacker.new(key_cache: true, symbolize_keys: true)
+      2.times do
+        unpacker.feed(data)
+        unpacker.read.should == MessagePack.unpack(data, symbolize_keys: true)
+      end
+    end
+
+    it 'counts hits, misses and evictions' do
+      unpacker = Unpacker.new(key_cache: 1000)
+      unpacker.feed(data)
+      unpacker.read
+      stats = unpacker.key_cache_stats
+      stats[:capacity].should == 1024
+      stats[:misses].should == 300
+      stats[:hits].should == 0
+
+      unpacker.feed(data)
+      unpacker.read
+      stats = unpacker.key_cache_stats
+      (stats[:hits] + stats[:misses]).should == 600
+      stats[:size].should == 300 - stats[:evictions]
+      stats[:hits].should > 200
+    end
+
+    it 'evicts entries when the capacity is exceeded' do
+      unpacker = Unpacker.new(key_cache: 32)
+      3.times do
+        unpacker.feed(data)
+        unpacker.read.should == MessagePack.unpack(data)
+      end
+      stats = unpacker.key_cache_stats
+      stats[:capacity].should == 32
+      stats[:size].should <= 32
+      stats[:evictions].should > 0
+    end
+
+    it 'can be disabled' do
+      [false, 0, nil].each do |key_cache|
+        unpacker = Unpacker.new(key_cache: key_cache)
+        unpacker.feed(data)
+        unpacker.read
+        unpacker.key_cache_stats.should == { capacity: 0, size: 0, hits: 0, misses: 0, evictions: 0 }
+      end
+    end
+
+    it 'rejects invalid capacities' do
+      lambda { Unpacker.new(key_cache: -1) }.should raise_error(ArgumentError)
+      lambda { Unpacker.new(key_cache: 2**40) }.should raise_error(ArgumentError)
+    end
+
+    it 'can be configured from a factory' do
+      unpacker = MessagePack::Factory.new.unpacker(key_cache: 64)
+      unpacker.key_cache_stats[:capacity].should == 64
+    end
+  end
+
+  describe 'nogvl_threshold' do
+    let :large_bin do
+      Random.new(1).bytes(3 * 1024 * 1024)
+    end
+
+    it 'reads bodies spread over several chunks' do
+      packed = MessagePack.pack([large_bin, "tail"])
+      unpacker = MessagePack::Unpacker.new(nogvl_threshold: 64 * 1024)
+      (0...packed.bytesize).step(700 * 1024) { |i| unpacker.feed(packed.byteslice(i, 700 * 1024)) }
+      unpacker.read.should == [large_bin, "tail"]
+    end
+
+    it 'reads bodies from a single copied chunk' do
+      str = ("\u3042" * 100_000).force_encoding(Encoding::UTF_8)
+      packed = MessagePack.pack(str)
+      packed.bytesize.should < 512 * 1024 # copied by feed instead of referred
+
+      unpacker = MessagePack::Unpacker.new(nogvl_threshold: 64 * 1024, freeze: true)
+      unpacker.feed(packed)
+      result = unpacker.read
+      result.should == str
+      result.encoding.should == Encoding::UTF_8
+      result.should be_frozen
+    end
+
+    it 'reads bodies streamed from an IO' do
+      packed = MessagePack.pack({ "a" => large_bin, "b" => large_bin.reverse })
+      unpacker = MessagePack::Unpacker.new(StringIO.new(packed), nogvl_threshold: 0)
+      unpacker.read.should == { "a" => large_bin, "b" => large_bin.reverse }
+    end
+
+    it 'appends to the outbuf of Buffer#read and unlocks it afterwards' do
+      buffer = MessagePack::Buffer.new(nogvl_threshold: 64 * 1024)
+      (0...large_bin.bytesize).step(100 * 1024) { |i| buffer << large_bin.byteslice(i, 100 * 1024) }
+      outbuf = "head".b
+      buffer.read(large_bin.bytesize, outbuf).should equal(outbuf)
+      outbuf.should == large_bin
+      outbuf << "tail"
+      outbuf.bytesize.should == large_bin.bytesize + 4
+    end
+
+    it 'packs into a single String' do
+      packer = MessagePack::Packer.new(nogvl_threshold: 64 * 1024)
+      packer.write(Array.new(20_000) { |i| "element #{i}" })
+      packer.write(large_bin)
+      packer.to_s.should == MessagePack.pack(Array.new(20_000) { |i| "element #{i}" }) + MessagePack.pack(large_bin)
+    end
+
+    it 'raises ThreadError when another thread frees the chunks being copied' do
+      # copies large_bin into a malloc'ed chunk instead of referring to it
+      packer = MessagePack::Packer.new(nogvl_threshold: 64 * 1024, write_reference_threshold: 16 * 1024 * 1024)
+      packer.write("x" * 100)
+      packer.write(large_bin)
+      expected = MessagePack.pack("x" * 100) + MessagePack.pack(large_bin)
+
+      writer = Thread.new do
+        100.times do
+          begin
+            packer.reset
+            packer.write("x" * 100)
+            packer.write(large_bin)
+          rescue ThreadError
+          end
+          Thread.pass
+        end
+      end
+      100.times { packer.to_s }
+      writer.join
+
+      lambda { packer.reset }.should_not raise_error
+      packer.write("x" * 100)
+      packer.write(large_bin)
+      packer.to_s.should == expected
+    end
+  end
+end
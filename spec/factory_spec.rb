@@ -328,6 +328,29 @@ describe MessagePack::Factory do
         it { is_expected.to eq "\xC7\x0F\x01value_msgpacked".force_encoding(Encoding::BINARY) }
       end
 
+      describe "packing an object whose class gets the module after a first pack" do
+        let(:klass) { Class.new { def to_msgpack(packer); packer.write_nil; end } }
+        let(:packed) { "\xC7\x0F\x01value_msgpacked".force_encoding(Encoding::BINARY) }
+
+        it 'uses the module included, prepended or extended since then' do
+          [:include, :prepend].each do |method|
+            packer = factory.packer
+            subclass = Class.new(klass)
+            expect(packer.write(subclass.new).to_s).to eq "\xC0".b
+            subclass.send(method, Mod)
+            packer.reset
+            expect(packer.write(subclass.new).to_s).to eq packed
+          end
+
+          packer = factory.packer
+          object = klass.new
+          expect(packer.write(object).to_s).to eq "\xC0".b
+          object.extend(Mod)
+          packer.reset
+          expect(packer.write(object).to_s).to eq packed
+        end
+      end
+
       describe "unpacking with the module" do
         subject { factory.unpacker.feed("\xC7\x06\x01module".force_encoding(Encoding::BINARY)).unpack }
         it { is_expected.to eq "unpacked module" }
@@ -506,6 +506,35 @@ describe MessagePack::Packer do
     it_behaves_like 'extension subclasses core type', Array
     it_behaves_like 'extension subclasses core type', String
 
+    context 'when a type is registered after packing' do
+      before { stub_const('Value', Class.new(Hash)) }
+
+      it 'packs with the new type' do
+        expect(packer.write(Value.new).to_s).to eq "\x80"
+        packer.register_type(0x01, Value, ->(_) { 'value_msgpacked' })
+        expect(packer.write(Value.new).to_s).to eq "\x80\xC7\x0F\x01value_msgpacked"
+        packer.register_type(0x02, Value, ->(_) { 'value_msgpacked' })
+        expect(packer.write(Value.new).to_s).to eq "\x80\xC7\x0F\x01value_msgpacked\xC7\x0F\x02value_msgpacked"
+      end
+    end
+
+    context 'when packing more classes than cached' do
+      let(:classes) { Array.new(10) { Class.new(Array) } }
+      before do
+        classes.each_with_index do |klass, i|
+          packer.register_type(i, klass, ->(_) { i.to_s }) if i.even?
+        end
+      end
+
+      it 'packs each class with its type' do
+        3.times do
+          classes.each { |klass| packer.write(klass.new) }
+        end
+        expected = Array.new(10) { |i| i.even? ? [0xd4, i, 0x30 + i].pack('C*') : "\x90" }.join
+        expect(packer.to_s).to eq expected * 3
+      end
+    end
+
     context 'when registering a type for symbols' do
       before { packer.register_type(0x00, ::Symbol, :to_msgpack_ext) }
 
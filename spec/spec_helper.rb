@@ -57,6 +57,18 @@ def string_deduplication?
   (-r1).equal?(-r2)
 end
 
+# an IO reaching its end until more data is appended to it
+def growing_io(data)
+  io = Object.new
+  io.define_singleton_method(:<<) { |more| data << more; io }
+  io.define_singleton_method(:readpartial) do |n, outbuf = nil|
+    raise EOFError if data.empty?
+    s = data.slice!(0, n)
+    outbuf ? outbuf.replace(s) : s
+  end
+  io
+end
+
 if IS_JRUBY
   RSpec.configure do |c|
     c.treat_symbols_as_metadata_keys_with_true_values = true